@@ -100,5 +100,6 @@ end
 
     dofile "tool_hash.lua"
     dofile "tool_doc.lua"
+    dofile "tool_cdb_bench.lua"
 
     dofile "cetech.lua"
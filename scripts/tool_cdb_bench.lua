@@ -0,0 +1,12 @@
+project "cdb_bench"
+	kind "ConsoleApp"
+
+	use_celib()
+
+	files {
+		path.join(CETECH_DIR, "src/tools/cdb_bench/**.c"),
+	}
+
+	copy_to_bin()
+
+	configuration {}
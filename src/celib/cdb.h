@@ -8,6 +8,7 @@
 #include <celib/module.inl>
 
 struct ce_alloc;
+struct ce_vio;
 
 struct ce_cdb_t {
     uint64_t idx;
@@ -15,6 +16,23 @@ struct ce_cdb_t {
 
 typedef void ce_cdb_obj_o;
 
+struct ce_cdb_stats {
+    // live objects
+    uint64_t objects;
+
+    // live object versions, include writers and versions waiting for gc
+    uint64_t versions;
+
+    uint64_t max_objects;
+
+    // memory allocated by object pools
+    uint64_t pool_bytes;
+};
+
+struct ce_cdb_prop_h {
+    uint64_t h;
+};
+
 typedef void (*ce_cdb_notify)(uint64_t obj,
                               const uint64_t *prop,
                               uint32_t prop_count,
@@ -40,10 +58,24 @@ enum ce_cdb_type {
 struct ce_cdb_a0 {
     struct ce_cdb_t (*db)();
 
+    // max_objects 0 use default limit, pools grow on demand up to limit.
+    struct ce_cdb_t (*create_db)(uint64_t max_objects);
+
+    void (*db_stats)(struct ce_cdb_t db,
+                     struct ce_cdb_stats *stats);
+
     void (*register_notify)(uint64_t obj,
                             ce_cdb_notify notify,
                             void *data);
 
+    // Changes are coalesced per object and delivered by flush_notify.
+    void (*register_notify_deferred)(uint64_t obj,
+                                     ce_cdb_notify notify,
+                                     void *data);
+
+    // Deliver deferred notifications, kernel call it once per frame.
+    void (*flush_notify)();
+
     uint64_t (*create_object)(struct ce_cdb_t db,
                               uint64_t type);
 
@@ -54,6 +86,9 @@ struct ce_cdb_a0 {
 
     void (*destroy_object)(uint64_t obj);
 
+    // Dense index of object in its db, index is reused after object is freed.
+    uint32_t (*obj_index)(uint64_t obj);
+
     uint64_t (*type)(uint64_t obj);
     void (*set_type)(uint64_t obj, uint64_t type);
 
@@ -63,11 +98,37 @@ struct ce_cdb_a0 {
                  char **output,
                  struct ce_alloc *allocator);
 
+    // Dump with compressed payload, use for big objects (meshes, blobs).
+    void (*dump_compressed)(uint64_t obj,
+                            char **output,
+                            struct ce_alloc *allocator);
+
     void (*load)(struct ce_cdb_t db,
                  const char *input,
                  uint64_t obj,
                  struct ce_alloc *allocator);
 
+    // Load without copy strings and blobs, they point to mapped input.
+    // Input is unmapped when gc free obj, use for build artifacts.
+    void (*load_mapped)(struct ce_cdb_t db,
+                        struct ce_vio *input,
+                        uint64_t obj,
+                        struct ce_alloc *allocator);
+
+    // SNAPSHOT
+    // Snapshot share unchanged objects with db, restore cost is number of
+    // objects changed since snapshot. Objects destroyed after snapshot are
+    // not restored.
+    uint64_t (*commit_counter)(struct ce_cdb_t db);
+
+    uint64_t (*snapshot)(struct ce_cdb_t db);
+
+    void (*release_snapshot)(struct ce_cdb_t db,
+                             uint64_t snapshot);
+
+    void (*restore_snapshot)(struct ce_cdb_t db,
+                             uint64_t snapshot);
+
     // PROP
     bool (*prop_exist)(uint64_t object,
                        uint64_t key);
@@ -85,6 +146,9 @@ struct ce_cdb_a0 {
     // WRITE
     ce_cdb_obj_o *(*write_begin)(uint64_t object);
 
+    // Writer on full copy of object, use for large edits.
+    ce_cdb_obj_o *(*write_begin_clone)(uint64_t object);
+
     void (*write_commit)(ce_cdb_obj_o *writer);
 
     bool (*write_try_commit)(ce_cdb_obj_o *writer);
@@ -139,6 +203,11 @@ struct ce_cdb_a0 {
     void (*set_prefab)(uint64_t obj,
                        uint64_t prefab);
 
+    // Instances of obj use new_prefab as prefab, they are notified with
+    // properties of both prefabs. Use when reloaded object replace obj.
+    void (*move_instances)(uint64_t obj,
+                           uint64_t new_prefab);
+
 
     // READ
     float (*read_float)(uint64_t object,
@@ -186,6 +255,35 @@ struct ce_cdb_a0 {
                        uint64_t property,
                        uint64_t *size,
                        void *defaultt);
+
+    // HANDLE
+    // Resolve property once, reads through handle skip key lookup for
+    // recently seen layouts. Handle is shared by all types with key.
+    struct ce_cdb_prop_h (*prop_handle)(uint64_t key);
+
+    uint64_t (*read_uint64_h)(uint64_t object,
+                              struct ce_cdb_prop_h prop,
+                              uint64_t defaultt);
+
+    uint64_t (*read_ref_h)(uint64_t object,
+                           struct ce_cdb_prop_h prop,
+                           uint64_t defaultt);
+
+    uint64_t (*read_subobject_h)(uint64_t object,
+                                 struct ce_cdb_prop_h prop,
+                                 uint64_t defaultt);
+
+    float (*read_float_h)(uint64_t object,
+                          struct ce_cdb_prop_h prop,
+                          float defaultt);
+
+    void (*read_vec4_h)(uint64_t object,
+                        struct ce_cdb_prop_h prop,
+                        float *value);
+
+    const char *(*read_str_h)(uint64_t object,
+                              struct ce_cdb_prop_h prop,
+                              const char *defaultt);
 };
 
 CE_MODULE(ce_cdb_a0);
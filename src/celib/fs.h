@@ -66,6 +66,12 @@ struct ce_fs_a0 {
                           char *fullpath,
                           uint32_t max_len);
 
+    // Files written in watched mount points since last call, path is
+    // relative to mount point. Free with listdir_free.
+    void (*changed_files)(uint64_t root,
+                          char ***files,
+                          uint32_t *count,
+                          struct ce_alloc *allocator);
 };
 
 CE_MODULE(ce_fs_a0);
@@ -17,9 +17,11 @@ struct ce_handler_t {
 #define _INDEXBITCOUNT 22
 #define _MINFREEINDEXS 1024
 
+#define _GENMASK ((1 << _GENBITCOUNT) - 1)
+
 #define _idx(h) ((h) >> _INDEXBITCOUNT)
-#define _gen(h) ((h) & ((1 << (_GENBITCOUNT - 1))))
-#define _make_entity(idx, gen) (uint64_t)(((idx) << _INDEXBITCOUNT) | (gen))
+#define _gen(h) ((h) & _GENMASK)
+#define _make_entity(idx, gen) (uint64_t)(((idx) << _INDEXBITCOUNT) | ((gen) & _GENMASK))
 
 static inline uint64_t ce_handler_create(struct ce_handler_t *handler,
                                          const struct ce_alloc *allocator) {
@@ -48,7 +50,7 @@ static inline void ce_handler_destroy(struct ce_handler_t *handler,
 
 static inline bool ce_handler_alive(struct ce_handler_t *handler,
                                     uint64_t handlerid) {
-    return handler->_generation[_idx(handlerid)] == _gen(handlerid);
+    return (handler->_generation[_idx(handlerid)] & _GENMASK) == _gen(handlerid);
 }
 
 static inline void ce_handler_free(struct ce_handler_t *handler,
@@ -155,14 +155,39 @@ static inline void ce_hash_add(struct ce_hash_t *hash,
 }
 
 
+// Remove *k*
 static inline void ce_hash_remove(struct ce_hash_t *hash,
                                   uint64_t k) {
-    const uint32_t idx = ce_hash_find_slot(hash, k);
-    if (hash->keys[idx] == k) {
-        hash->keys[idx] = EMPTY_SLOT;
-        hash->values[idx] = 0;
+    if (!hash->n) {
+        return;
+    }
+
+    uint32_t idx = ce_hash_find_slot(hash, k);
+    if (hash->keys[idx] != k) {
         return;
     }
+
+    hash->keys[idx] = EMPTY_SLOT;
+    hash->values[idx] = 0;
+
+    // Shift back rest of the probe chain so lookups never stop at the hole.
+    uint32_t next = (idx + 1) % hash->n;
+    while (hash->keys[next] != EMPTY_SLOT) {
+        const uint32_t home = hash->keys[next] % hash->n;
+
+        const bool in_chain = (idx <= next) ? ((idx < home) && (home <= next))
+                                            : ((idx < home) || (home <= next));
+
+        if (!in_chain) {
+            hash->keys[idx] = hash->keys[next];
+            hash->values[idx] = hash->values[next];
+            hash->keys[next] = EMPTY_SLOT;
+            hash->values[next] = 0;
+            idx = next;
+        }
+
+        next = (next + 1) % hash->n;
+    }
 }
 
 static inline void ce_hash_clone(const struct ce_hash_t *from,
@@ -134,12 +134,21 @@ struct ce_os_path_a0 {
 
 struct ce_os_process_a0 {
     int (*exec)(const char *argv);
+
+    // Run executable without shell and wait for it.
+    // - argv Full path to executable followed by arguments, NULL terminated
+    // - output Captured stdout and stderr (ce_array), can be NULL
+    // - return Exit code or -1
+    int (*run)(const char *const *argv,
+               char **output,
+               struct ce_alloc *allocator);
 };
 
 
 // # Thread
 
 typedef void ce_thread_t;
+typedef void ce_semaphore_t;
 
 typedef int (*ce_thread_fce_t)(void *data);
 
@@ -178,6 +187,19 @@ struct ce_os_thread_a0 {
     void (*spin_lock)(struct ce_spinlock *lock);
 
     void (*spin_unlock)(struct ce_spinlock *lock);
+
+    // Create semaphore
+    // - value Initial value
+    ce_semaphore_t *(*sem_create)(uint32_t value);
+
+    // Destroy semaphore
+    void (*sem_destroy)(ce_semaphore_t *sem);
+
+    // Wait until value is positive and decrement it
+    void (*sem_wait)(ce_semaphore_t *sem);
+
+    // Increment value
+    void (*sem_post)(ce_semaphore_t *sem);
 };
 
 
@@ -229,6 +251,14 @@ struct ce_vio {
                     size_t num);
 
     int (*close)(struct ce_vio *vio);
+
+    // Map whole file read-only, mapping stay valid after close.
+    // Return NULL if vio can not be mapped.
+    const void *(*map)(struct ce_vio *vio);
+
+    // Release mapping returned by map, size is size of vio.
+    void (*unmap)(const void *data,
+                  uint64_t size);
 };
 
 struct ce_os_vio_a0 {
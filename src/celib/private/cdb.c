@@ -2,7 +2,7 @@
 #include <string.h>
 #include <stdatomic.h>
 
-#include <sys/mman.h>
+#include <zlib.h>
 
 #include <celib/macros.h>
 #include <celib/api_system.h>
@@ -18,9 +18,18 @@
 #define _G coredb_global
 #define LOG_WHERE "coredb"
 
-#define MAX_OBJECTS 1000000000ULL
-#define MAX_FREE_OBJECE_POOL 10000
-#define MAX_FREE_OBJECE_ID_POOL 10000
+#define MAX_DBS 64
+#define DEFAULT_MAX_OBJECTS (1ULL << 24)
+#define POOL_SEGMENT_SHIFT 12
+#define POOL_SEGMENT_SIZE (1U << POOL_SEGMENT_SHIFT)
+#define POOL_SEGMENT_MASK (POOL_SEGMENT_SIZE - 1)
+#define OBJECT_RETIRED (1U << 31)
+#define GC_STEP 16384
+#define MAX_PROP_HANDLES 4096
+
+// Layouts cached per property handle, property is read from objects of
+// more types.
+#define PROP_HANDLE_CACHE 8
 
 // TODO: non optimal braindump code
 // TODO: remove null element
@@ -28,77 +37,33 @@
 struct notify_pair {
     ce_cdb_notify notify;
     void *data;
+    bool deferred;
 };
 
-struct object_t {
-    struct notify_pair *notify;
-
-    // prefab
-    uint64_t prefab;
-    uint64_t *instances;
-
-    // hiearchy
-    uint64_t parent;
-//    uint64_t *children;
-
-    // writer
-    uint64_t orig_data_idx;
+// Changes of object waiting for flush_notify, props are unique.
+struct queued_notify_t {
     uint64_t obj;
-    uint64_t *changed_prop;
+    uint64_t *props;
+};
 
-    // object
-    uint64_t type;
-    uint64_t idx;
-    struct ce_cdb_t db;
-    struct ce_hash_t prop_map;
+// Property layout. Versions of object share layout until writer add property,
+// objects with same properties share interned layout.
+struct object_layout_t {
+    atomic_uint refs;
+
+    // New id on every change, property handles cache offset by it.
+    uint32_t id;
 
     uint64_t properties_count;
 
     uint64_t *keys;
     uint8_t *property_type;
     uint64_t *offset;
-    uint8_t *values;
-};
-
-struct db_t {
-    uint32_t idx;
-
-    // id pool
-    uint64_t *objects_mem;
-    atomic_ullong object_used;
-
-    uint32_t *free_objects_id;
-    uint32_t *to_free_objects_id;
-    atomic_ullong to_free_objects_id_n;
-    atomic_ullong free_objects_id_n;
-
-//    // Hiearchy
-//    uint32_t *first_child;
-//    uint32_t *next_sibling;
-//    uint32_t *parent;
-
-    // objects
-    struct object_t *object_pool;
-    uint32_t *free_objects;
-    uint32_t *to_free_objects;
-
-    atomic_uint_least64_t object_pool_n;
-    atomic_uint_least64_t free_objects_n;
-    atomic_uint_least64_t to_free_objects_n;
-};
-
-static struct _G {
-    struct db_t *dbs;
-    uint32_t *free_db;
-    uint32_t *to_free_db;
-
-    struct ce_alloc *allocator;
-    struct ce_cdb_t global_db;
-} _G;
+    struct ce_hash_t prop_map;
 
-struct blob_t {
-    void *data;
-    uint64_t size;
+    // Interned layout is in layout_map under hash, map hold one reference.
+    uint64_t hash;
+    bool interned;
 };
 
 union type_u {
@@ -114,503 +79,1570 @@ union type_u {
     float vec3[3];
     float vec4[4];
     float mat4[16];
-    struct blob_t blob;
+    struct blob_t {
+        void *data;
+        uint64_t size;
+    } blob;
 };
 
-static struct object_t *_get_object_from_objid(uint64_t objid) {
-    uint64_t idx = *(uint64_t *) objid;
+struct delta_t {
+    uint64_t key;
+    uint64_t type;
+    union type_u value;
+};
 
-    return &_G.dbs[0].object_pool[idx];
-}
+// Object id is address of slot, slot hold index of current object version.
+struct object_slot_t {
+    atomic_ullong version;
+    uint32_t idx;
+    uint32_t db;
 
-static struct object_t *_get_object_from_obj_o(ce_cdb_obj_o *obj_o) {
-    uint64_t idx = (uint64_t) obj_o;
+    uint64_t type;
 
-    return &_G.dbs[0].object_pool[idx];
-}
+    // prefab
+    uint64_t prefab;
+    uint64_t *instances;
 
-static uint64_t _object_new_property(struct object_t *obj,
-                                     uint64_t key,
-                                     enum ce_cdb_type type,
-                                     const void *value,
-                                     size_t size,
-                                     const struct ce_alloc *alloc) {
+    // hiearchy
+    uint64_t parent;
 
-    const uint64_t prop_count = obj->properties_count;
-    const uint64_t values_size = ce_array_size(obj->values);
+    struct notify_pair *notify;
 
-    ce_array_push(obj->keys, key, alloc);
-    ce_array_push(obj->property_type, type, alloc);
-    ce_array_push(obj->offset, values_size, alloc);
+    // Guard instances and notify, objects are created from any thread.
+    struct ce_spinlock lock;
 
-    if (size) {
-        ce_array_resize(obj->values, values_size + size, alloc);
-    }
+    // Instance properties merged with all prefabs, built on first read and
+    // dropped in _notify.
+    _Atomic(struct object_t *) flat;
+    atomic_uint flat_gen;
 
-    ce_hash_add(&obj->prop_map, key, prop_count, alloc);
+    // Destroyed while snapshot exist, slot is not reused until snapshots
+    // are released.
+    bool destroyed;
 
-    obj->properties_count = obj->properties_count + 1;
-    return prop_count;
-}
+    // Loaded by load_mapped, own borrowed ranges.
+    bool borrowed;
+};
 
-struct object_t *_new_object(struct db_t *db,
-                             const struct ce_alloc *a) {
+// Object version
+struct object_t {
+    uint64_t idx;
+    struct ce_cdb_t db;
 
-    uint32_t idx;
-    if (db->free_objects_n) {
-        atomic_fetch_sub(&db->free_objects_n, 1);
-        idx = db->free_objects[db->free_objects_n];
-    } else {
-        idx = atomic_fetch_add(&db->object_pool_n, 1);
+    struct object_layout_t *layout;
+    uint8_t *values;
 
-        db->object_pool[idx] = (struct object_t) {0};
-    }
+    // writer
+    uint64_t orig_data_idx;
+    uint64_t obj;
+    uint64_t *changed_prop;
+    bool clone;
 
+    // delta writer record only changed properties and apply them on commit.
+    struct delta_t *delta;
 
-    struct object_t *obj = &db->object_pool[idx];
-    obj->idx = idx;
-    obj->db.idx = db->idx;
+    // strings and blobs to free after commit / after failed commit
+    void **replaced;
+    void **owned;
 
-    _object_new_property(obj, 0, CDB_TYPE_NONE, NULL, 0, a);
-    return obj;
-}
+    // replaced strings and blobs freed with this version by gc, readers
+    // of retired version and prefab flats still can see them.
+    void **garbage;
 
-static uint64_t _new_object_id(struct db_t *db_inst) {
-    uint64_t idx = 0;
-    if (db_inst->free_objects_id_n) {
-        atomic_fetch_sub(&db_inst->free_objects_id_n, 1);
-        idx = db_inst->free_objects_id[db_inst->free_objects_id_n];
-    } else {
-        idx = atomic_fetch_add(&db_inst->object_used, 1);
-    }
+    // snapshot references | OBJECT_RETIRED
+    atomic_uint hold;
+};
 
-    return idx;
-}
+struct prop_handle_t {
+    uint64_t key;
 
-static struct object_t *_object_clone(struct db_t *db,
-                                      struct object_t *obj,
-                                      const struct ce_alloc *alloc) {
-    const uint64_t properties_count = obj->properties_count;
-    const uint64_t values_size = ce_array_size(obj->values);
+    // layout id << 32 | value offset + 1, slot by layout id
+    atomic_ullong cache[PROP_HANDLE_CACHE];
+};
 
-    struct object_t *new_obj = _new_object(db, alloc);
+// Input of load_mapped, strings and blobs point to it.
+struct borrowed_range_t {
+    uintptr_t begin;
+    uintptr_t end;
 
-    new_obj->prefab = obj->prefab;
-    new_obj->parent = obj->parent;
+    // Object loaded from range, without unmap range is freed by allocator.
+    uint64_t obj;
+    void (*unmap)(const void *data,
+                  uint64_t size);
+    struct ce_alloc *allocator;
+};
 
-    new_obj->type = obj->type;
-    new_obj->properties_count = properties_count;
+// Fixed size items allocated by segments on demand. Segments never move so
+// slot address can be object id. Segment end with next links of free lists.
+struct pool_t {
+    uint32_t item_size;
+    uint32_t max_segments;
+    _Atomic(uint8_t *) *segments;
 
-    ce_array_push_n(new_obj->keys, obj->keys + 1,
-                    ce_array_size(obj->keys) - 1, alloc);
+    atomic_ullong used;
+    atomic_ullong live;
+    atomic_uint segments_n;
+};
 
-    ce_array_push_n(new_obj->property_type, obj->property_type + 1,
-                    ce_array_size(obj->property_type) - 1, alloc);
+struct snapshot_entry_t {
+    uint64_t obj;
+    uint32_t version;
+};
 
-    ce_array_push_n(new_obj->offset, obj->offset + 1,
-                    ce_array_size(obj->offset) - 1, alloc);
+// Versions of objects first changed after snapshot was taken, and strings
+// and blobs replaced while it was newest snapshot.
+struct snapshot_t {
+    uint64_t commit;
+    uint32_t refs;
 
-    if (values_size)
-        ce_array_push_n(new_obj->values, obj->values, values_size, alloc);
+    struct snapshot_entry_t *entries;
+    struct ce_hash_t recorded;
+    void **garbage;
+};
 
+// Lock-free stack of pool indices linked through next,
+// head is tag << 32 | idx + 1. Tag protect pop from ABA.
+struct idx_list_t {
+    atomic_ullong head;
+};
 
-    ce_hash_clone(&obj->prop_map, &new_obj->prop_map, alloc);
+struct db_t {
+    uint32_t idx;
+    bool used;
 
-    uint32_t n = ce_array_size(obj->instances);
-    if (n) {
-        ce_array_push_n(new_obj->instances, obj->instances, n, alloc);
-    }
+    // id pool
+    struct pool_t slots;
+    struct idx_list_t free_slots;
+    struct idx_list_t retired_slots;
+    uint32_t pending_slots;
 
-//    n = ce_array_size(obj->children);
-//    if (n) {
-//        ce_array_push_n(new_obj->children, obj->children, n, alloc);
-//    }
+    // objects
+    struct pool_t objects;
+    struct idx_list_t free_objects;
+    struct idx_list_t retired_objects;
+    uint32_t pending_objects;
+
+    // snapshots, oldest first
+    atomic_ullong commit_n;
+    struct snapshot_t *snapshots;
+    atomic_uint snapshots_n;
+    uint32_t *held_slots;
+    struct ce_spinlock snapshot_lock;
+};
 
-    n = ce_array_size(obj->notify);
-    if (n) {
-        ce_array_push_n(new_obj->notify, obj->notify, n, alloc);
-    }
+static struct _G {
+    struct db_t dbs[MAX_DBS];
+    uint32_t *free_db;
+    uint32_t *to_free_db;
+    uint32_t dbs_n;
+    struct ce_spinlock db_lock;
 
-    return new_obj;
-}
+    struct object_layout_t empty_layout;
+    atomic_uint layout_id;
 
-static uint64_t _find_prop_index(const struct object_t *obj,
-                                 uint64_t key) {
-    return ce_hash_lookup(&obj->prop_map, key, 0);
-}
+    struct ce_hash_t layout_map;
+    struct ce_spinlock layout_lock;
 
-static void _destroy_object(struct object_t *obj) {
-    struct db_t *db_inst = &_G.dbs[obj->db.idx];
+    struct prop_handle_t prop_handles[MAX_PROP_HANDLES];
+    uint32_t prop_handles_n;
+    struct ce_hash_t prop_handle_map;
+    struct ce_spinlock prop_handle_lock;
 
-    uint64_t idx = atomic_fetch_add(&db_inst->to_free_objects_n, 1);
-    db_inst->to_free_objects[idx] = obj->idx;
-}
+    struct borrowed_range_t *borrowed;
+    struct ce_spinlock borrowed_lock;
 
-static struct ce_cdb_t create_db() {
-    uint64_t idx = ce_array_size(_G.dbs);
+    struct queued_notify_t *notify_queue;
+    struct ce_hash_t notify_queue_map;
+    struct ce_spinlock notify_lock;
 
-    struct db_t db = (struct db_t) {
-            .idx = idx,
+    struct ce_alloc *allocator;
+    struct ce_cdb_t global_db;
+} _G;
+
+static struct object_slot_t *_get_slot(uint64_t objid) {
+    return (struct object_slot_t *) objid;
+}
 
-            .objects_mem = (uint64_t *) mmap(NULL,
-                                             MAX_OBJECTS * sizeof(uint64_t),
-                                             PROT_READ | PROT_WRITE,
-                                             MAP_PRIVATE | MAP_ANONYMOUS,
-                                             -1, 0),
-
-
-            .free_objects_id = (uint32_t *) mmap(NULL,
-                                                 MAX_OBJECTS * sizeof(uint32_t),
-                                                 PROT_READ | PROT_WRITE,
-                                                 MAP_PRIVATE | MAP_ANONYMOUS,
-                                                 -1, 0),
-
-            .to_free_objects_id = (uint32_t *) mmap(NULL,
-                                                    MAX_OBJECTS *
-                                                    sizeof(uint32_t),
-                                                    PROT_READ | PROT_WRITE,
-                                                    MAP_PRIVATE | MAP_ANONYMOUS,
-                                                    -1, 0),
-            .object_pool = (struct object_t *) mmap(NULL,
-                                                    MAX_OBJECTS *
-                                                    sizeof(struct object_t),
-                                                    PROT_READ | PROT_WRITE,
-                                                    MAP_PRIVATE | MAP_ANONYMOUS,
-                                                    -1, 0),
-            .free_objects = (uint32_t *) mmap(NULL,
-                                              MAX_OBJECTS * sizeof(uint32_t),
-                                              PROT_READ | PROT_WRITE,
-                                              MAP_PRIVATE | MAP_ANONYMOUS,
-                                              -1, 0),
-
-            .to_free_objects = (uint32_t *) mmap(NULL,
-                                                 MAX_OBJECTS * sizeof(uint32_t),
-                                                 PROT_READ | PROT_WRITE,
-                                                 MAP_PRIVATE | MAP_ANONYMOUS,
-                                                 -1, 0)
+static void _pool_init(struct pool_t *pool,
+                       uint32_t item_size,
+                       uint64_t max_items) {
+    const uint32_t max_segments = (uint32_t) ((max_items + POOL_SEGMENT_MASK)
+                                              >> POOL_SEGMENT_SHIFT);
+
+    *pool = (struct pool_t) {
+            .item_size = item_size,
+            .max_segments = max_segments,
+            .segments = CE_ALLOC(_G.allocator, _Atomic(uint8_t *),
+                                 sizeof(uint8_t *) * max_segments),
     };
 
-    ce_array_push(_G.dbs, db, _G.allocator);
-    return (struct ce_cdb_t) {.idx = idx};
-};
+    memset(pool->segments, 0, sizeof(uint8_t *) * max_segments);
+}
 
-static uint64_t create_object(struct ce_cdb_t db,
-                              uint64_t type) {
-    struct db_t *db_inst = &_G.dbs[db.idx];
-    struct object_t *obj = _new_object(db_inst, _G.allocator);
+static void _pool_free(struct pool_t *pool) {
+    for (uint32_t i = 0; i < pool->max_segments; ++i) {
+        CE_FREE(_G.allocator, atomic_load(&pool->segments[i]));
+    }
 
-    uint64_t idx = _new_object_id(db_inst);
+    CE_FREE(_G.allocator, pool->segments);
+    *pool = (struct pool_t) {};
+}
 
-    uint64_t *obj_addr = db_inst->objects_mem + idx;
+static uint64_t _pool_capacity(const struct pool_t *pool) {
+    return (uint64_t) pool->max_segments << POOL_SEGMENT_SHIFT;
+}
 
-    *obj_addr = obj->idx;
-    obj->db = db;
-    obj->type = type;
+// Items ever allocated, failed allocations move used over capacity.
+static uint64_t _pool_used(struct pool_t *pool) {
+    const uint64_t used = atomic_load(&pool->used);
+    const uint64_t capacity = _pool_capacity(pool);
 
-    return (uint64_t) obj_addr;
+    return used < capacity ? used : capacity;
 }
 
-static ce_cdb_obj_o *write_begin(uint64_t _obj);
-
-static void write_commit(ce_cdb_obj_o *_writer);
+static uint64_t _pool_segment_bytes(const struct pool_t *pool) {
+    return POOL_SEGMENT_SIZE * (pool->item_size + sizeof(atomic_uint));
+}
 
-void set_subobject(ce_cdb_obj_o *_writer,
-                   uint64_t property,
-                   uint64_t subobject);
+static void *_pool_item(const struct pool_t *pool,
+                        uint32_t idx) {
+    uint8_t *segment = atomic_load_explicit(
+            &pool->segments[idx >> POOL_SEGMENT_SHIFT], memory_order_acquire);
 
-static uint64_t create_from(struct ce_cdb_t db,
-                            uint64_t _obj) {
-    struct db_t *db_inst = &_G.dbs[db.idx];
+    return segment + (idx & POOL_SEGMENT_MASK) * pool->item_size;
+}
 
-    struct object_t *obj = _get_object_from_objid(_obj);
+static atomic_uint *_pool_next(const struct pool_t *pool,
+                               uint32_t idx) {
+    uint8_t *segment = atomic_load_explicit(
+            &pool->segments[idx >> POOL_SEGMENT_SHIFT], memory_order_acquire);
 
-    struct object_t *inst = _new_object(db_inst, _G.allocator);
-    inst->db = db;
+    atomic_uint *next = (atomic_uint *) (segment +
+                                         POOL_SEGMENT_SIZE * pool->item_size);
 
-    uint64_t idx = _new_object_id(db_inst);
+    return next + (idx & POOL_SEGMENT_MASK);
+}
 
-    uint64_t *obj_addr = db_inst->objects_mem + idx;
+// Return new never used item index or false if pool is full.
+static bool _pool_alloc(struct pool_t *pool,
+                        uint32_t *idx) {
+    const uint64_t i = atomic_fetch_add(&pool->used, 1);
+    if (i >= _pool_capacity(pool)) {
+        return false;
+    }
 
-    *obj_addr = inst->idx;
+    const uint64_t segment_idx = i >> POOL_SEGMENT_SHIFT;
 
-    inst->prefab = _obj;
-    inst->type = obj->type;
+    uint8_t *segment = atomic_load(&pool->segments[segment_idx]);
+    if (!segment) {
+        const uint64_t size = _pool_segment_bytes(pool);
 
-    ce_array_push(obj->instances, (uint64_t) obj_addr, _G.allocator);
+        uint8_t *new_segment = CE_ALLOC(_G.allocator, uint8_t, size);
+        memset(new_segment, 0, size);
 
-    uint32_t n = ce_array_size(obj->notify);
-    if (n) {
-        ce_array_push_n(inst->notify, obj->notify, n, _G.allocator);
+        if (atomic_compare_exchange_strong(&pool->segments[segment_idx],
+                                           &segment, new_segment)) {
+            atomic_fetch_add(&pool->segments_n, 1);
+        } else {
+            CE_FREE(_G.allocator, new_segment);
+        }
     }
 
-    struct object_t *wr = write_begin((uint64_t) obj_addr);
+    *idx = (uint32_t) i;
+    return true;
+}
 
-    for (int i = 1; i < obj->properties_count; ++i) {
-        switch (obj->property_type[i]) {
-            case CDB_TYPE_SUBOBJECT: {
-                union type_u *value_ptr = (union type_u *) (obj->values +
-                                                            obj->offset[i]);
+static void _idx_push(struct idx_list_t *list,
+                      struct pool_t *pool,
+                      uint32_t idx) {
+    uint64_t head = atomic_load(&list->head);
+    uint64_t new_head;
+
+    do {
+        atomic_store_explicit(_pool_next(pool, idx), (uint32_t) head,
+                              memory_order_relaxed);
+        new_head = (((head >> 32) + 1) << 32) | (idx + 1);
+    } while (!atomic_compare_exchange_weak(&list->head, &head, new_head));
+}
 
-                uint64_t old_subobj = value_ptr->subobj;
+static bool _idx_pop(struct idx_list_t *list,
+                     struct pool_t *pool,
+                     uint32_t *idx) {
+    uint64_t head = atomic_load(&list->head);
+    uint64_t new_head;
 
-                uint64_t new_subobj = create_from(db, old_subobj);
+    do {
+        uint32_t top = (uint32_t) head;
+        if (!top) {
+            return false;
+        }
 
-                set_subobject(wr, obj->keys[i], new_subobj);
-            }
+        uint32_t top_next = atomic_load_explicit(_pool_next(pool, top - 1),
+                                                 memory_order_relaxed);
+        new_head = (((head >> 32) + 1) << 32) | top_next;
+    } while (!atomic_compare_exchange_weak(&list->head, &head, new_head));
 
-                break;
+    *idx = (uint32_t) head - 1;
+    return true;
+}
 
-            default:
-                break;
-        }
+// Detach whole list, return first idx + 1.
+static uint32_t _idx_take_all(struct idx_list_t *list) {
+    uint64_t head = atomic_load(&list->head);
+
+    while (!atomic_compare_exchange_weak(&list->head, &head,
+                                         ((head >> 32) + 1) << 32)) {
     }
 
-    write_commit(wr);
+    return (uint32_t) head;
+}
 
-    return (uint64_t) obj_addr;
+static struct object_t *_get_object(uint32_t db,
+                                    uint64_t idx) {
+    return _pool_item(&_G.dbs[db].objects, idx);
 }
 
-static void destroy_db(struct ce_cdb_t db) {
-    ce_array_push(_G.to_free_db, db.idx, _G.allocator);
+static struct object_t *_get_object_from_objid(uint64_t objid) {
+    struct object_slot_t *slot = _get_slot(objid);
+
+    return _get_object(slot->db, slot->version);
 }
 
-static void destroy_object(uint64_t _obj) {
+static struct object_t *_get_object_from_obj_o(ce_cdb_obj_o *obj_o) {
+    return (struct object_t *) obj_o;
+}
 
-    struct object_t *obj = _get_object_from_objid(_obj);
-    struct db_t *db_inst = &_G.dbs[obj->db.idx];
+static union type_u *_value_ptr(const struct object_t *obj,
+                                uint64_t idx) {
+    return (union type_u *) (obj->values + obj->layout->offset[idx]);
+}
 
-    uint64_t idx = atomic_fetch_add(&db_inst->to_free_objects_id_n, 1);
+static size_t _type_size(enum ce_cdb_type type) {
+    switch (type) {
+        case CDB_TYPE_UINT64:
+        case CDB_TYPE_REF:
+        case CDB_TYPE_SUBOBJECT:
+            return sizeof(uint64_t);
 
-    db_inst->to_free_objects_id[idx] = \
-            ((uint64_t *) _obj) - db_inst->objects_mem;
+        case CDB_TYPE_PTR:
+            return sizeof(void *);
 
-    for (int i = 1; i < obj->properties_count; ++i) {
-        switch (obj->property_type[i]) {
-            case CDB_TYPE_SUBOBJECT: {
-                union type_u *value_ptr = (union type_u *) (obj->values +
-                                                            obj->offset[i]);
+        case CDB_TYPE_FLOAT:
+            return sizeof(float);
 
-                uint64_t old_subobj = value_ptr->subobj;
-                destroy_object(old_subobj);
-            }
+        case CDB_TYPE_BOOL:
+            return sizeof(bool);
 
-                break;
+        case CDB_TYPE_STR:
+            return sizeof(char *);
 
-            default:
-                break;
-        }
-    }
+        case CDB_TYPE_VEC3:
+            return sizeof(float) * 3;
 
-}
+        case CDB_TYPE_VEC4:
+            return sizeof(float) * 4;
 
+        case CDB_TYPE_MAT4:
+            return sizeof(float) * 16;
 
-static void gc() {
-    const uint32_t db_n = ce_array_size(_G.dbs);
-    for (int i = 0; i < db_n; ++i) {
-        struct db_t *db_inst = &_G.dbs[i];
+        case CDB_TYPE_BLOB:
+            return sizeof(struct blob_t);
 
-        const uint32_t to_free_objects_id_n = db_inst->to_free_objects_id_n;
+        default:
+            return 0;
+    }
+}
 
-        for (int j = 0; j < to_free_objects_id_n; ++j) {
-            const uint32_t idx = db_inst->to_free_objects_id[j];
+static void _layout_init(struct object_layout_t *layout,
+                         const struct ce_alloc *alloc) {
+    *layout = (struct object_layout_t) {};
+    atomic_init(&layout->refs, 1);
 
-            uint64_t *obj_addr = db_inst->objects_mem + idx;
-            struct object_t *obj = _get_object_from_objid((uint64_t) obj_addr);
+    ce_array_push(layout->keys, 0, alloc);
+    ce_array_push(layout->property_type, CDB_TYPE_NONE, alloc);
+    ce_array_push(layout->offset, 0, alloc);
+    ce_hash_add(&layout->prop_map, 0, 0, alloc);
 
-            if (obj->prefab) {
-                struct object_t *prefab_obj = \
-                    _get_object_from_objid(obj->prefab);
+    layout->properties_count = 1;
+}
 
-                const uint32_t instances_n = \
-                    ce_array_size(prefab_obj->instances);
+static struct object_layout_t *_layout_clone(struct object_layout_t *layout,
+                                             const struct ce_alloc *alloc) {
+    struct object_layout_t *new_layout;
+    new_layout = CE_ALLOC(alloc, struct object_layout_t,
+                          sizeof(struct object_layout_t));
 
-                const uint32_t last_idx = instances_n - 1;
-                for (int k = 0; k < instances_n; ++k) {
-                    if (prefab_obj->instances[k] != obj->obj) {
-                        continue;
-                    }
+    *new_layout = (struct object_layout_t) {
+            .id = atomic_fetch_add(&_G.layout_id, 1),
+            .properties_count = layout->properties_count,
+    };
 
-                    prefab_obj->instances[k] = prefab_obj->instances[last_idx];
-                    ce_array_pop_back(prefab_obj->instances);
+    atomic_init(&new_layout->refs, 1);
 
-                    break;
-                }
-            }
+    ce_array_push_n(new_layout->keys, layout->keys,
+                    ce_array_size(layout->keys), alloc);
 
-            _destroy_object(obj);
+    ce_array_push_n(new_layout->property_type, layout->property_type,
+                    ce_array_size(layout->property_type), alloc);
 
-            db_inst->free_objects_id[atomic_fetch_add(&db_inst->free_objects_id_n, 1)] = idx;
-        }
+    ce_array_push_n(new_layout->offset, layout->offset,
+                    ce_array_size(layout->offset), alloc);
 
-        db_inst->to_free_objects_id_n = 0;
+    ce_hash_clone(&layout->prop_map, &new_layout->prop_map, alloc);
 
-        const uint32_t to_free_objects_n = db_inst->to_free_objects_n;
-        for (int j = 0; j < to_free_objects_n; ++j) {
-            const uint32_t idx = db_inst->to_free_objects[j];
+    return new_layout;
+}
 
-            struct object_t *obj = &db_inst->object_pool[idx];
+static struct object_layout_t *_layout_retain(struct object_layout_t *layout) {
+    if (layout != &_G.empty_layout) {
+        atomic_fetch_add(&layout->refs, 1);
+    }
 
-//            ce_array_clean(obj->children);
-            ce_array_clean(obj->instances);
+    return layout;
+}
 
-            ce_array_clean(obj->property_type);
-            ce_array_clean(obj->keys);
-            ce_array_clean(obj->values);
-            ce_array_clean(obj->offset);
+static void _layout_free(struct object_layout_t *layout,
+                         const struct ce_alloc *alloc) {
+    ce_array_free(layout->keys, alloc);
+    ce_array_free(layout->property_type, alloc);
+    ce_array_free(layout->offset, alloc);
+    ce_hash_free(&layout->prop_map, alloc);
 
-            ce_hash_clean(&obj->prop_map);
+    CE_FREE(alloc, layout);
+}
 
-            ce_array_clean(obj->changed_prop);
-            ce_array_clean(obj->notify);
+// Interned layout is removed from map when last user release it. Last user
+// release under lock, so _layout_find can't retain removed layout.
+static void _layout_release(struct object_layout_t *layout,
+                            const struct ce_alloc *alloc) {
+    if (!layout || (layout == &_G.empty_layout)) {
+        return;
+    }
 
-            *obj = (struct object_t) {
-//                    .children = obj->children,
-                    .instances = obj->instances,
-                    .property_type = obj->property_type,
-                    .keys = obj->keys,
-                    .values = obj->values,
-                    .offset = obj->offset,
-                    .prop_map = obj->prop_map,
-                    .changed_prop = obj->changed_prop,
-                    .notify = obj->notify,
-            };
+    uint32_t refs = atomic_load(&layout->refs);
+    while (!layout->interned || (refs > 2)) {
+        if (atomic_compare_exchange_weak(&layout->refs, &refs, refs - 1)) {
+            if (1 == refs) {
+                _layout_free(layout, alloc);
+            }
 
-            db_inst->free_objects[atomic_fetch_add(&db_inst->free_objects_n, 1)] = idx;
+            return;
         }
+    }
+
+    ce_os_a0->thread->spin_lock(&_G.layout_lock);
+
+    bool unused = (2 == atomic_fetch_sub(&layout->refs, 1));
+    if (unused) {
+        ce_hash_remove(&_G.layout_map, layout->hash);
+    }
 
-        db_inst->to_free_objects_n = 0;
+    ce_os_a0->thread->spin_unlock(&_G.layout_lock);
+
+    if (unused) {
+        _layout_free(layout, alloc);
     }
 }
 
-struct cdb_binobj_header {
-    uint64_t version;
-    uint64_t type;
-    uint64_t properties_count;
-    uint64_t values_size;
-    uint64_t string_buffer_size;
-    uint64_t subobject_buffer_size;
-    uint64_t blob_buffer_size;
-};
+// Copy layout if other version use it too.
+static struct object_layout_t *_object_own_layout(struct object_t *obj,
+                                                  const struct ce_alloc *alloc) {
+    struct object_layout_t *layout = obj->layout;
 
-static void dump(uint64_t _obj,
-                 char **output,
-                 struct ce_alloc *allocator) {
-    struct object_t *obj = _get_object_from_objid(_obj);
+    if ((layout != &_G.empty_layout) && (1 == atomic_load(&layout->refs))) {
+        return layout;
+    }
 
-    uint64_t *keys = obj->keys;
-    uint8_t *type = obj->property_type;
-    uint64_t *offset = obj->offset;
-    uint8_t *values = obj->values;
+    obj->layout = _layout_clone(layout, alloc);
+    _layout_release(layout, alloc);
 
-    uint8_t *values_copy = CE_ALLOC(allocator, uint8_t, ce_array_size(values));
-    memcpy(values_copy, values, ce_array_size(values));
+    return obj->layout;
+}
 
-    char *str_buffer = NULL;
-    char *subobject_buffer = NULL;
-    char *blob_buffer = NULL;
-    for (int i = 1; i < obj->properties_count; ++i) {
-        switch (obj->property_type[i]) {
-            case CDB_TYPE_SUBOBJECT: {
-                uint64_t subobject_offset = ce_array_size(subobject_buffer);
-                uint64_t subobject_ptr;
+static uint64_t _object_new_property(struct object_t *obj,
+                                     uint64_t key,
+                                     enum ce_cdb_type type,
+                                     const struct ce_alloc *alloc) {
+    struct object_layout_t *layout = _object_own_layout(obj, alloc);
 
-                union type_u *value_ptr = (union type_u *) (values_copy +
-                                                            offset[i]);
-                subobject_ptr = value_ptr->subobj;
+    const uint64_t values_size = ce_array_size(obj->values);
+    const size_t size = _type_size(type);
 
-                dump(subobject_ptr, &subobject_buffer, allocator);
+    if (size) {
+        ce_array_resize(obj->values, values_size + size, alloc);
+    }
 
-                uint64_t *ptr = (uint64_t *) (values_copy + offset[i]);
-                *ptr = subobject_offset;
-            }
+    layout->id = atomic_fetch_add(&_G.layout_id, 1);
 
-                break;
+    // Type change, keep property index and move value to new place.
+    uint64_t idx = ce_hash_lookup(&layout->prop_map, key, 0);
+    if (idx) {
+        layout->property_type[idx] = type;
+        layout->offset[idx] = values_size;
+        return idx;
+    }
 
-            case CDB_TYPE_STR: {
-                uint64_t stroffset = ce_array_size(str_buffer);
-                char *str = *(char **) (values_copy + offset[i]);
-                ce_array_push_n(str_buffer, str, strlen(str) + 1, allocator);
+    const uint64_t prop_count = layout->properties_count;
 
-                uint64_t *strptr = (uint64_t *) (values_copy + offset[i]);
-                *strptr = stroffset;
-            }
-                break;
+    ce_array_push(layout->keys, key, alloc);
+    ce_array_push(layout->property_type, type, alloc);
+    ce_array_push(layout->offset, values_size, alloc);
 
-            case CDB_TYPE_BLOB: {
-                uint64_t bloboffset = ce_array_size(blob_buffer);
+    ce_hash_add(&layout->prop_map, key, prop_count, alloc);
 
-                struct blob_t *blob;
-                blob = (struct blob_t *) (values_copy + offset[i]);
+    layout->properties_count = layout->properties_count + 1;
+    return prop_count;
+}
 
-                ce_array_push_n(blob_buffer, &blob->size, sizeof(uint64_t),
-                                allocator);
+// Hash and compare properties without null element.
+static uint64_t _layout_hash(const uint64_t *keys,
+                             const uint8_t *type,
+                             const uint64_t *offset,
+                             uint64_t n) {
+    uint64_t h = ce_hash_murmur2_64(keys, sizeof(uint64_t) * n, 0);
+    h = ce_hash_murmur2_64(type, sizeof(uint8_t) * n, h);
+    h = ce_hash_murmur2_64(offset, sizeof(uint64_t) * n, h);
+    return h;
+}
 
-                ce_array_push_n(blob_buffer, blob->data, blob->size, allocator);
+static bool _layout_match(const struct object_layout_t *layout,
+                          const uint64_t *keys,
+                          const uint8_t *type,
+                          const uint64_t *offset,
+                          uint64_t n) {
+    if ((n + 1) != layout->properties_count) {
+        return false;
+    }
 
-                uint64_t *blobptr = (uint64_t *) (values_copy + offset[i]);
-                *blobptr = bloboffset;
-            }
-                break;
-            default:
+    return !memcmp(layout->keys + 1, keys, sizeof(uint64_t) * n) &&
+           !memcmp(layout->property_type + 1, type, sizeof(uint8_t) * n) &&
+           !memcmp(layout->offset + 1, offset, sizeof(uint64_t) * n);
+}
+
+static bool _layout_equal(const struct object_layout_t *a,
+                          const struct object_layout_t *b) {
+    return _layout_match(a, b->keys + 1, b->property_type + 1, b->offset + 1,
+                         b->properties_count - 1);
+}
+
+// Find interned layout for loaded properties.
+static struct object_layout_t *_layout_find(const uint64_t *keys,
+                                            const uint8_t *type,
+                                            const uint64_t *offset,
+                                            uint64_t n) {
+    const uint64_t h = _layout_hash(keys, type, offset, n);
+
+    struct object_layout_t *interned;
+
+    ce_os_a0->thread->spin_lock(&_G.layout_lock);
+
+    interned = (struct object_layout_t *) ce_hash_lookup(&_G.layout_map, h, 0);
+    if (interned && _layout_match(interned, keys, type, offset, n)) {
+        _layout_retain(interned);
+    } else {
+        interned = NULL;
+    }
+
+    ce_os_a0->thread->spin_unlock(&_G.layout_lock);
+
+    return interned;
+}
+
+// Share layout with objects that have same properties, call only on new
+// layout owned by obj.
+static void _object_intern_layout(struct object_t *obj) {
+    struct object_layout_t *layout = obj->layout;
+
+    if (layout == &_G.empty_layout) {
+        return;
+    }
+
+    const uint64_t h = _layout_hash(layout->keys + 1,
+                                    layout->property_type + 1,
+                                    layout->offset + 1,
+                                    layout->properties_count - 1);
+
+    struct object_layout_t *interned;
+
+    ce_os_a0->thread->spin_lock(&_G.layout_lock);
+
+    interned = (struct object_layout_t *) ce_hash_lookup(&_G.layout_map, h, 0);
+    if (!interned) {
+        layout->hash = h;
+        layout->interned = true;
+        ce_hash_add(&_G.layout_map, h, (uint64_t) _layout_retain(layout),
+                    _G.allocator);
+    } else if ((interned != layout) && _layout_equal(interned, layout)) {
+        obj->layout = _layout_retain(interned);
+    }
+
+    ce_os_a0->thread->spin_unlock(&_G.layout_lock);
+
+    if (obj->layout != layout) {
+        _layout_release(layout, _G.allocator);
+    }
+}
+
+struct object_t *_new_object(struct db_t *db,
+                             const struct ce_alloc *a) {
+
+    uint32_t idx;
+    if (!_idx_pop(&db->free_objects, &db->objects, &idx)) {
+        if (!_pool_alloc(&db->objects, &idx)) {
+            ce_log_a0->error(LOG_WHERE, "db %u: object versions pool is full",
+                             db->idx);
+            CE_ASSERT(LOG_WHERE, false);
+            return NULL;
+        }
+    }
+
+    atomic_fetch_add(&db->objects.live, 1);
+
+    struct object_t *obj = _pool_item(&db->objects, idx);
+    obj->idx = idx;
+    obj->db.idx = db->idx;
+    obj->layout = _layout_retain(&_G.empty_layout);
+
+    return obj;
+}
+
+static struct object_slot_t *_new_slot(struct db_t *db_inst) {
+    uint32_t idx;
+    if (!_idx_pop(&db_inst->free_slots, &db_inst->slots, &idx)) {
+        if (!_pool_alloc(&db_inst->slots, &idx)) {
+            ce_log_a0->error(LOG_WHERE, "db %u: objects pool is full",
+                             db_inst->idx);
+            CE_ASSERT(LOG_WHERE, false);
+            return NULL;
+        }
+    }
+
+    atomic_fetch_add(&db_inst->slots.live, 1);
+
+    struct object_slot_t *slot = _pool_item(&db_inst->slots, idx);
+    slot->idx = idx;
+    slot->db = db_inst->idx;
+
+    return slot;
+}
+
+// New version share layout with obj and copy only values
+static struct object_t *_object_clone(struct db_t *db,
+                                      struct object_t *obj,
+                                      const struct ce_alloc *alloc) {
+    const uint64_t values_size = ce_array_size(obj->values);
+
+    struct object_t *new_obj = _new_object(db, alloc);
+
+    _layout_release(new_obj->layout, alloc);
+    new_obj->layout = _layout_retain(obj->layout);
+
+    ce_array_clean(new_obj->values);
+    if (values_size) {
+        ce_array_push_n(new_obj->values, obj->values, values_size, alloc);
+    }
+
+    return new_obj;
+}
+
+// Range is released when object it was loaded to is freed by gc.
+static void _borrow_range(const void *data,
+                          uint64_t size,
+                          uint64_t obj,
+                          void (*unmap)(const void *data,
+                                        uint64_t size),
+                          struct ce_alloc *allocator) {
+    struct borrowed_range_t range = {
+            .begin = (uintptr_t) data,
+            .end = (uintptr_t) data + size,
+            .obj = obj,
+            .unmap = unmap,
+            .allocator = allocator,
+    };
+
+    _get_slot(obj)->borrowed = true;
+
+    ce_os_a0->thread->spin_lock(&_G.borrowed_lock);
+
+    const uint32_t n = ce_array_size(_G.borrowed);
+    uint32_t i = 0;
+    while ((i < n) && (_G.borrowed[i].begin < range.begin)) {
+        ++i;
+    }
+
+    ce_array_push(_G.borrowed, range, _G.allocator);
+    memmove(_G.borrowed + i + 1, _G.borrowed + i,
+            sizeof(struct borrowed_range_t) * (n - i));
+    _G.borrowed[i] = range;
+
+    ce_os_a0->thread->spin_unlock(&_G.borrowed_lock);
+}
+
+static bool _is_borrowed(const void *ptr) {
+    const uintptr_t p = (uintptr_t) ptr;
+
+    ce_os_a0->thread->spin_lock(&_G.borrowed_lock);
+
+    uint32_t lo = 0;
+    uint32_t hi = ce_array_size(_G.borrowed);
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (_G.borrowed[mid].begin <= p) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    bool borrowed = lo && (p < _G.borrowed[lo - 1].end);
+
+    ce_os_a0->thread->spin_unlock(&_G.borrowed_lock);
+
+    return borrowed;
+}
+
+static void _release_range(struct borrowed_range_t *range) {
+    if (range->unmap) {
+        range->unmap((const void *) range->begin, range->end - range->begin);
+    } else {
+        CE_FREE(range->allocator, (void *) range->begin);
+    }
+}
+
+// Replaced values never point to borrowed range, so it is safe to release
+// it with slot.
+static void _release_borrowed(uint64_t obj) {
+    struct borrowed_range_t *released = NULL;
+
+    ce_os_a0->thread->spin_lock(&_G.borrowed_lock);
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < ce_array_size(_G.borrowed); ++i) {
+        if (_G.borrowed[i].obj == obj) {
+            ce_array_push(released, _G.borrowed[i], _G.allocator);
+            continue;
+        }
+
+        _G.borrowed[n++] = _G.borrowed[i];
+    }
+    ce_array_resize(_G.borrowed, n, _G.allocator);
+
+    ce_os_a0->thread->spin_unlock(&_G.borrowed_lock);
+
+    for (uint32_t i = 0; i < ce_array_size(released); ++i) {
+        _release_range(&released[i]);
+    }
+
+    ce_array_free(released, _G.allocator);
+}
+
+// Borrowed value is owned by its range, writer must not free it.
+static void _replace_value(struct object_t *writer,
+                           void *value,
+                           const struct ce_alloc *alloc) {
+    if (_is_borrowed(value)) {
+        return;
+    }
+
+    ce_array_push(writer->replaced, value, alloc);
+}
+
+static uint64_t _find_prop_index(const struct object_t *obj,
+                                 uint64_t key) {
+    return ce_hash_lookup(&obj->layout->prop_map, key, 0);
+}
+
+// Write value to property, replaced string or blob is remembered in writer.
+// Without writer values are only shared (flattened instance).
+static void _object_set(struct object_t *obj,
+                        struct object_t *writer,
+                        uint64_t key,
+                        enum ce_cdb_type type,
+                        const union type_u *value,
+                        const struct ce_alloc *alloc) {
+    uint64_t idx = _find_prop_index(obj, key);
+
+    if (!idx || (obj->layout->property_type[idx] != type)) {
+        idx = _object_new_property(obj, key, type, alloc);
+    } else if (writer && (CDB_TYPE_STR == type)) {
+        _replace_value(writer, _value_ptr(obj, idx)->str, alloc);
+    } else if (writer && (CDB_TYPE_BLOB == type)) {
+        _replace_value(writer, _value_ptr(obj, idx)->blob.data, alloc);
+    }
+
+    memcpy(_value_ptr(obj, idx), value, _type_size(type));
+}
+
+// Version held by snapshot is retired when snapshot release it.
+static void _destroy_object(struct object_t *obj) {
+    struct db_t *db_inst = &_G.dbs[obj->db.idx];
+
+    if (atomic_fetch_or(&obj->hold, OBJECT_RETIRED)) {
+        return;
+    }
+
+    _idx_push(&db_inst->retired_objects, &db_inst->objects, obj->idx);
+}
+
+static void _version_release(struct object_t *obj) {
+    struct db_t *db_inst = &_G.dbs[obj->db.idx];
+
+    if ((OBJECT_RETIRED | 1) != atomic_fetch_sub(&obj->hold, 1)) {
+        return;
+    }
+
+    _idx_push(&db_inst->retired_objects, &db_inst->objects, obj->idx);
+}
+
+static void _invalidate_flat(struct object_slot_t *slot) {
+    atomic_fetch_add(&slot->flat_gen, 1);
+
+    struct object_t *flat = atomic_exchange(&slot->flat, NULL);
+    if (flat) {
+        _destroy_object(flat);
+    }
+}
+
+static struct object_t *_get_resolved(uint64_t objid);
+
+// Prefab properties overlaid with own properties.
+static struct object_t *_build_flat(uint64_t objid) {
+    struct object_slot_t *slot = _get_slot(objid);
+    const uint32_t gen = atomic_load(&slot->flat_gen);
+
+    struct object_t *obj = _get_object_from_objid(objid);
+    struct object_t *prefab = _get_resolved(slot->prefab);
+
+    struct object_t *flat = _object_clone(&_G.dbs[obj->db.idx], prefab,
+                                          _G.allocator);
+    flat->db = obj->db;
+
+    const struct object_layout_t *layout = obj->layout;
+    for (int i = 1; i < layout->properties_count; ++i) {
+        _object_set(flat, NULL, layout->keys[i], layout->property_type[i],
+                    _value_ptr(obj, i), _G.allocator);
+    }
+
+    if (flat->layout != prefab->layout) {
+        _object_intern_layout(flat);
+    }
+
+    struct object_t *expected = NULL;
+    if (!atomic_compare_exchange_strong(&slot->flat, &expected, flat)) {
+        _destroy_object(flat);
+        return expected;
+    }
+
+    // Invalidated while building, use it for this read only.
+    if (gen != atomic_load(&slot->flat_gen)) {
+        expected = flat;
+        if (atomic_compare_exchange_strong(&slot->flat, &expected, NULL)) {
+            _destroy_object(flat);
+        }
+    }
+
+    return flat;
+}
+
+// Version used for reads, for prefab instance it is flattened copy.
+static struct object_t *_get_resolved(uint64_t objid) {
+    struct object_slot_t *slot = _get_slot(objid);
+
+    if (!slot->prefab) {
+        return _get_object_from_objid(objid);
+    }
+
+    struct object_t *flat = atomic_load(&slot->flat);
+    if (flat) {
+        return flat;
+    }
+
+    return _build_flat(objid);
+}
+
+static struct ce_cdb_t create_db(uint64_t max_objects) {
+    if (!max_objects) {
+        max_objects = DEFAULT_MAX_OBJECTS;
+    }
+
+    ce_os_a0->thread->spin_lock(&_G.db_lock);
+
+    uint32_t idx;
+    if (ce_array_size(_G.free_db)) {
+        idx = ce_array_back(_G.free_db);
+        ce_array_pop_back(_G.free_db);
+    } else if (_G.dbs_n < MAX_DBS) {
+        idx = _G.dbs_n++;
+    } else {
+        ce_os_a0->thread->spin_unlock(&_G.db_lock);
+        ce_log_a0->error(LOG_WHERE, "Too many db");
+        return (struct ce_cdb_t) {};
+    }
+
+    struct db_t *db_inst = &_G.dbs[idx];
+
+    *db_inst = (struct db_t) {
+            .idx = idx,
+            .used = true,
+    };
+
+    _pool_init(&db_inst->slots, sizeof(struct object_slot_t), max_objects);
+
+    // writers, prefab flats and versions waiting for gc need extra room.
+    _pool_init(&db_inst->objects, sizeof(struct object_t), max_objects * 2);
+
+    ce_os_a0->thread->spin_unlock(&_G.db_lock);
+
+    return (struct ce_cdb_t) {.idx = idx};
+};
+
+static void db_stats(struct ce_cdb_t db,
+                     struct ce_cdb_stats *stats) {
+    struct db_t *db_inst = &_G.dbs[db.idx];
+
+    *stats = (struct ce_cdb_stats) {
+            .objects = atomic_load(&db_inst->slots.live),
+            .versions = atomic_load(&db_inst->objects.live),
+            .max_objects = _pool_capacity(&db_inst->slots),
+            .pool_bytes = atomic_load(&db_inst->slots.segments_n) *
+                          _pool_segment_bytes(&db_inst->slots) +
+                          atomic_load(&db_inst->objects.segments_n) *
+                          _pool_segment_bytes(&db_inst->objects),
+    };
+}
+
+static uint32_t obj_index(uint64_t _obj) {
+    return _get_slot(_obj)->idx;
+}
+
+static uint64_t create_object(struct ce_cdb_t db,
+                              uint64_t type) {
+    struct db_t *db_inst = &_G.dbs[db.idx];
+
+    struct object_slot_t *slot = _new_slot(db_inst);
+    if (!slot) {
+        return 0;
+    }
+
+    struct object_t *obj = _new_object(db_inst, _G.allocator);
+    if (!obj) {
+        atomic_fetch_sub(&db_inst->slots.live, 1);
+        _idx_push(&db_inst->free_slots, &db_inst->slots, slot->idx);
+        return 0;
+    }
+
+    slot->version = obj->idx;
+    slot->type = type;
+
+    obj->db = db;
+    obj->obj = (uint64_t) slot;
+
+    return (uint64_t) slot;
+}
+
+static ce_cdb_obj_o *write_begin(uint64_t _obj);
+
+static void _unqueue_notify(uint64_t _obj);
+
+static void _writer_free_values(void **values);
+
+static void write_commit(ce_cdb_obj_o *_writer);
+
+void set_subobject(ce_cdb_obj_o *_writer,
+                   uint64_t property,
+                   uint64_t subobject);
+
+static void _slot_lock(struct object_slot_t *slot) {
+    ce_os_a0->thread->spin_lock(&slot->lock);
+}
+
+static void _slot_unlock(struct object_slot_t *slot) {
+    ce_os_a0->thread->spin_unlock(&slot->lock);
+}
+
+// Copy listeners, so callbacks run without slot lock.
+static void _slot_listeners(struct object_slot_t *slot,
+                            struct notify_pair **notify,
+                            uint64_t **instances) {
+    _slot_lock(slot);
+
+    const uint32_t notify_n = ce_array_size(slot->notify);
+    if (notify && notify_n) {
+        ce_array_push_n(*notify, slot->notify, notify_n, _G.allocator);
+    }
+
+    const uint32_t instances_n = ce_array_size(slot->instances);
+    if (instances && instances_n) {
+        ce_array_push_n(*instances, slot->instances, instances_n,
+                        _G.allocator);
+    }
+
+    _slot_unlock(slot);
+}
+
+static uint64_t create_from(struct ce_cdb_t db,
+                            uint64_t _obj) {
+    struct db_t *db_inst = &_G.dbs[db.idx];
+
+    struct object_t *obj = _get_object_from_objid(_obj);
+    struct object_slot_t *prefab_slot = _get_slot(_obj);
+
+    struct object_slot_t *slot = _new_slot(db_inst);
+    if (!slot) {
+        return 0;
+    }
+
+    struct object_t *inst = _new_object(db_inst, _G.allocator);
+    if (!inst) {
+        atomic_fetch_sub(&db_inst->slots.live, 1);
+        _idx_push(&db_inst->free_slots, &db_inst->slots, slot->idx);
+        return 0;
+    }
+
+    inst->db = db;
+
+    slot->version = inst->idx;
+    inst->obj = (uint64_t) slot;
+
+    slot->prefab = _obj;
+    slot->type = prefab_slot->type;
+
+    _slot_lock(prefab_slot);
+
+    ce_array_push(prefab_slot->instances, (uint64_t) slot, _G.allocator);
+
+    uint32_t n = ce_array_size(prefab_slot->notify);
+    if (n) {
+        ce_array_push_n(slot->notify, prefab_slot->notify, n, _G.allocator);
+    }
+
+    _slot_unlock(prefab_slot);
+
+    ce_cdb_obj_o *wr = write_begin((uint64_t) slot);
+
+    const struct object_layout_t *layout = obj->layout;
+    for (int i = 1; i < layout->properties_count; ++i) {
+        switch (layout->property_type[i]) {
+            case CDB_TYPE_SUBOBJECT: {
+                uint64_t old_subobj = _value_ptr(obj, i)->subobj;
+
+                uint64_t new_subobj = create_from(db, old_subobj);
+
+                set_subobject(wr, layout->keys[i], new_subobj);
+            }
+
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    write_commit(wr);
+
+    return (uint64_t) slot;
+}
+
+static void destroy_db(struct ce_cdb_t db) {
+    // Global db is shared by all systems, it is freed on shutdown.
+    if (db.idx == _G.global_db.idx) {
+        ce_log_a0->warning(LOG_WHERE, "Could not destroy global db");
+        return;
+    }
+
+    ce_os_a0->thread->spin_lock(&_G.db_lock);
+    ce_array_push(_G.to_free_db, db.idx, _G.allocator);
+    ce_os_a0->thread->spin_unlock(&_G.db_lock);
+}
+
+static void destroy_object(uint64_t _obj) {
+
+    struct object_t *obj = _get_object_from_objid(_obj);
+    struct db_t *db_inst = &_G.dbs[obj->db.idx];
+
+    struct object_slot_t *slot = _get_slot(_obj);
+
+    bool held = false;
+    if (atomic_load(&db_inst->snapshots_n)) {
+        ce_os_a0->thread->spin_lock(&db_inst->snapshot_lock);
+
+        if (atomic_load(&db_inst->snapshots_n)) {
+            slot->destroyed = true;
+            ce_array_push(db_inst->held_slots, slot->idx, _G.allocator);
+            held = true;
+        }
+
+        ce_os_a0->thread->spin_unlock(&db_inst->snapshot_lock);
+    }
+
+    if (!held) {
+        _idx_push(&db_inst->retired_slots, &db_inst->slots, slot->idx);
+    }
+
+    _unqueue_notify(_obj);
+
+    const struct object_layout_t *layout = obj->layout;
+    for (int i = 1; i < layout->properties_count; ++i) {
+        switch (layout->property_type[i]) {
+            case CDB_TYPE_SUBOBJECT: {
+                uint64_t old_subobj = _value_ptr(obj, i)->subobj;
+                destroy_object(old_subobj);
+            }
+
+                break;
+
+            default:
                 break;
         }
     }
 
-    struct cdb_binobj_header header = {
-            .type = obj->type,
-            .properties_count = obj->properties_count - 1,
-            .values_size = ce_array_size(values),
-            .string_buffer_size = ce_array_size(str_buffer),
-            .subobject_buffer_size = ce_array_size(subobject_buffer),
-            .blob_buffer_size = ce_array_size(blob_buffer),
+}
+
+
+static void _gc_slot(struct db_t *db_inst,
+                     uint32_t idx) {
+    struct object_slot_t *slot = _pool_item(&db_inst->slots, idx);
+    struct object_t *obj = _get_object_from_objid((uint64_t) slot);
+
+    if (slot->prefab) {
+        struct object_slot_t *prefab_slot = _get_slot(slot->prefab);
+
+        _slot_lock(prefab_slot);
+
+        const uint32_t instances_n = ce_array_size(prefab_slot->instances);
+
+        const uint32_t last_idx = instances_n - 1;
+        for (int k = 0; k < instances_n; ++k) {
+            if (prefab_slot->instances[k] != (uint64_t) slot) {
+                continue;
+            }
+
+            prefab_slot->instances[k] = prefab_slot->instances[last_idx];
+            ce_array_pop_back(prefab_slot->instances);
+
+            break;
+        }
+
+        _slot_unlock(prefab_slot);
+    }
+
+    _destroy_object(obj);
+    _invalidate_flat(slot);
+
+    if (slot->borrowed) {
+        _release_borrowed((uint64_t) slot);
+    }
+
+    ce_array_clean(slot->instances);
+    ce_array_clean(slot->notify);
+
+    *slot = (struct object_slot_t) {
+            .idx = slot->idx,
+            .db = slot->db,
+            .instances = slot->instances,
+            .notify = slot->notify,
     };
 
-    ce_array_push_n(*output, (char *) &header,
-                    sizeof(struct cdb_binobj_header),
-                    allocator);
+    atomic_fetch_sub(&db_inst->slots.live, 1);
+    _idx_push(&db_inst->free_slots, &db_inst->slots, idx);
+}
 
-    ce_array_push_n(*output, (char *) (keys + 1),
-                    sizeof(uint64_t) * (ce_array_size(keys) - 1),
-                    allocator);
+static void _gc_object(struct db_t *db_inst,
+                       uint32_t idx) {
+    struct object_t *obj = _pool_item(&db_inst->objects, idx);
 
-    ce_array_push_n(*output, (char *) (type + 1),
-                    sizeof(uint8_t) * (ce_array_size(type) - 1),
-                    allocator);
+    _layout_release(obj->layout, _G.allocator);
 
-    ce_array_push_n(*output, (char *) (offset + 1),
-                    sizeof(uint64_t) * (ce_array_size(offset) - 1),
-                    allocator);
+    ce_array_clean(obj->values);
+    ce_array_clean(obj->changed_prop);
+    ce_array_clean(obj->delta);
+    ce_array_clean(obj->replaced);
+    ce_array_clean(obj->owned);
 
-    ce_array_push_n(*output, (char *) values_copy,
-                    ce_array_size(values),
-                    allocator);
+    _writer_free_values(obj->garbage);
+    ce_array_clean(obj->garbage);
 
-    ce_array_push_n(*output, (char *) str_buffer,
-                    header.string_buffer_size,
-                    allocator);
+    *obj = (struct object_t) {
+            .values = obj->values,
+            .changed_prop = obj->changed_prop,
+            .delta = obj->delta,
+            .replaced = obj->replaced,
+            .owned = obj->owned,
+            .garbage = obj->garbage,
+    };
+
+    atomic_fetch_sub(&db_inst->objects.live, 1);
+    _idx_push(&db_inst->free_objects, &db_inst->objects, idx);
+}
+
+// Free at most GC_STEP items from pending list. Pending list is retired list
+// detached by previous gc call, so readers get one frame to drop references.
+static void _gc_list(struct db_t *db_inst,
+                     uint32_t *pending,
+                     struct idx_list_t *retired,
+                     struct pool_t *pool,
+                     void (*free_item)(struct db_t *db_inst, uint32_t idx)) {
+    uint32_t step = GC_STEP;
+
+    while (*pending && step--) {
+        uint32_t idx = *pending - 1;
+        *pending = atomic_load_explicit(_pool_next(pool, idx),
+                                        memory_order_relaxed);
+
+        free_item(db_inst, idx);
+    }
+
+    if (!*pending) {
+        *pending = _idx_take_all(retired);
+    }
+}
+
+// Destroyed db, nobody use it so free all without free lists.
+static void _free_db(struct db_t *db_inst) {
+    const uint64_t slots_n = _pool_used(&db_inst->slots);
+
+    for (uint32_t i = 0; i < slots_n; ++i) {
+        struct object_slot_t *slot = _pool_item(&db_inst->slots, i);
+        ce_array_free(slot->instances, _G.allocator);
+        ce_array_free(slot->notify, _G.allocator);
+    }
+
+    const uint64_t objects_n = _pool_used(&db_inst->objects);
+
+    for (uint32_t i = 0; i < objects_n; ++i) {
+        struct object_t *obj = _pool_item(&db_inst->objects, i);
+
+        _layout_release(obj->layout, _G.allocator);
+
+        ce_array_free(obj->values, _G.allocator);
+        ce_array_free(obj->changed_prop, _G.allocator);
+        ce_array_free(obj->delta, _G.allocator);
+        ce_array_free(obj->replaced, _G.allocator);
+        ce_array_free(obj->owned, _G.allocator);
+
+        _writer_free_values(obj->garbage);
+        ce_array_free(obj->garbage, _G.allocator);
+    }
+
+    for (uint32_t i = 0; i < slots_n; ++i) {
+        struct object_slot_t *slot = _pool_item(&db_inst->slots, i);
+
+        if (slot->borrowed) {
+            _release_borrowed((uint64_t) slot);
+        }
+    }
+
+    const uint32_t snapshots_n = ce_array_size(db_inst->snapshots);
+    for (uint32_t i = 0; i < snapshots_n; ++i) {
+        struct snapshot_t *snapshot = &db_inst->snapshots[i];
+
+        _writer_free_values(snapshot->garbage);
+
+        ce_array_free(snapshot->entries, _G.allocator);
+        ce_array_free(snapshot->garbage, _G.allocator);
+        ce_hash_free(&snapshot->recorded, _G.allocator);
+    }
+
+    ce_array_free(db_inst->snapshots, _G.allocator);
+    ce_array_free(db_inst->held_slots, _G.allocator);
+
+    _pool_free(&db_inst->slots);
+    _pool_free(&db_inst->objects);
+
+    *db_inst = (struct db_t) {.idx = db_inst->idx};
+}
+
+// Incremental, safe to call every frame while other threads create, write
+// and destroy objects.
+static void gc() {
+    ce_os_a0->thread->spin_lock(&_G.db_lock);
+
+    const uint32_t to_free_n = ce_array_size(_G.to_free_db);
+    for (int i = 0; i < to_free_n; ++i) {
+        _free_db(&_G.dbs[_G.to_free_db[i]]);
+        ce_array_push(_G.free_db, _G.to_free_db[i], _G.allocator);
+    }
+    ce_array_clean(_G.to_free_db);
+
+    const uint32_t db_n = _G.dbs_n;
+
+    ce_os_a0->thread->spin_unlock(&_G.db_lock);
+
+    for (int i = 0; i < db_n; ++i) {
+        struct db_t *db_inst = &_G.dbs[i];
+
+        if (!db_inst->used) {
+            continue;
+        }
+
+        _gc_list(db_inst, &db_inst->pending_slots, &db_inst->retired_slots,
+                 &db_inst->slots, _gc_slot);
+
+        _gc_list(db_inst, &db_inst->pending_objects,
+                 &db_inst->retired_objects,
+                 &db_inst->objects, _gc_object);
+    }
+}
+
+struct cdb_binobj_header {
+    uint64_t version;
+    uint64_t type;
+    uint64_t properties_count;
+    uint64_t values_size;
+    uint64_t string_buffer_size;
+    uint64_t subobject_buffer_size;
+    uint64_t blob_buffer_size;
+};
+
+// CDB2 format: key table, deduplicated string table and object tree with
+// varint encoded indices and integers. Payload can be compressed.
+#define CDB_BIN_MAGIC 0x32424443
+#define CDB_BIN_COMPRESSED 1
+
+struct cdb_bin_header {
+    uint32_t magic;
+    uint32_t flags;
+    uint64_t size;
+    uint64_t stored_size;
+};
+
+struct bin_writer_t {
+    uint64_t *keys;
+    struct ce_hash_t key_map;
+
+    char *strings;
+    uint64_t *string_offset;
+    struct ce_hash_t string_map;
+
+    char *objects;
+    struct ce_alloc *allocator;
+};
+
+static void _write_varint(char **output,
+                          uint64_t v,
+                          struct ce_alloc *allocator) {
+    uint8_t buffer[10];
+    uint32_t n = 0;
+
+    while (v >= 0x80) {
+        buffer[n++] = (uint8_t) (v | 0x80);
+        v >>= 7;
+    }
+    buffer[n++] = (uint8_t) v;
+
+    ce_array_push_n(*output, (char *) buffer, n, allocator);
+}
+
+static uint64_t _bin_key(struct bin_writer_t *w,
+                         uint64_t key) {
+    uint64_t idx = ce_hash_lookup(&w->key_map, key, UINT64_MAX);
+    if (UINT64_MAX != idx) {
+        return idx;
+    }
+
+    idx = ce_array_size(w->keys);
+    ce_array_push(w->keys, key, w->allocator);
+    ce_hash_add(&w->key_map, key, idx, w->allocator);
+
+    return idx;
+}
+
+static uint64_t _bin_string(struct bin_writer_t *w,
+                            const char *str) {
+    const uint64_t len = strlen(str);
+    const uint64_t h = ce_hash_murmur2_64(str, len, 0);
+
+    uint64_t idx = ce_hash_lookup(&w->string_map, h, UINT64_MAX);
+    if ((UINT64_MAX != idx) &&
+        !strcmp(w->strings + w->string_offset[idx], str)) {
+        return idx;
+    }
+
+    _write_varint(&w->strings, len, w->allocator);
+
+    const uint64_t new_idx = ce_array_size(w->string_offset);
+    ce_array_push(w->string_offset, ce_array_size(w->strings), w->allocator);
+    ce_array_push_n(w->strings, str, len + 1, w->allocator);
+
+    // Collision keep first string in map, second is stored twice.
+    if (UINT64_MAX == idx) {
+        ce_hash_add(&w->string_map, h, new_idx, w->allocator);
+    }
+
+    return new_idx;
+}
+
+static void _dump_object(struct bin_writer_t *w,
+                         uint64_t _obj) {
+    struct object_t *obj = _get_object_from_objid(_obj);
+    const struct object_layout_t *layout = obj->layout;
+    char **out = &w->objects;
+
+    _write_varint(out, _bin_key(w, _get_slot(_obj)->type), w->allocator);
+    _write_varint(out, layout->properties_count - 1, w->allocator);
+
+    for (int i = 1; i < layout->properties_count; ++i) {
+        const uint8_t type = layout->property_type[i];
+        union type_u *value = _value_ptr(obj, i);
+
+        _write_varint(out, _bin_key(w, layout->keys[i]), w->allocator);
+        ce_array_push(*out, type, w->allocator);
+
+        switch (type) {
+            case CDB_TYPE_UINT64:
+            case CDB_TYPE_REF:
+            case CDB_TYPE_PTR:
+                _write_varint(out, value->uint64, w->allocator);
+                break;
+
+            case CDB_TYPE_FLOAT:
+            case CDB_TYPE_VEC3:
+            case CDB_TYPE_VEC4:
+            case CDB_TYPE_MAT4:
+                ce_array_push_n(*out, (char *) value, _type_size(type),
+                                w->allocator);
+                break;
+
+            case CDB_TYPE_BOOL:
+                ce_array_push(*out, value->b, w->allocator);
+                break;
+
+            case CDB_TYPE_STR:
+                _write_varint(out, _bin_string(w, value->str), w->allocator);
+                break;
 
-    ce_array_push_n(*output, (char *) subobject_buffer,
-                    header.subobject_buffer_size,
+            case CDB_TYPE_SUBOBJECT:
+                _dump_object(w, value->subobj);
+                break;
+
+            case CDB_TYPE_BLOB:
+                _write_varint(out, value->blob.size, w->allocator);
+                ce_array_push_n(*out, (char *) value->blob.data,
+                                value->blob.size, w->allocator);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+static void _dump(uint64_t _obj,
+                  char **output,
+                  struct ce_alloc *allocator,
+                  bool compress) {
+    struct bin_writer_t w = {.allocator = allocator};
+
+    _dump_object(&w, _obj);
+
+    char *payload = NULL;
+
+    const uint64_t key_n = ce_array_size(w.keys);
+    ce_array_push_n(payload, (char *) &key_n, sizeof(uint64_t), allocator);
+    ce_array_push_n(payload, (char *) w.keys, sizeof(uint64_t) * key_n,
                     allocator);
 
-    ce_array_push_n(*output, (char *) blob_buffer,
-                    header.blob_buffer_size,
+    _write_varint(&payload, ce_array_size(w.string_offset), allocator);
+    ce_array_push_n(payload, w.strings, ce_array_size(w.strings), allocator);
+    ce_array_push_n(payload, w.objects, ce_array_size(w.objects), allocator);
+
+    struct cdb_bin_header header = {
+            .magic = CDB_BIN_MAGIC,
+            .size = ce_array_size(payload),
+            .stored_size = ce_array_size(payload),
+    };
+
+    char *compressed = NULL;
+    if (compress) {
+        uLongf compressed_size = compressBound(header.size);
+        compressed = CE_ALLOC(allocator, char, compressed_size);
+
+        // Keep raw payload if it not help.
+        if ((Z_OK == compress2((Bytef *) compressed, &compressed_size,
+                               (const Bytef *) payload, header.size,
+                               Z_BEST_SPEED)) &&
+            (compressed_size < header.size)) {
+            header.flags |= CDB_BIN_COMPRESSED;
+            header.stored_size = compressed_size;
+        }
+    }
+
+    ce_array_push_n(*output, (char *) &header, sizeof(struct cdb_bin_header),
                     allocator);
 
-    CE_FREE(allocator, values_copy);
+    ce_array_push_n(*output,
+                    (header.flags & CDB_BIN_COMPRESSED) ? compressed : payload,
+                    header.stored_size, allocator);
+
+    CE_FREE(allocator, compressed);
+    ce_array_free(payload, allocator);
+    ce_array_free(w.keys, allocator);
+    ce_array_free(w.strings, allocator);
+    ce_array_free(w.string_offset, allocator);
+    ce_array_free(w.objects, allocator);
+    ce_hash_free(&w.key_map, allocator);
+    ce_hash_free(&w.string_map, allocator);
 }
 
-static void load(struct ce_cdb_t db,
-                 const char *input,
-                 uint64_t _obj,
+static void dump(uint64_t _obj,
+                 char **output,
                  struct ce_alloc *allocator) {
+    _dump(_obj, output, allocator, false);
+}
+
+static void dump_compressed(uint64_t _obj,
+                            char **output,
+                            struct ce_alloc *allocator) {
+    _dump(_obj, output, allocator, true);
+}
+
+// Same resource type mostly have same layout, skip building it.
+static struct object_layout_t *_load_layout(struct object_t *obj,
+                                            const uint64_t *keys,
+                                            const uint8_t *ptype,
+                                            const uint64_t *offset,
+                                            uint64_t n,
+                                            struct ce_alloc *allocator) {
+    struct object_layout_t *layout = NULL;
+    if (obj->layout == &_G.empty_layout) {
+        layout = _layout_find(keys, ptype, offset, n);
+    }
+
+    if (layout) {
+        obj->layout = layout;
+        return layout;
+    }
+
+    layout = _object_own_layout(obj, allocator);
+
+    ce_array_push_n(layout->keys, keys, n, allocator);
+    ce_array_push_n(layout->property_type, ptype, n, allocator);
+    ce_array_push_n(layout->offset, offset, n, allocator);
+
+    layout->properties_count += n;
+    layout->id = atomic_fetch_add(&_G.layout_id, 1);
+
+    for (int i = 1; i < layout->properties_count; ++i) {
+        ce_hash_add(&layout->prop_map, layout->keys[i], i, allocator);
+    }
+
+    _object_intern_layout(obj);
+    return obj->layout;
+}
+
+// With borrow strings and blobs point to input, input must live forever.
+static void _load_v1(struct ce_cdb_t db,
+                  const char *input,
+                  uint64_t _obj,
+                  struct ce_alloc *allocator,
+                  bool borrow) {
 
     const struct cdb_binobj_header *header;
     header = (const struct cdb_binobj_header *) input;
 
-    struct object_t *obj = _get_object_from_objid(_obj);
-    if (!obj->type) {
-        obj->type = header->type;
+    struct object_slot_t *slot = _get_slot(_obj);
+    if (!slot->type) {
+        slot->type = header->type;
     }
 
     uint64_t *keys = (uint64_t *) (header + 1);
@@ -626,78 +1658,71 @@ static void load(struct ce_cdb_t db,
         return;
     }
 
-    ce_array_push_n(obj->keys, keys,
-                    header->properties_count,
-                    allocator);
+    struct object_t *obj = _get_object_from_objid(_obj);
 
-    ce_array_push_n(obj->property_type, ptype,
-                    header->properties_count,
-                    allocator);
+    _invalidate_flat(slot);
 
-    ce_array_push_n(obj->offset, offset,
-                    header->properties_count,
-                    allocator);
+    struct object_layout_t *layout = _load_layout(obj, keys, ptype, offset,
+                                                  header->properties_count,
+                                                  allocator);
 
     ce_array_push_n(obj->values, values,
                     header->values_size,
                     allocator);
 
-    obj->properties_count += header->properties_count;
-
-    for (int i = 1; i < obj->properties_count; ++i) {
-        ce_hash_add(&obj->prop_map, obj->keys[i], i, allocator);
-    }
+    for (int i = 1; i < layout->properties_count; ++i) {
+        union type_u *value_ptr = _value_ptr(obj, i);
 
-    for (int i = 1; i < obj->properties_count; ++i) {
-        switch (obj->property_type[i]) {
+        switch (layout->property_type[i]) {
             case CDB_TYPE_SUBOBJECT: {
-                uint64_t suboffset = *(uint64_t *) (obj->values +
-                                                    obj->offset[i]);
+                uint64_t suboffset = value_ptr->uint64;
 
                 const char *subobj_data;
                 subobj_data = subobject_buffer + suboffset;
 
                 uint64_t subobj = create_object(db, 0);
-                load(obj->db, subobj_data, subobj, allocator);
+                _load_v1(obj->db, subobj_data, subobj, allocator, borrow);
 
-                struct object_t *sub_obj = _get_object_from_objid(subobj);
-                sub_obj->parent = _obj;
+                _get_slot(subobj)->parent = _obj;
 
-                union type_u *value_ptr = (union type_u *) (obj->values +
-                                                            obj->offset[i]);
                 value_ptr->subobj = subobj;
             }
 
                 break;
 
             case CDB_TYPE_STR: {
-                uint64_t str_offset = *(uint64_t *) (obj->values +
-                                                     obj->offset[i]);
+                uint64_t str_offset = value_ptr->uint64;
+
+                if (borrow) {
+                    value_ptr->str = (char *) (strbuffer + str_offset);
+                    break;
+                }
 
                 char *dup_str = ce_memory_a0->str_dup(strbuffer + str_offset,
                                                       allocator);
 
-                union type_u *value_ptr = (union type_u *) (obj->values +
-                                                            obj->offset[i]);
                 value_ptr->str = dup_str;
             }
 
                 break;
 
             case CDB_TYPE_BLOB: {
-                uint64_t blob_offset = *(uint64_t *) (obj->values +
-                                                      obj->offset[i]);
+                uint64_t blob_offset = value_ptr->uint64;
 
                 uint64_t size = *((uint64_t *) (blob_buffer + blob_offset));
                 const char *blob_data = ((blob_buffer +
                                           blob_offset + sizeof(uint64_t)));
 
+                value_ptr->blob.size = size;
+
+                if (borrow) {
+                    value_ptr->blob.data = (void *) blob_data;
+                    break;
+                }
+
                 char *copy_blob_data = CE_ALLOC(allocator, char, size);
                 memcpy(copy_blob_data, blob_data, size);
 
-                union type_u *value_ptr = (union type_u *) (obj->values +
-                                                            obj->offset[i]);
-                value_ptr->blob.size = size;
                 value_ptr->blob.data = copy_blob_data;
             }
                 break;
@@ -708,178 +1733,680 @@ static void load(struct ce_cdb_t db,
     }
 }
 
-static ce_cdb_obj_o *write_begin(uint64_t _obj) {
+struct bin_reader_t {
+    struct ce_cdb_t db;
+    uint64_t *key_table;
+    const char **strings;
+
+    // Properties of objects on recursion stack.
+    uint64_t *keys;
+    uint8_t *types;
+    uint64_t *offsets;
+    uint8_t *values;
+
+    struct ce_alloc *allocator;
+    bool borrow;
+};
+
+static inline uint64_t _read_varint(const uint8_t **input) {
+    const uint8_t *p = *input;
+
+    if (p[0] < 0x80) {
+        *input = p + 1;
+        return p[0];
+    }
+
+    uint64_t v = 0;
+    uint32_t shift = 0;
+    do {
+        v |= (uint64_t) (*p & 0x7f) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+
+    *input = p;
+    return v;
+}
+
+static const uint8_t *_load_object(struct bin_reader_t *r,
+                                   const uint8_t *input,
+                                   uint64_t _obj) {
+    struct object_slot_t *slot = _get_slot(_obj);
+
+    const uint64_t type = r->key_table[_read_varint(&input)];
+    if (!slot->type) {
+        slot->type = type;
+    }
+
+    const uint64_t n = _read_varint(&input);
+    if (!n) {
+        return input;
+    }
+
+    const uint64_t base = ce_array_size(r->keys);
+    const uint64_t values_base = ce_array_size(r->values);
+
+    for (uint64_t i = 0; i < n; ++i) {
+        const uint64_t key = r->key_table[_read_varint(&input)];
+        const uint8_t prop_type = *input++;
+        const uint64_t size = _type_size(prop_type);
+
+        union type_u value = {};
+
+        switch (prop_type) {
+            case CDB_TYPE_UINT64:
+            case CDB_TYPE_REF:
+            case CDB_TYPE_PTR:
+                value.uint64 = _read_varint(&input);
+                break;
+
+            case CDB_TYPE_FLOAT:
+            case CDB_TYPE_VEC3:
+            case CDB_TYPE_VEC4:
+            case CDB_TYPE_MAT4:
+                memcpy(&value, input, size);
+                input += size;
+                break;
+
+            case CDB_TYPE_BOOL:
+                value.b = *input++;
+                break;
+
+            case CDB_TYPE_STR: {
+                const char *str = r->strings[_read_varint(&input)];
+                value.str = r->borrow ? (char *) str
+                                      : ce_memory_a0->str_dup(str,
+                                                              r->allocator);
+            }
+                break;
+
+            case CDB_TYPE_SUBOBJECT:
+                value.subobj = create_object(r->db, 0);
+                _get_slot(value.subobj)->parent = _obj;
+                input = _load_object(r, input, value.subobj);
+                break;
+
+            case CDB_TYPE_BLOB:
+                value.blob.size = _read_varint(&input);
+                if (r->borrow) {
+                    value.blob.data = (void *) input;
+                } else {
+                    value.blob.data = CE_ALLOC(r->allocator, char,
+                                               value.blob.size);
+                    memcpy(value.blob.data, input, value.blob.size);
+                }
+                input += value.blob.size;
+                break;
+
+            default:
+                break;
+        }
+
+        const uint64_t offset = ce_array_size(r->values) - values_base;
+        ce_array_push(r->keys, key, _G.allocator);
+        ce_array_push(r->types, prop_type, _G.allocator);
+        ce_array_push(r->offsets, offset, _G.allocator);
+        ce_array_push_n(r->values, (uint8_t *) &value, size, _G.allocator);
+    }
+
     struct object_t *obj = _get_object_from_objid(_obj);
+
+    _invalidate_flat(slot);
+
+    _load_layout(obj, r->keys + base, r->types + base, r->offsets + base, n,
+                 r->allocator);
+
+    ce_array_push_n(obj->values, r->values + values_base,
+                    ce_array_size(r->values) - values_base,
+                    r->allocator);
+
+    ce_array_resize(r->keys, base, _G.allocator);
+    ce_array_resize(r->types, base, _G.allocator);
+    ce_array_resize(r->offsets, base, _G.allocator);
+    ce_array_resize(r->values, values_base, _G.allocator);
+
+    return input;
+}
+
+static void _load_v2(struct ce_cdb_t db,
+                     const uint8_t *input,
+                     uint64_t _obj,
+                     struct ce_alloc *allocator,
+                     bool borrow) {
+    struct bin_reader_t r = {
+            .db = db,
+            .allocator = allocator,
+            .borrow = borrow,
+    };
+
+    // Payload can start on any offset, copy keys to aligned table.
+    uint64_t key_n;
+    memcpy(&key_n, input, sizeof(uint64_t));
+    input += sizeof(uint64_t);
+
+    ce_array_resize(r.key_table, key_n, _G.allocator);
+    memcpy(r.key_table, input, sizeof(uint64_t) * key_n);
+    input += sizeof(uint64_t) * key_n;
+
+    const uint64_t string_n = _read_varint(&input);
+    ce_array_resize(r.strings, string_n, _G.allocator);
+    for (uint64_t i = 0; i < string_n; ++i) {
+        const uint64_t len = _read_varint(&input);
+        r.strings[i] = (const char *) input;
+        input += len + 1;
+    }
+
+    _load_object(&r, input, _obj);
+
+    ce_array_free(r.key_table, _G.allocator);
+    ce_array_free(r.strings, _G.allocator);
+    ce_array_free(r.keys, _G.allocator);
+    ce_array_free(r.types, _G.allocator);
+    ce_array_free(r.offsets, _G.allocator);
+    ce_array_free(r.values, _G.allocator);
+}
+
+static void _load(struct ce_cdb_t db,
+                  const char *input,
+                  uint64_t _obj,
+                  struct ce_alloc *allocator,
+                  bool borrow) {
+    struct cdb_bin_header header;
+    memcpy(&header, input, sizeof(struct cdb_bin_header));
+
+    // Old format start with zero version.
+    if (CDB_BIN_MAGIC != header.magic) {
+        _load_v1(db, input, _obj, allocator, borrow);
+        return;
+    }
+
+    const uint8_t *payload = (const uint8_t *) (input + sizeof(header));
+
+    if (!(header.flags & CDB_BIN_COMPRESSED)) {
+        _load_v2(db, payload, _obj, allocator, borrow);
+        return;
+    }
+
+    uint8_t *data = CE_ALLOC(_G.allocator, uint8_t, header.size);
+
+    uLongf size = header.size;
+    if (Z_OK != uncompress(data, &size, payload, header.stored_size)) {
+        ce_log_a0->error(LOG_WHERE, "could not decompress object");
+        CE_FREE(_G.allocator, data);
+        return;
+    }
+
+    // Borrowed data live as long as mapped input.
+    if (borrow) {
+        _borrow_range(data, header.size, _obj, NULL, _G.allocator);
+    }
+
+    _load_v2(db, data, _obj, allocator, borrow);
+
+    if (!borrow) {
+        CE_FREE(_G.allocator, data);
+    }
+}
+
+static void load(struct ce_cdb_t db,
+                 const char *input,
+                 uint64_t _obj,
+                 struct ce_alloc *allocator) {
+    _load(db, input, _obj, allocator, false);
+}
+
+static void load_mapped(struct ce_cdb_t db,
+                        struct ce_vio *input,
+                        uint64_t _obj,
+                        struct ce_alloc *allocator) {
+    const uint64_t size = input->size(input);
+
+    const char *data = input->map ? input->map(input) : NULL;
+    const bool mapped = data != NULL;
+    if (!mapped) {
+        char *buffer = CE_ALLOC(allocator, char, size);
+        input->read(input, buffer, 1, size);
+        data = buffer;
+    }
+
+    struct cdb_bin_header header;
+    memcpy(&header, data, sizeof(struct cdb_bin_header));
+
+    // Compressed object borrow decompressed copy, input is not needed.
+    if ((CDB_BIN_MAGIC == header.magic) &&
+        (header.flags & CDB_BIN_COMPRESSED)) {
+        _load(db, data, _obj, allocator, true);
+
+        if (!mapped) {
+            CE_FREE(allocator, (void *) data);
+        } else if (input->unmap) {
+            input->unmap(data, size);
+        }
+
+        return;
+    }
+
+    _borrow_range(data, size, _obj, mapped ? input->unmap : NULL, allocator);
+    _load(db, data, _obj, allocator, true);
+}
+
+// Pin current version of object, pinned version is not retired until
+// _version_release.
+static struct object_t *_version_pin(uint64_t _obj) {
+    struct object_slot_t *slot = _get_slot(_obj);
+
+    while (true) {
+        struct object_t *obj = _get_object(slot->db,
+                                           atomic_load(&slot->version));
+
+        uint32_t hold = atomic_load(&obj->hold);
+        while (!(hold & OBJECT_RETIRED)) {
+            if (atomic_compare_exchange_weak(&obj->hold, &hold, hold + 1)) {
+                return obj;
+            }
+        }
+    }
+}
+
+// Writer pin version it is based on, pin is released on commit.
+static struct object_t *_new_writer(uint64_t _obj,
+                                    bool clone) {
+    struct object_t *obj = _version_pin(_obj);
     struct db_t *db_inst = &_G.dbs[obj->db.idx];
 
-    struct object_t *new_obj = _object_clone(db_inst,
-                                             obj,
-                                             _G.allocator);
-    new_obj->orig_data_idx = obj->idx;
+    struct object_t *writer;
+    if (clone) {
+        writer = _object_clone(db_inst, obj, _G.allocator);
+    } else {
+        writer = _new_object(db_inst, _G.allocator);
+    }
+
+    writer->db = obj->db;
+    writer->orig_data_idx = obj->idx;
+    writer->obj = _obj;
+    writer->clone = clone;
+
+    return writer;
+}
+
+// Delta writer, changes are applied to new version of object on commit.
+static ce_cdb_obj_o *write_begin(uint64_t _obj) {
+    return _new_writer(_obj, false);
+}
+
+// Full clone writer, changes go directly to private copy of object.
+static ce_cdb_obj_o *write_begin_clone(uint64_t _obj) {
+    return _new_writer(_obj, true);
+}
+
+static void _queue_notify(uint64_t _obj,
+                          const uint64_t *changed_prop,
+                          uint32_t changed_prop_n) {
+    ce_os_a0->thread->spin_lock(&_G.notify_lock);
+
+    uint64_t idx = ce_hash_lookup(&_G.notify_queue_map, _obj, UINT64_MAX);
+    if (UINT64_MAX == idx) {
+        idx = ce_array_size(_G.notify_queue);
+
+        struct queued_notify_t queued = {.obj = _obj};
+        ce_array_push(_G.notify_queue, queued, _G.allocator);
+        ce_hash_add(&_G.notify_queue_map, _obj, idx, _G.allocator);
+    }
+
+    struct queued_notify_t *queued = &_G.notify_queue[idx];
+    for (uint32_t i = 0; i < changed_prop_n; ++i) {
+        const uint32_t props_n = ce_array_size(queued->props);
 
-    new_obj->obj = _obj;
+        uint32_t j = 0;
+        while ((j < props_n) && (queued->props[j] != changed_prop[i])) {
+            ++j;
+        }
+
+        if (j == props_n) {
+            ce_array_push(queued->props, changed_prop[i], _G.allocator);
+        }
+    }
+
+    ce_os_a0->thread->spin_unlock(&_G.notify_lock);
+}
+
+static void _unqueue_notify(uint64_t _obj) {
+    ce_os_a0->thread->spin_lock(&_G.notify_lock);
+
+    uint64_t idx = ce_hash_lookup(&_G.notify_queue_map, _obj, UINT64_MAX);
+    if (UINT64_MAX != idx) {
+        _G.notify_queue[idx].obj = 0;
+        ce_hash_remove(&_G.notify_queue_map, _obj);
+    }
+
+    ce_os_a0->thread->spin_unlock(&_G.notify_lock);
+}
+
+// Deliver queued changes, changes made by listeners are delivered on next
+// flush.
+static void flush_notify() {
+    ce_os_a0->thread->spin_lock(&_G.notify_lock);
+
+    struct queued_notify_t *queue = _G.notify_queue;
+    _G.notify_queue = NULL;
+    ce_hash_clean(&_G.notify_queue_map);
+
+    ce_os_a0->thread->spin_unlock(&_G.notify_lock);
+
+    struct notify_pair *notify = NULL;
+
+    const uint32_t queue_n = ce_array_size(queue);
+    for (uint32_t i = 0; i < queue_n; ++i) {
+        struct queued_notify_t *queued = &queue[i];
 
-    return (void *) new_obj->idx;
+        if (queued->obj) {
+            struct object_slot_t *slot = _get_slot(queued->obj);
+
+            ce_array_clean(notify);
+            _slot_listeners(slot, &notify, NULL);
+
+            const uint32_t notify_n = ce_array_size(notify);
+            for (uint32_t j = 0; j < notify_n; ++j) {
+                struct notify_pair *pair = &notify[j];
+
+                if (!pair->deferred) {
+                    continue;
+                }
+
+                pair->notify(queued->obj, queued->props,
+                             ce_array_size(queued->props), pair->data);
+            }
+        }
+
+        ce_array_free(queued->props, _G.allocator);
+    }
+
+    ce_array_free(notify, _G.allocator);
+    ce_array_free(queue, _G.allocator);
 }
 
 static void _notify(uint64_t _obj,
                     uint64_t *changed_prop) {
-    struct object_t *obj = _get_object_from_objid(_obj);
+    struct object_slot_t *slot = _get_slot(_obj);
 
-    const int notify_n = ce_array_size(obj->notify);
     const int changed_prop_n = ce_array_size(changed_prop);
 
     if(!changed_prop_n) {
         return;
     }
 
+    _invalidate_flat(slot);
+
+    struct notify_pair *notify = NULL;
+    uint64_t *instances = NULL;
+    _slot_listeners(slot, &notify, &instances);
+
+    const int notify_n = ce_array_size(notify);
+
+    bool deferred = false;
     for (int i = 0; i < notify_n; ++i) {
-        struct notify_pair *pair = &obj->notify[i];
+        struct notify_pair *pair = &notify[i];
+
+        if (pair->deferred) {
+            deferred = true;
+            continue;
+        }
+
         pair->notify(_obj, changed_prop, changed_prop_n, pair->data);
     }
 
-    const int instances_n = ce_array_size(obj->instances);
+    if (deferred) {
+        _queue_notify(_obj, changed_prop, changed_prop_n);
+    }
+
+    const int instances_n = ce_array_size(instances);
     for (int i = 0; i < instances_n; ++i) {
-        _notify(obj->instances[i], changed_prop);
+        _notify(instances[i], changed_prop);
     }
+
+    ce_array_free(notify, _G.allocator);
+    ce_array_free(instances, _G.allocator);
 }
 
-static void write_commit(ce_cdb_obj_o *_writer) {
-    struct object_t *writer = _get_object_from_obj_o(_writer);
-    struct object_t *orig_obj = _get_object_from_objid(writer->obj);
+// Make writer ready to publish as new version of orig_obj.
+static void _writer_apply(struct object_t *writer,
+                          struct object_t *orig_obj) {
+    if (writer->clone) {
+        if (writer->layout != orig_obj->layout) {
+            _object_intern_layout(writer);
+        }
+
+        return;
+    }
 
-    uint64_t *obj_addr = (uint64_t *) writer->obj;
+    const uint64_t values_size = ce_array_size(orig_obj->values);
 
-    *obj_addr = writer->idx;
+    ce_array_clean(writer->replaced);
 
-//    (*(struct object_t **) writer->obj) = writer;
+    _layout_release(writer->layout, _G.allocator);
+    writer->layout = _layout_retain(orig_obj->layout);
 
-    _notify(writer->obj, writer->changed_prop);
+    ce_array_clean(writer->values);
+    if (values_size) {
+        ce_array_push_n(writer->values, orig_obj->values, values_size,
+                        _G.allocator);
+    }
+
+    const uint32_t delta_n = ce_array_size(writer->delta);
+    for (int i = 0; i < delta_n; ++i) {
+        struct delta_t *delta = &writer->delta[i];
+
+        _object_set(writer, writer, delta->key, delta->type, &delta->value,
+                    _G.allocator);
+    }
+
+    if (writer->layout != orig_obj->layout) {
+        _object_intern_layout(writer);
+    }
+}
 
-    _destroy_object(orig_obj);
+static void _writer_free_values(void **values) {
+    const uint32_t n = ce_array_size(values);
+    for (int i = 0; i < n; ++i) {
+        CE_FREE(_G.allocator, values[i]);
+    }
 }
 
-static bool write_try_commit(ce_cdb_obj_o *_writer) {
-    struct object_t *writer = _get_object_from_obj_o(_writer);
-    struct object_t *orig_obj = _get_object_from_objid(writer->obj);
+// Without snapshot replaced strings and blobs are freed with prev version.
+static void _retire_values(struct object_t *prev,
+                           void **replaced) {
+    const uint32_t replaced_n = ce_array_size(replaced);
+    if (replaced_n) {
+        ce_array_push_n(prev->garbage, replaced, replaced_n, _G.allocator);
+    }
+}
 
-    uint64_t *obj_addr = (uint64_t *) writer->obj;
+// Remember replaced version in newest snapshot, replaced strings and blobs
+// live until snapshots that can see them are released.
+static void _snapshot_record(struct db_t *db_inst,
+                             uint64_t _obj,
+                             struct object_t *prev,
+                             void **replaced) {
+    if (!atomic_load(&db_inst->snapshots_n)) {
+        _retire_values(prev, replaced);
+        return;
+    }
 
-    bool ok = atomic_compare_exchange_weak((atomic_ullong *) obj_addr,
-                                           &writer->orig_data_idx, writer->idx);
+    ce_os_a0->thread->spin_lock(&db_inst->snapshot_lock);
 
-    if (!ok) {
-        goto end;
+    const uint32_t snapshots_n = ce_array_size(db_inst->snapshots);
+    if (!snapshots_n) {
+        ce_os_a0->thread->spin_unlock(&db_inst->snapshot_lock);
+        _retire_values(prev, replaced);
+        return;
     }
 
-    _notify(writer->obj, writer->changed_prop);
+    struct snapshot_t *snapshot = &db_inst->snapshots[snapshots_n - 1];
 
-    end:
-    _destroy_object(orig_obj);
-    return ok;
-}
+    if (!ce_hash_contain(&snapshot->recorded, _obj)) {
+        atomic_fetch_add(&prev->hold, 1);
 
+        struct snapshot_entry_t entry = {
+                .obj = _obj,
+                .version = prev->idx,
+        };
 
-static void set_float(ce_cdb_obj_o *_writer,
-                      uint64_t property,
-                      float value) {
-    struct object_t *writer = _get_object_from_obj_o(_writer);
+        ce_array_push(snapshot->entries, entry, _G.allocator);
+        ce_hash_add(&snapshot->recorded, _obj, 1, _G.allocator);
+    }
 
-    uint64_t idx = _find_prop_index(writer, property);
-    if (!idx) {
-        idx = _object_new_property(writer, property,
-                                   CDB_TYPE_FLOAT, &value,
-                                   sizeof(float),
-                                   _G.allocator);
+    const uint32_t replaced_n = ce_array_size(replaced);
+    if (replaced_n) {
+        ce_array_push_n(snapshot->garbage, replaced, replaced_n, _G.allocator);
     }
 
-    ce_array_push(writer->changed_prop, property, _G.allocator);
+    ce_os_a0->thread->spin_unlock(&db_inst->snapshot_lock);
+}
+
+// Writer is published, prev is version it replaced. Writer is pinned
+// until commit is done, concurrent commit could retire it.
+static void _commit_done(struct object_t *writer,
+                         struct object_t *prev) {
+    struct db_t *db_inst = &_G.dbs[writer->db.idx];
+
+    atomic_fetch_add(&db_inst->commit_n, 1);
+
+    _notify(writer->obj, writer->changed_prop);
 
-    union type_u *value_ptr = (union type_u *) (writer->values +
-                                                writer->offset[idx]);
-    value_ptr->f = value;
+    _snapshot_record(db_inst, writer->obj, prev, writer->replaced);
+
+    _destroy_object(prev);
+    _version_release(writer);
 }
 
-static void set_bool(ce_cdb_obj_o *_writer,
-                     uint64_t property,
-                     bool value) {
+// Clone writer replace whatever version is current (last writer wins),
+// delta writer is rebased on current version until commit succeed.
+static void write_commit(ce_cdb_obj_o *_writer) {
     struct object_t *writer = _get_object_from_obj_o(_writer);
+    struct object_slot_t *slot = _get_slot(writer->obj);
+    struct object_t *orig_obj = _get_object(writer->db.idx,
+                                            writer->orig_data_idx);
+
+    atomic_store(&writer->hold, 1);
 
-    uint64_t idx = _find_prop_index(writer, property);
-    if (!idx) {
-        idx = _object_new_property(writer, property,
-                                   CDB_TYPE_BOOL, &value,
-                                   sizeof(bool),
-                                   _G.allocator);
+    if (writer->clone) {
+        _writer_apply(writer, orig_obj);
+        _version_release(orig_obj);
+
+        uint64_t prev_idx = atomic_exchange(&slot->version, writer->idx);
+        _commit_done(writer, _get_object(writer->db.idx, prev_idx));
+        return;
     }
 
-    ce_array_push(writer->changed_prop, property, _G.allocator);
+    while (true) {
+        _writer_apply(writer, orig_obj);
 
-    union type_u *value_ptr = (union type_u *) (writer->values +
-                                                writer->offset[idx]);
-    value_ptr->b = value;
-}
+        uint64_t prev_idx = writer->orig_data_idx;
+        if (atomic_compare_exchange_strong(&slot->version, &prev_idx,
+                                           writer->idx)) {
+            break;
+        }
 
-static void set_vec3(ce_cdb_obj_o *_writer,
-                     uint64_t property,
-                     const float *value) {
-    const size_t size = sizeof(float) * 3;
+        _version_release(orig_obj);
+        orig_obj = _version_pin(writer->obj);
+        writer->orig_data_idx = orig_obj->idx;
+    }
+
+    _version_release(orig_obj);
+    _commit_done(writer, orig_obj);
+}
 
+static bool write_try_commit(ce_cdb_obj_o *_writer) {
     struct object_t *writer = _get_object_from_obj_o(_writer);
+    struct object_t *orig_obj = _get_object(writer->db.idx,
+                                            writer->orig_data_idx);
+    struct object_slot_t *slot = _get_slot(writer->obj);
+
+    atomic_store(&writer->hold, 1);
+
+    bool ok = atomic_load(&slot->version) == writer->orig_data_idx;
 
-    uint64_t idx = _find_prop_index(writer, property);
-    if (!idx) {
-        idx = _object_new_property(writer, property,
-                                   CDB_TYPE_VEC3, value,
-                                   size, _G.allocator);
+    if (ok) {
+        _writer_apply(writer, orig_obj);
+
+        ok = atomic_compare_exchange_strong(&slot->version,
+                                            &writer->orig_data_idx,
+                                            writer->idx);
     }
 
-    ce_array_push(writer->changed_prop, property, _G.allocator);
+    _version_release(orig_obj);
 
-    union type_u *value_ptr = (union type_u *) (writer->values +
-                                                writer->offset[idx]);
-    memcpy(value_ptr->vec3, value, size);
-}
+    if (!ok) {
+        _writer_free_values(writer->owned);
+        _destroy_object(writer);
+        _version_release(writer);
+        return false;
+    }
 
-static void set_vec4(ce_cdb_obj_o *_writer,
-                     uint64_t property,
-                     const float *value) {
-    const size_t size = sizeof(float) * 4;
+    _commit_done(writer, orig_obj);
+    return true;
+}
 
+static void _writer_set(ce_cdb_obj_o *_writer,
+                        uint64_t property,
+                        enum ce_cdb_type type,
+                        const union type_u *value) {
     struct object_t *writer = _get_object_from_obj_o(_writer);
 
-    uint64_t idx = _find_prop_index(writer, property);
-    if (!idx) {
-        idx = _object_new_property(writer, property,
-                                   CDB_TYPE_VEC4, value,
-                                   size, _G.allocator);
+    ce_array_push(writer->changed_prop, property, _G.allocator);
+
+    if (writer->clone) {
+        _object_set(writer, writer, property, type, value, _G.allocator);
+        return;
     }
 
-    ce_array_push(writer->changed_prop, property, _G.allocator);
+    struct delta_t delta = {
+            .key = property,
+            .type = type,
+            .value = *value,
+    };
 
-    union type_u *value_ptr = (union type_u *) (writer->values +
-                                                writer->offset[idx]);
-    memcpy(value_ptr->vec4, value, size);
+    ce_array_push(writer->delta, delta, _G.allocator);
 }
 
-static void set_mat4(ce_cdb_obj_o *_writer,
+static void set_float(ce_cdb_obj_o *_writer,
+                      uint64_t property,
+                      float value) {
+    union type_u v = {.f = value};
+    _writer_set(_writer, property, CDB_TYPE_FLOAT, &v);
+}
+
+static void set_bool(ce_cdb_obj_o *_writer,
+                     uint64_t property,
+                     bool value) {
+    union type_u v = {.b = value};
+    _writer_set(_writer, property, CDB_TYPE_BOOL, &v);
+}
+
+static void set_vec3(ce_cdb_obj_o *_writer,
                      uint64_t property,
                      const float *value) {
-    const size_t size = sizeof(float) * 16;
-    struct object_t *writer = _get_object_from_obj_o(_writer);
+    union type_u v = {};
+    memcpy(v.vec3, value, sizeof(float) * 3);
 
-    uint64_t idx = _find_prop_index(writer, property);
-    if (!idx) {
-        idx = _object_new_property(writer, property,
-                                   CDB_TYPE_MAT4, value,
-                                   size, _G.allocator);
-    }
+    _writer_set(_writer, property, CDB_TYPE_VEC3, &v);
+}
+
+static void set_vec4(ce_cdb_obj_o *_writer,
+                     uint64_t property,
+                     const float *value) {
+    union type_u v = {};
+    memcpy(v.vec4, value, sizeof(float) * 4);
+
+    _writer_set(_writer, property, CDB_TYPE_VEC4, &v);
+}
 
-    ce_array_push(writer->changed_prop, property, _G.allocator);
+static void set_mat4(ce_cdb_obj_o *_writer,
+                     uint64_t property,
+                     const float *value) {
+    union type_u v = {};
+    memcpy(v.mat4, value, sizeof(float) * 16);
 
-    union type_u *value_ptr = (union type_u *) (writer->values +
-                                                writer->offset[idx]);
-    memcpy(value_ptr->mat4, value, size);
+    _writer_set(_writer, property, CDB_TYPE_MAT4, &v);
 }
 
 static void set_string(ce_cdb_obj_o *_writer,
@@ -889,83 +2416,31 @@ static void set_string(ce_cdb_obj_o *_writer,
 
     struct object_t *writer = _get_object_from_obj_o(_writer);
 
-    uint64_t idx = _find_prop_index(writer, property);
-
-    if (!idx) {
-        idx = _object_new_property(writer, property,
-                                   CDB_TYPE_STR,
-                                   &value, sizeof(char *),
-                                   _G.allocator);
-    } else {
-        union type_u *value_ptr = (union type_u *) (writer->values +
-                                                    writer->offset[idx]);
-
-        CE_FREE(a, value_ptr->str);
-    }
-
-    union type_u *value_ptr = (union type_u *) (writer->values +
-                                                writer->offset[idx]);
-
-    char *value_clone = ce_memory_a0->str_dup(value, a);
-
-    ce_array_push(writer->changed_prop, property, _G.allocator);
+    union type_u v = {.str = ce_memory_a0->str_dup(value, a)};
+    ce_array_push(writer->owned, v.str, a);
 
-    value_ptr->str = value_clone;
+    _writer_set(_writer, property, CDB_TYPE_STR, &v);
 }
 
 static void set_uint64(ce_cdb_obj_o *_writer,
                        uint64_t property,
                        uint64_t value) {
-    struct object_t *writer = _get_object_from_obj_o(_writer);
-
-    uint64_t idx = _find_prop_index(writer, property);
-    if (!idx) {
-        idx = _object_new_property(writer, property, CDB_TYPE_UINT64,
-                                   &value, sizeof(uint64_t), _G.allocator);
-    }
-    ce_array_push(writer->changed_prop, property, _G.allocator);
-
-
-    union type_u *value_ptr = (union type_u *) (writer->values +
-                                                writer->offset[idx]);
-    value_ptr->uint64 = value;
+    union type_u v = {.uint64 = value};
+    _writer_set(_writer, property, CDB_TYPE_UINT64, &v);
 }
 
 static void set_ptr(ce_cdb_obj_o *_writer,
                     uint64_t property,
                     const void *value) {
-    struct object_t *writer = _get_object_from_obj_o(_writer);
-
-    uint64_t idx = _find_prop_index(writer, property);
-    if (!idx) {
-        idx = _object_new_property(writer, property, CDB_TYPE_PTR, &value,
-                                   sizeof(void *),
-                                   _G.allocator);
-    }
-    ce_array_push(writer->changed_prop, property, _G.allocator);
-
-    memcpy((writer->values + writer->offset[idx]), &value, sizeof(void *));
+    union type_u v = {.ptr = (void *) value};
+    _writer_set(_writer, property, CDB_TYPE_PTR, &v);
 }
 
 static void set_ref(ce_cdb_obj_o *_writer,
                     uint64_t property,
                     uint64_t ref) {
-
-    struct object_t *writer = _get_object_from_obj_o(_writer);
-
-    uint64_t idx = _find_prop_index(writer, property);
-    if (!idx) {
-        idx = _object_new_property(writer, property,
-                                   CDB_TYPE_REF, &ref,
-                                   sizeof(uint64_t),
-                                   _G.allocator);
-    }
-
-    ce_array_push(writer->changed_prop, property, _G.allocator);
-
-    union type_u *value_ptr = (union type_u *) (writer->values +
-                                                writer->offset[idx]);
-    value_ptr->ref = ref;
+    union type_u v = {.ref = ref};
+    _writer_set(_writer, property, CDB_TYPE_REF, &v);
 }
 
 void set_subobject(ce_cdb_obj_o *_writer,
@@ -973,27 +2448,12 @@ void set_subobject(ce_cdb_obj_o *_writer,
                    uint64_t subobject) {
     struct object_t *writer = _get_object_from_obj_o(_writer);
 
-    uint64_t idx = _find_prop_index(writer, property);
-    if (!idx) {
-        idx = _object_new_property(writer, property,
-                                   CDB_TYPE_SUBOBJECT, &subobject,
-                                   sizeof(uint64_t),
-                                   _G.allocator);
-    }
-
-    ce_array_push(writer->changed_prop, property, _G.allocator);
-
-    union type_u *value_ptr = (union type_u *) (writer->values +
-                                                writer->offset[idx]);
-    value_ptr->subobj = subobject;
+    union type_u v = {.subobj = subobject};
+    _writer_set(_writer, property, CDB_TYPE_SUBOBJECT, &v);
 
     if (subobject) {
-        ce_cdb_obj_o *w = ce_cdb_a0->write_begin(subobject);
-        struct object_t *subobj = _get_object_from_obj_o(w);
-        subobj->parent = writer->obj;
-        ce_cdb_a0->write_commit(w);
+        _get_slot(subobject)->parent = writer->obj;
     }
-
 }
 
 void set_blob(ce_cdb_obj_o *_writer,
@@ -1008,42 +2468,86 @@ void set_blob(ce_cdb_obj_o *_writer,
 
     memcpy(new_blob, blob_data, blob_size);
 
-    struct blob_t blob = {
-            .size = blob_size,
-            .data = new_blob,
+    ce_array_push(writer->owned, new_blob, a);
+
+    union type_u v = {
+            .blob = {
+                    .size = blob_size,
+                    .data = new_blob,
+            }
     };
 
+    _writer_set(_writer, property, CDB_TYPE_BLOB, &v);
+}
 
-    uint64_t idx = _find_prop_index(writer, property);
-    if (!idx) {
-        idx = _object_new_property(writer, property,
-                                   CDB_TYPE_BLOB,
-                                   &blob, sizeof(struct blob_t),
-                                   _G.allocator);
-    } else {
-        union type_u *value_ptr = (union type_u *) (writer->values +
-                                                    writer->offset[idx]);
-        CE_FREE(a, value_ptr->blob.data);
+void set_prefab(uint64_t _obj,
+                uint64_t _prefab) {
+    struct object_slot_t *slot = _get_slot(_obj);
+    struct object_slot_t *prefab_slot = _get_slot(_prefab);
+
+    slot->prefab = _prefab;
+
+    _slot_lock(prefab_slot);
+    ce_array_push(prefab_slot->instances,
+                  _obj,
+                  _G.allocator);
+    _slot_unlock(prefab_slot);
+
+    _invalidate_flat(slot);
+}
+
+static void move_instances(uint64_t _obj,
+                           uint64_t _new_prefab) {
+    struct object_slot_t *slot = _get_slot(_obj);
+    struct object_slot_t *prefab_slot = _get_slot(_new_prefab);
+
+    uint64_t *instances = NULL;
+    _slot_listeners(slot, NULL, &instances);
+
+    const uint32_t instances_n = ce_array_size(instances);
+    if (!instances_n) {
+        return;
     }
 
-    ce_array_push(writer->changed_prop, property, _G.allocator);
+    const struct object_t *old = _get_resolved(_obj);
+    const struct object_layout_t *new_layout;
+    new_layout = _get_resolved(_new_prefab)->layout;
 
+    uint64_t *changed_prop = NULL;
+    ce_array_push_n(changed_prop, old->layout->keys + 1,
+                    old->layout->properties_count - 1, _G.allocator);
 
-    union type_u *value_ptr = (union type_u *) (writer->values +
-                                                writer->offset[idx]);
+    for (uint64_t i = 1; i < new_layout->properties_count; ++i) {
+        if (!_find_prop_index(old, new_layout->keys[i])) {
+            ce_array_push(changed_prop, new_layout->keys[i], _G.allocator);
+        }
+    }
 
-    value_ptr->blob = blob;
-}
+    // Instances created meanwhile stay on old prefab.
+    _slot_lock(slot);
+    for (uint32_t i = 0; i < instances_n; ++i) {
+        for (uint32_t k = 0; k < ce_array_size(slot->instances); ++k) {
+            if (slot->instances[k] == instances[i]) {
+                slot->instances[k] = ce_array_back(slot->instances);
+                ce_array_pop_back(slot->instances);
+                break;
+            }
+        }
+    }
+    _slot_unlock(slot);
 
-void set_prefab(uint64_t _obj,
-                uint64_t _prefab) {
-    struct object_t *obj = _get_object_from_objid(_obj);
-    struct object_t *prefab = _get_object_from_objid(_prefab);
+    _slot_lock(prefab_slot);
+    ce_array_push_n(prefab_slot->instances, instances, instances_n,
+                    _G.allocator);
+    _slot_unlock(prefab_slot);
 
-    obj->prefab = _prefab;
-    ce_array_push(prefab->instances,
-                  _obj,
-                  _G.allocator);
+    for (uint32_t i = 0; i < instances_n; ++i) {
+        _get_slot(instances[i])->prefab = _new_prefab;
+        _notify(instances[i], changed_prop);
+    }
+
+    ce_array_free(instances, _G.allocator);
+    ce_array_free(changed_prop, _G.allocator);
 }
 
 static bool prop_exist(uint64_t _object,
@@ -1054,32 +2558,20 @@ static bool prop_exist(uint64_t _object,
 
 static enum ce_cdb_type prop_type(uint64_t _object,
                                   uint64_t key) {
-    struct object_t *obj = _get_object_from_objid(_object);
+    struct object_t *obj = _get_resolved(_object);
     uint64_t idx = _find_prop_index(obj, key);
 
-    if (idx) {
-        return (enum ce_cdb_type) obj->property_type[idx];
-    }
-
-    if (obj->prefab) {
-        return prop_type(obj->prefab, key);
-    }
-
-    return CDB_TYPE_NONE;
+    return (enum ce_cdb_type) obj->layout->property_type[idx];
 }
 
 static float read_float(uint64_t _obj,
                         uint64_t property,
                         float defaultt) {
-    struct object_t *obj = _get_object_from_objid(_obj);
+    struct object_t *obj = _get_resolved(_obj);
     uint64_t idx = _find_prop_index(obj, property);
 
     if (idx) {
-        return *(float *) (obj->values + obj->offset[idx]);
-    }
-
-    if (obj->prefab) {
-        return read_float(obj->prefab, property, defaultt);
+        return _value_ptr(obj, idx)->f;
     }
 
     return defaultt;
@@ -1088,15 +2580,11 @@ static float read_float(uint64_t _obj,
 static bool read_bool(uint64_t _obj,
                       uint64_t property,
                       bool defaultt) {
-    struct object_t *obj = _get_object_from_objid(_obj);
+    struct object_t *obj = _get_resolved(_obj);
     uint64_t idx = _find_prop_index(obj, property);
 
     if (idx) {
-        return *(bool *) (obj->values + obj->offset[idx]);
-    }
-
-    if (obj->prefab) {
-        return read_bool(obj->prefab, property, defaultt);
+        return _value_ptr(obj, idx)->b;
     }
 
     return defaultt;
@@ -1105,73 +2593,51 @@ static bool read_bool(uint64_t _obj,
 static void read_vec3(uint64_t _obj,
                       uint64_t property,
                       float *value) {
-    struct object_t *obj = _get_object_from_objid(_obj);
+    struct object_t *obj = _get_resolved(_obj);
     uint64_t idx = _find_prop_index(obj, property);
 
 
     if (idx) {
-        const float *f = (const float *) (obj->values + obj->offset[idx]);
-        memcpy(value, f, sizeof(float) * 3);
-
+        memcpy(value, _value_ptr(obj, idx)->vec3, sizeof(float) * 3);
         return;
     }
-
-    if (obj->prefab) {
-        read_vec3(obj->prefab, property, value);
-    }
 }
 
 static void read_vec4(uint64_t _obj,
                       uint64_t property,
                       float *value) {
-    struct object_t *obj = _get_object_from_objid(_obj);
+    struct object_t *obj = _get_resolved(_obj);
     uint64_t idx = _find_prop_index(obj, property);
 
 
     if (idx) {
-        const float *f = (const float *) (obj->values + obj->offset[idx]);
-        memcpy(value, f, sizeof(float) * 4);
-
+        memcpy(value, _value_ptr(obj, idx)->vec4, sizeof(float) * 4);
         return;
     }
-
-    if (obj->prefab) {
-        read_vec4(obj->prefab, property, value);
-    }
 }
 
 static void read_mat4(uint64_t _obj,
                       uint64_t property,
                       float *value) {
-    struct object_t *obj = _get_object_from_objid(_obj);
+    struct object_t *obj = _get_resolved(_obj);
     uint64_t idx = _find_prop_index(obj, property);
 
 
     if (idx) {
-        const float *f = (const float *) (obj->values + obj->offset[idx]);
-        memcpy(value, f, sizeof(float) * 16);
-
+        memcpy(value, _value_ptr(obj, idx)->mat4, sizeof(float) * 16);
         return;
     }
 
-    if (obj->prefab) {
-        read_mat4(obj->prefab, property, value);
-    }
-
 }
 
 static const char *read_string(uint64_t _obj,
                                uint64_t property,
                                const char *defaultt) {
-    struct object_t *obj = _get_object_from_objid(_obj);
+    struct object_t *obj = _get_resolved(_obj);
     uint64_t idx = _find_prop_index(obj, property);
 
     if (idx) {
-        return *(const char **) (obj->values + obj->offset[idx]);
-    }
-
-    if (obj->prefab) {
-        return read_string(obj->prefab, property, defaultt);
+        return _value_ptr(obj, idx)->str;
     }
 
     return defaultt;
@@ -1181,15 +2647,11 @@ static const char *read_string(uint64_t _obj,
 static uint64_t read_uint64(uint64_t _obj,
                             uint64_t property,
                             uint64_t defaultt) {
-    struct object_t *obj = _get_object_from_objid(_obj);
+    struct object_t *obj = _get_resolved(_obj);
     uint64_t idx = _find_prop_index(obj, property);
 
     if (idx) {
-        return *(uint64_t *) (obj->values + obj->offset[idx]);
-    }
-
-    if (obj->prefab) {
-        return read_uint64(obj->prefab, property, defaultt);
+        return _value_ptr(obj, idx)->uint64;
     }
 
     return defaultt;
@@ -1198,15 +2660,11 @@ static uint64_t read_uint64(uint64_t _obj,
 static void *read_ptr(uint64_t _obj,
                       uint64_t property,
                       void *defaultt) {
-    struct object_t *obj = _get_object_from_objid(_obj);
+    struct object_t *obj = _get_resolved(_obj);
     uint64_t idx = _find_prop_index(obj, property);
 
     if (idx) {
-        return *(void **) (obj->values + obj->offset[idx]);
-    }
-
-    if (obj->prefab) {
-        return read_ptr(obj->prefab, property, defaultt);
+        return _value_ptr(obj, idx)->ptr;
     }
 
     return defaultt;
@@ -1215,15 +2673,11 @@ static void *read_ptr(uint64_t _obj,
 static uint64_t read_ref(uint64_t _obj,
                          uint64_t property,
                          uint64_t defaultt) {
-    struct object_t *obj = _get_object_from_objid(_obj);
+    struct object_t *obj = _get_resolved(_obj);
     uint64_t idx = _find_prop_index(obj, property);
 
     if (idx) {
-        return *(uint64_t *) (obj->values + obj->offset[idx]);
-    }
-
-    if (obj->prefab) {
-        return read_ref(obj->prefab, property, defaultt);
+        return _value_ptr(obj, idx)->ref;
     }
 
     return defaultt;
@@ -1232,15 +2686,11 @@ static uint64_t read_ref(uint64_t _obj,
 static uint64_t read_subobject(uint64_t _obj,
                                uint64_t property,
                                uint64_t defaultt) {
-    struct object_t *obj = _get_object_from_objid(_obj);
+    struct object_t *obj = _get_resolved(_obj);
     uint64_t idx = _find_prop_index(obj, property);
 
     if (idx) {
-        return *(uint64_t *) (obj->values + obj->offset[idx]);
-    }
-
-    if (obj->prefab) {
-        return read_subobject(obj->prefab, property, defaultt);
+        return _value_ptr(obj, idx)->subobj;
     }
 
     return defaultt;
@@ -1251,13 +2701,11 @@ void *read_blob(uint64_t _obj,
                 uint64_t *size,
                 void *defaultt) {
 
-    struct object_t *obj = _get_object_from_objid(_obj);
+    struct object_t *obj = _get_resolved(_obj);
     uint64_t idx = _find_prop_index(obj, property);
 
     if (idx) {
-        void *data = (obj->values + obj->offset[idx]);
-
-        struct blob_t *blob = data;
+        struct blob_t *blob = &_value_ptr(obj, idx)->blob;
 
         if (size) {
             *size = blob->size;
@@ -1266,79 +2714,379 @@ void *read_blob(uint64_t _obj,
         return blob->data;
     }
 
-    if (obj->prefab) {
-        return read_blob(obj->prefab, property, size, defaultt);
-    }
-
     return defaultt;
 }
 
-static uint64_t prop_count(uint64_t _obj);
-
 static void prop_keys(uint64_t _obj,
                       uint64_t *keys) {
-    struct object_t *obj = _get_object_from_objid(_obj);
+    const struct object_layout_t *layout = _get_resolved(_obj)->layout;
+
+    memcpy(keys, layout->keys + 1,
+           sizeof(uint64_t) * (layout->properties_count - 1));
+}
+
+static uint64_t prop_count(uint64_t _obj) {
+    return _get_resolved(_obj)->layout->properties_count - 1;
+}
+
+static struct ce_cdb_prop_h prop_handle(uint64_t key) {
+    ce_os_a0->thread->spin_lock(&_G.prop_handle_lock);
+
+    uint64_t idx = ce_hash_lookup(&_G.prop_handle_map, key, UINT64_MAX);
+    if (UINT64_MAX == idx) {
+        CE_ASSERT(LOG_WHERE, _G.prop_handles_n < MAX_PROP_HANDLES);
+
+        idx = _G.prop_handles_n++;
+
+        _G.prop_handles[idx] = (struct prop_handle_t) {
+                .key = key,
+        };
+
+        ce_hash_add(&_G.prop_handle_map, key, idx, _G.allocator);
+    }
+
+    ce_os_a0->thread->spin_unlock(&_G.prop_handle_lock);
+
+    return (struct ce_cdb_prop_h) {.h = idx + 1};
+}
+
+// Value of property or NULL, offset is cached in handle slot of layout.
+static union type_u *_handle_value(uint64_t _obj,
+                                   struct ce_cdb_prop_h prop) {
+    CE_ASSERT(LOG_WHERE, prop.h);
+
+    struct prop_handle_t *handle = &_G.prop_handles[prop.h - 1];
+
+    struct object_t *obj = _get_resolved(_obj);
+    const struct object_layout_t *layout = obj->layout;
 
-    if (obj->prefab) {
-        memcpy(keys, obj->keys + 1,
-               sizeof(uint64_t) * (obj->properties_count - 1));
+    atomic_ullong *slot = &handle->cache[layout->id % PROP_HANDLE_CACHE];
+    uint64_t cache = atomic_load_explicit(slot, memory_order_relaxed);
 
-        keys += (obj->properties_count - 1);
+    uint64_t offset;
+    if ((cache >> 32) == layout->id) {
+        offset = (uint32_t) cache;
+    } else {
+        uint64_t idx = ce_hash_lookup(&layout->prop_map, handle->key, 0);
+        offset = idx ? layout->offset[idx] + 1 : 0;
+
+        atomic_store_explicit(slot, ((uint64_t) layout->id << 32) | offset,
+                              memory_order_relaxed);
+    }
+
+    if (!offset) {
+        return NULL;
+    }
+
+    return (union type_u *) (obj->values + offset - 1);
+}
+
+static uint64_t read_uint64_h(uint64_t object,
+                              struct ce_cdb_prop_h prop,
+                              uint64_t defaultt) {
+    union type_u *value = _handle_value(object, prop);
+    return value ? value->uint64 : defaultt;
+}
+
+static uint64_t read_ref_h(uint64_t object,
+                           struct ce_cdb_prop_h prop,
+                           uint64_t defaultt) {
+    union type_u *value = _handle_value(object, prop);
+    return value ? value->ref : defaultt;
+}
+
+static uint64_t read_subobject_h(uint64_t object,
+                                 struct ce_cdb_prop_h prop,
+                                 uint64_t defaultt) {
+    union type_u *value = _handle_value(object, prop);
+    return value ? value->subobj : defaultt;
+}
+
+static float read_float_h(uint64_t object,
+                          struct ce_cdb_prop_h prop,
+                          float defaultt) {
+    union type_u *value = _handle_value(object, prop);
+    return value ? value->f : defaultt;
+}
+
+static void read_vec4_h(uint64_t object,
+                        struct ce_cdb_prop_h prop,
+                        float *v) {
+    union type_u *value = _handle_value(object, prop);
+
+    if (value) {
+        memcpy(v, value->vec4, sizeof(float) * 4);
+    }
+}
+
+static const char *read_str_h(uint64_t object,
+                              struct ce_cdb_prop_h prop,
+                              const char *defaultt) {
+    union type_u *value = _handle_value(object, prop);
+    return value ? value->str : defaultt;
+}
+
+static struct snapshot_t *_find_snapshot(struct db_t *db_inst,
+                                        uint64_t snapshot,
+                                        uint32_t *idx) {
+    const uint32_t snapshots_n = ce_array_size(db_inst->snapshots);
+    for (uint32_t i = 0; i < snapshots_n; ++i) {
+        if (db_inst->snapshots[i].commit == snapshot) {
+            *idx = i;
+            return &db_inst->snapshots[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Snapshot share all versions with db, it cost only versions replaced
+// after it.
+static uint64_t snapshot(struct ce_cdb_t db) {
+    struct db_t *db_inst = &_G.dbs[db.idx];
+
+    ce_os_a0->thread->spin_lock(&db_inst->snapshot_lock);
+
+    const uint64_t commit = atomic_load(&db_inst->commit_n);
+    const uint32_t snapshots_n = ce_array_size(db_inst->snapshots);
+
+    if (snapshots_n && (db_inst->snapshots[snapshots_n - 1].commit == commit)) {
+        db_inst->snapshots[snapshots_n - 1].refs += 1;
+    } else {
+        struct snapshot_t new_snapshot = {
+                .commit = commit,
+                .refs = 1,
+        };
 
-        uint32_t prefab_prop_count = prop_count(obj->prefab);
+        ce_array_push(db_inst->snapshots, new_snapshot, _G.allocator);
+        atomic_fetch_add(&db_inst->snapshots_n, 1);
+    }
+
+    ce_os_a0->thread->spin_unlock(&db_inst->snapshot_lock);
+
+    return commit;
+}
+
+static void release_snapshot(struct ce_cdb_t db,
+                             uint64_t snapshot) {
+    struct db_t *db_inst = &_G.dbs[db.idx];
+
+    ce_os_a0->thread->spin_lock(&db_inst->snapshot_lock);
+
+    uint32_t idx;
+    struct snapshot_t *s = _find_snapshot(db_inst, snapshot, &idx);
+    if (!s || --s->refs) {
+        ce_os_a0->thread->spin_unlock(&db_inst->snapshot_lock);
+        return;
+    }
+
+    const uint32_t entries_n = ce_array_size(s->entries);
 
-        uint64_t prefab_keys[prefab_prop_count];
-        prop_keys(obj->prefab, prefab_keys);
+    // Older snapshot see same versions for objects not changed since it.
+    if (idx) {
+        struct snapshot_t *older = &db_inst->snapshots[idx - 1];
+
+        for (uint32_t i = 0; i < entries_n; ++i) {
+            struct snapshot_entry_t *entry = &s->entries[i];
 
-        for (int i = 0; i < prefab_prop_count; ++i) {
-            if (ce_hash_contain(&obj->prop_map, prefab_keys[i])) {
+            if (ce_hash_contain(&older->recorded, entry->obj)) {
+                _version_release(_get_object(db.idx, entry->version));
                 continue;
             }
 
-            keys[i] = prefab_keys[i];
+            ce_array_push(older->entries, *entry, _G.allocator);
+            ce_hash_add(&older->recorded, entry->obj, 1, _G.allocator);
+        }
+
+        ce_array_push_n(older->garbage, s->garbage, ce_array_size(s->garbage),
+                        _G.allocator);
+    } else {
+        for (uint32_t i = 0; i < entries_n; ++i) {
+            _version_release(_get_object(db.idx, s->entries[i].version));
+        }
+
+        _writer_free_values(s->garbage);
+    }
+
+    ce_array_free(s->entries, _G.allocator);
+    ce_array_free(s->garbage, _G.allocator);
+    ce_hash_free(&s->recorded, _G.allocator);
+
+    const uint32_t snapshots_n = ce_array_size(db_inst->snapshots);
+    memmove(s, s + 1, sizeof(struct snapshot_t) * (snapshots_n - idx - 1));
+    ce_array_pop_back(db_inst->snapshots);
+
+    if (1 == atomic_fetch_sub(&db_inst->snapshots_n, 1)) {
+        const uint32_t held_n = ce_array_size(db_inst->held_slots);
+        for (uint32_t i = 0; i < held_n; ++i) {
+            _idx_push(&db_inst->retired_slots, &db_inst->slots,
+                      db_inst->held_slots[i]);
         }
 
+        ce_array_clean(db_inst->held_slots);
+    }
+
+    ce_os_a0->thread->spin_unlock(&db_inst->snapshot_lock);
+}
+
+// Publish copy of version as new version of object.
+static void _restore_version(struct db_t *db_inst,
+                             uint64_t _obj,
+                             struct object_t *version) {
+    struct object_slot_t *slot = _get_slot(_obj);
+    if (slot->destroyed) {
         return;
     }
 
-    memcpy(keys, obj->keys + 1, sizeof(uint64_t) * (obj->properties_count - 1));
+    struct object_t *writer = _object_clone(db_inst, version, _G.allocator);
+    writer->db.idx = db_inst->idx;
+    writer->obj = _obj;
+
+    // Snapshot keep own strings and blobs, restored version need copy.
+    const struct object_layout_t *layout = writer->layout;
+    for (int i = 1; i < layout->properties_count; ++i) {
+        union type_u *value = _value_ptr(writer, i);
+
+        ce_array_push(writer->changed_prop, layout->keys[i], _G.allocator);
+
+        switch (layout->property_type[i]) {
+            case CDB_TYPE_STR:
+                value->str = ce_memory_a0->str_dup(value->str, _G.allocator);
+                break;
+
+            case CDB_TYPE_BLOB: {
+                void *data = CE_ALLOC(_G.allocator, char, value->blob.size);
+                memcpy(data, value->blob.data, value->blob.size);
+                value->blob.data = data;
+            }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    atomic_store(&writer->hold, 1);
+
+    uint64_t prev_idx = atomic_exchange(&slot->version, writer->idx);
+    struct object_t *prev = _get_object(db_inst->idx, prev_idx);
+
+    const struct object_layout_t *prev_layout = prev->layout;
+    for (int i = 1; i < prev_layout->properties_count; ++i) {
+        const union type_u *value = _value_ptr(prev, i);
+
+        switch (prev_layout->property_type[i]) {
+            case CDB_TYPE_STR:
+                _replace_value(writer, value->str, _G.allocator);
+                break;
+
+            case CDB_TYPE_BLOB:
+                _replace_value(writer, value->blob.data, _G.allocator);
+                break;
+
+            default:
+                break;
+        }
+
+        if (!_find_prop_index(writer, prev_layout->keys[i])) {
+            ce_array_push(writer->changed_prop, prev_layout->keys[i],
+                          _G.allocator);
+        }
+    }
+
+    _commit_done(writer, prev);
 }
 
-static uint64_t prop_count(uint64_t _obj) {
-    struct object_t *obj = _get_object_from_objid(_obj);
+// Restore objects changed after snapshot, restore is commit so it can be
+// restored back by newer snapshot.
+static void restore_snapshot(struct ce_cdb_t db,
+                             uint64_t snapshot) {
+    struct db_t *db_inst = &_G.dbs[db.idx];
+
+    ce_os_a0->thread->spin_lock(&db_inst->snapshot_lock);
+
+    uint32_t idx;
+    if (!_find_snapshot(db_inst, snapshot, &idx)) {
+        ce_os_a0->thread->spin_unlock(&db_inst->snapshot_lock);
+        return;
+    }
 
-    uint64_t count = obj->properties_count - 1;
+    // First change after snapshot win.
+    struct ce_hash_t restore_map = {};
+    struct snapshot_entry_t *restore = NULL;
 
-    if (obj->prefab) {
-        uint32_t prefab_prop_count = prop_count(obj->prefab);
+    const uint32_t snapshots_n = ce_array_size(db_inst->snapshots);
+    for (uint32_t i = snapshots_n; i > idx; --i) {
+        struct snapshot_t *s = &db_inst->snapshots[i - 1];
 
-        uint64_t keys[prefab_prop_count];
-        prop_keys(obj->prefab, keys);
+        const uint32_t entries_n = ce_array_size(s->entries);
+        for (uint32_t j = 0; j < entries_n; ++j) {
+            struct snapshot_entry_t *entry = &s->entries[j];
 
-        for (int i = 0; i < prefab_prop_count; ++i) {
-            if (ce_hash_contain(&obj->prop_map, keys[i])) {
+            uint64_t restore_idx = ce_hash_lookup(&restore_map, entry->obj,
+                                                  UINT64_MAX);
+            if (UINT64_MAX != restore_idx) {
+                restore[restore_idx] = *entry;
                 continue;
             }
 
-            count += 1;
+            ce_hash_add(&restore_map, entry->obj, ce_array_size(restore),
+                        _G.allocator);
+            ce_array_push(restore, *entry, _G.allocator);
         }
+    }
 
+    const uint32_t restore_n = ce_array_size(restore);
+    for (uint32_t i = 0; i < restore_n; ++i) {
+        atomic_fetch_add(&_get_object(db.idx, restore[i].version)->hold, 1);
     }
 
-    return count;
+    ce_os_a0->thread->spin_unlock(&db_inst->snapshot_lock);
+
+    for (uint32_t i = 0; i < restore_n; ++i) {
+        struct object_t *version = _get_object(db.idx, restore[i].version);
+
+        _restore_version(db_inst, restore[i].obj, version);
+        _version_release(version);
+    }
+
+    ce_array_free(restore, _G.allocator);
+    ce_hash_free(&restore_map, _G.allocator);
+}
+
+static uint64_t commit_counter(struct ce_cdb_t db) {
+    return atomic_load(&_G.dbs[db.idx].commit_n);
 }
 
 void register_notify(uint64_t _obj,
                      ce_cdb_notify notify,
                      void *data) {
-    struct object_t *obj = _get_object_from_objid(_obj);
+    struct object_slot_t *slot = _get_slot(_obj);
 
     struct notify_pair pair = {
             .notify = notify,
             .data = data
     };
 
-    ce_array_push(obj->notify, pair, _G.allocator);
+    _slot_lock(slot);
+    ce_array_push(slot->notify, pair, _G.allocator);
+    _slot_unlock(slot);
+}
+
+void register_notify_deferred(uint64_t _obj,
+                              ce_cdb_notify notify,
+                              void *data) {
+    struct object_slot_t *slot = _get_slot(_obj);
+
+    struct notify_pair pair = {
+            .notify = notify,
+            .data = data,
+            .deferred = true,
+    };
+
+    _slot_lock(slot);
+    ce_array_push(slot->notify, pair, _G.allocator);
+    _slot_unlock(slot);
 }
 
 
@@ -1347,31 +3095,36 @@ static struct ce_cdb_t global_db() {
 }
 
 static uint64_t type(uint64_t _obj) {
-    struct object_t *obj = _get_object_from_objid(_obj);
-
-    return obj->type;
+    return _get_slot(_obj)->type;
 }
 
 void set_type(uint64_t _obj,
               uint64_t type) {
-    struct object_t *obj = _get_object_from_objid(_obj);
-    obj->type = type;
+    _get_slot(_obj)->type = type;
 }
 
 uint64_t parent(uint64_t object) {
-    struct object_t *obj = _get_object_from_objid(object);
-    return obj->parent;
+    return _get_slot(object)->parent;
 }
 
 static struct ce_cdb_a0 cdb_api = {
         .register_notify = register_notify,
-//        .create_db = create_db,
+
+        .commit_counter = commit_counter,
+        .snapshot = snapshot,
+        .release_snapshot = release_snapshot,
+        .restore_snapshot = restore_snapshot,
+        .register_notify_deferred = register_notify_deferred,
+        .flush_notify = flush_notify,
+        .create_db = create_db,
+        .db_stats = db_stats,
 
         . db  = global_db,
 
         .type = type,
         .set_type = set_type,
         .create_object = create_object,
+        .obj_index = obj_index,
         .create_from = create_from,
         .destroy_object = destroy_object,
         .destroy_db = destroy_db,
@@ -1379,7 +3132,9 @@ static struct ce_cdb_a0 cdb_api = {
         .gc = gc,
 
         .dump = dump,
+        .dump_compressed = dump_compressed,
         .load = load,
+        .load_mapped = load_mapped,
 
         .prop_exist = prop_exist,
         .prop_type = prop_type,
@@ -1399,7 +3154,16 @@ static struct ce_cdb_a0 cdb_api = {
         .read_subobject = read_subobject,
         .read_blob = read_blob,
 
+        .prop_handle = prop_handle,
+        .read_uint64_h = read_uint64_h,
+        .read_ref_h = read_ref_h,
+        .read_subobject_h = read_subobject_h,
+        .read_float_h = read_float_h,
+        .read_vec4_h = read_vec4_h,
+        .read_str_h = read_str_h,
+
         .write_begin = write_begin,
+        .write_begin_clone = write_begin_clone,
         .write_commit = write_commit,
         .write_try_commit = write_try_commit,
 
@@ -1414,6 +3178,7 @@ static struct ce_cdb_a0 cdb_api = {
         .set_ref = set_ref,
         .set_subobject = set_subobject,
         .set_prefab = set_prefab,
+        .move_instances = move_instances,
         .set_blob = set_blob,
 };
 
@@ -1424,12 +3189,48 @@ static void _init(struct ce_api_a0 *api) {
             .allocator = ce_memory_a0->system,
     };
 
-    _G.global_db = create_db();
+    _layout_init(&_G.empty_layout, _G.allocator);
+    atomic_init(&_G.layout_id, 1);
+
+    _G.global_db = create_db(DEFAULT_MAX_OBJECTS);
 
     api->register_api("ce_cdb_a0", &cdb_api);
 }
 
 static void _shutdown() {
+    for (uint32_t i = 0; i < _G.dbs_n; ++i) {
+        if (_G.dbs[i].used) {
+            _free_db(&_G.dbs[i]);
+        }
+    }
+
+    ce_array_free(_G.free_db, _G.allocator);
+    ce_array_free(_G.to_free_db, _G.allocator);
+    ce_array_free(_G.borrowed, _G.allocator);
+
+    // Layouts still in map are used only by map.
+    for (uint32_t i = 0; i < _G.layout_map.n; ++i) {
+        if (EMPTY_SLOT != _G.layout_map.keys[i]) {
+            _layout_free((struct object_layout_t *) _G.layout_map.values[i],
+                         _G.allocator);
+        }
+    }
+
+    ce_hash_free(&_G.layout_map, _G.allocator);
+    ce_hash_free(&_G.prop_handle_map, _G.allocator);
+
+    ce_array_free(_G.empty_layout.keys, _G.allocator);
+    ce_array_free(_G.empty_layout.property_type, _G.allocator);
+    ce_array_free(_G.empty_layout.offset, _G.allocator);
+    ce_hash_free(&_G.empty_layout.prop_map, _G.allocator);
+
+    for (uint32_t i = 0; i < ce_array_size(_G.notify_queue); ++i) {
+        ce_array_free(_G.notify_queue[i].props, _G.allocator);
+    }
+
+    ce_array_free(_G.notify_queue, _G.allocator);
+    ce_hash_free(&_G.notify_queue_map, _G.allocator);
+
     _G = (struct _G) {0};
 }
 
@@ -1447,4 +3248,4 @@ CE_MODULE_DEF(
             CE_UNUSED(api);
             _shutdown();
         }
-)
\ No newline at end of file
+)
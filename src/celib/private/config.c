@@ -246,6 +246,4 @@ void CE_MODULE_UNLOAD (config)(struct ce_api_a0 *api,
                                     int reload) {
     CE_UNUSED(api, reload);
     ce_log_a0->debug(LOG_WHERE, "Shutdown");
-
-    ce_cdb_a0->destroy_db(_G.db);
 }
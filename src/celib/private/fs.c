@@ -2,7 +2,15 @@
 // Includes
 //==============================================================================
 
+#include <celib/platform.h>
+
 #include <stdlib.h>
+#include <stdio.h>
+
+#if CE_PLATFORM_LINUX
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
 
 #include <celib/api_system.h>
 #include <celib/os.h>
@@ -22,6 +30,8 @@
 #define MAX_PATH_LEN 128
 #define MAX_ROOTS 32
 
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)
+
 //==============================================================================
 // Global
 //==============================================================================
@@ -29,16 +39,29 @@
 
 struct fs_mount_point {
     char *root_path;
-//    struct ce_watchdog_a0 *wd;
 };
 
 struct fs_root {
     struct fs_mount_point *mount_points;
+
+    // Changed files relative to mount point, not taken by changed_files yet.
+    char **changed;
+};
+
+struct fs_watch {
+    uint64_t root;
+    uint32_t mount_len;
+    char *dir;
 };
 
 static struct _G {
     struct ce_hash_t root_map;
     struct fs_root *roots;
+
+    int watch_fd;
+    struct ce_hash_t watch_map;
+    struct fs_watch *watches;
+
     struct ce_alloc *allocator;
 } _G;
 
@@ -94,6 +117,206 @@ static uint32_t new_fs_mount(uint64_t root,
 }
 
 
+//==============================================================================
+// Watch
+//==============================================================================
+
+#if CE_PLATFORM_LINUX
+
+static void _watch_dir(uint64_t root,
+                       uint32_t mount_len,
+                       const char *dir) {
+    int wd = inotify_add_watch(_G.watch_fd, dir, WATCH_EVENTS);
+    if (wd < 0) {
+        ce_log_a0->warning(LOG_WHERE, "Could not watch dir %s", dir);
+        return;
+    }
+
+    if (ce_hash_contain(&_G.watch_map, wd)) {
+        return;
+    }
+
+    // Listed dirs end with "/".
+    char *watch_dir = ce_memory_a0->str_dup(dir, _G.allocator);
+    const size_t len = strlen(watch_dir);
+    if (len && (watch_dir[len - 1] == '/')) {
+        watch_dir[len - 1] = '\0';
+    }
+
+    struct fs_watch watch = {
+            .root = root,
+            .mount_len = mount_len,
+            .dir = watch_dir,
+    };
+
+    ce_hash_add(&_G.watch_map, wd, ce_array_size(_G.watches), _G.allocator);
+    ce_array_push(_G.watches, watch, _G.allocator);
+}
+
+static void _watch_tree(uint64_t root,
+                        uint32_t mount_len,
+                        const char *dir) {
+    if (_G.watch_fd < 0) {
+        return;
+    }
+
+    _watch_dir(root, mount_len, dir);
+
+    char **dirs;
+    uint32_t dirs_n;
+    ce_os_a0->path->list(dir, (const char *[]) {"*"}, 1, true, true,
+                         &dirs, &dirs_n, _G.allocator);
+
+    for (uint32_t i = 0; i < dirs_n; ++i) {
+        _watch_dir(root, mount_len, dirs[i]);
+    }
+
+    ce_os_a0->path->list_free(dirs, dirs_n, _G.allocator);
+}
+
+static void _push_changed(uint64_t root,
+                          uint32_t mount_len,
+                          const char *path) {
+    struct fs_root *fs_inst = get_fs_root(root);
+
+    const char *rel = path + mount_len;
+    while (*rel == '/') {
+        ++rel;
+    }
+
+    ce_array_push(fs_inst->changed, strdup(rel), _G.allocator);
+}
+
+static void _fetch_events() {
+    if (_G.watch_fd < 0) {
+        return;
+    }
+
+    char buffer[16 * 1024]
+            __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    while (true) {
+        ssize_t len = read(_G.watch_fd, buffer, sizeof(buffer));
+        if (len <= 0) {
+            break;
+        }
+
+        for (char *ptr = buffer; ptr < buffer + len;) {
+            const struct inotify_event *ev = (struct inotify_event *) ptr;
+            ptr += sizeof(struct inotify_event) + ev->len;
+
+            if (!ev->len) {
+                continue;
+            }
+
+            uint64_t idx = ce_hash_lookup(&_G.watch_map, ev->wd, UINT64_MAX);
+            if (UINT64_MAX == idx) {
+                continue;
+            }
+
+            struct fs_watch *watch = &_G.watches[idx];
+
+            if (ev->mask & IN_ISDIR) {
+                char *dir = NULL;
+                ce_buffer_printf(&dir, _G.allocator, "%s/%s",
+                                 watch->dir, ev->name);
+
+                _watch_tree(watch->root, watch->mount_len, dir);
+
+                // Files written before watch was added.
+                char **files;
+                uint32_t files_n;
+                ce_os_a0->path->list(dir, (const char *[]) {"*"}, 1, true,
+                                     false, &files, &files_n, _G.allocator);
+
+                for (uint32_t i = 0; i < files_n; ++i) {
+                    _push_changed(watch->root, watch->mount_len, files[i]);
+                }
+
+                ce_os_a0->path->list_free(files, files_n, _G.allocator);
+                ce_buffer_free(dir, _G.allocator);
+                continue;
+            }
+
+            // File is reported after it is written.
+            if (ev->mask & IN_CREATE) {
+                continue;
+            }
+
+            char *path = NULL;
+            ce_buffer_printf(&path, _G.allocator, "%s/%s", watch->dir,
+                             ev->name);
+
+            _push_changed(watch->root, watch->mount_len, path);
+
+            ce_buffer_free(path, _G.allocator);
+        }
+    }
+}
+
+static void _watch_init() {
+    _G.watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (_G.watch_fd < 0) {
+        ce_log_a0->warning(LOG_WHERE, "Could not init inotify");
+    }
+}
+
+static void _watch_shutdown() {
+    if (_G.watch_fd >= 0) {
+        close(_G.watch_fd);
+    }
+}
+
+#else
+
+static void _watch_tree(uint64_t root,
+                        uint32_t mount_len,
+                        const char *dir) {
+    CE_UNUSED(root, mount_len, dir);
+}
+
+static void _fetch_events() {
+}
+
+static void _watch_init() {
+    _G.watch_fd = -1;
+}
+
+static void _watch_shutdown() {
+}
+
+#endif
+
+static void changed_files(uint64_t root,
+                          char ***files,
+                          uint32_t *count,
+                          struct ce_alloc *allocator) {
+    _fetch_events();
+
+    *files = NULL;
+    *count = 0;
+
+    struct fs_root *fs_inst = get_fs_root(root);
+    if (!fs_inst) {
+        return;
+    }
+
+    const uint32_t changed_n = ce_array_size(fs_inst->changed);
+    if (!changed_n) {
+        return;
+    }
+
+    char **result_files = CE_ALLOC(allocator, char*,
+                                   sizeof(char *) * changed_n);
+
+    memcpy(result_files, fs_inst->changed, sizeof(char *) * changed_n);
+    ce_array_clean(fs_inst->changed);
+
+    *files = result_files;
+    *count = changed_n;
+}
+
 static void map_root_dir(uint64_t root,
                          const char *base_path,
                          bool watch) {
@@ -101,15 +324,12 @@ static void map_root_dir(uint64_t root,
 
     struct fs_mount_point mp = {};
 
-    if (watch) {
-//        struct ce_watchdog_a0 *wd = ce_os_a0->watchdog->create(_G.allocator);
-//        wd->add_dir(wd->inst, base_path, true);
-
-//        mp.wd = wd;
-    }
-
     mp.root_path = ce_memory_a0->str_dup(base_path, _G.allocator);
     new_fs_mount(root, mp);
+
+    if (watch) {
+        _watch_tree(root, strlen(base_path), base_path);
+    }
 }
 
 static bool exist_dir(const char *full_path) {
@@ -172,7 +392,7 @@ static struct ce_vio *open(uint64_t root,
     return file;
 }
 
-static void close(struct ce_vio *file) {
+static void _close(struct ce_vio *file) {
     file->close(file);
 }
 
@@ -285,70 +505,6 @@ static int64_t get_file_mtime(uint64_t root,
 }
 
 
-//static void check_wd() {
-//    ce_alloc *alloc = ce_memory_a0->system;
-//    const uint32_t root_count = ce_array_size(_G.roots);
-//
-//    for (uint32_t i = 0; i < root_count; ++i) {
-//        fs_root *fs_inst = &_G.roots[i];
-//        const uint32_t mp_count = ce_array_size(fs_inst->mount_points);
-//
-//        clean_events(fs_inst);
-//
-//        for (uint32_t j = 0; j < mp_count; ++j) {
-//            fs_mount_point *mp = &fs_inst->mount_points[j];
-//            const uint32_t root_path_len = strlen(mp->root_path);
-//
-//            auto *wd = mp->wd;
-//            if (!wd) {
-//                continue;
-//            }
-//
-//            wd->fetch_events(wd->inst);
-//
-//            auto *wd_it = wd->event_begin(wd->inst);
-//            const auto *wd_end = wd->event_end(wd->inst);
-//
-//            while (wd_it != wd_end) {
-//                if (wd_it->type == CE_WATCHDOG_EVENT_FILE_MODIFIED) {
-//                    ce_wd_ev_file_write_end *ev = (ce_wd_ev_file_write_end *) wd_it;
-//
-//                    ce_wd_ev_file_write_end new_ev = *ev;
-//
-//                    new_ev.dir = ce_memory_a0->str_dup(
-//                            ev->dir + root_path_len + 1, alloc);
-//                    new_ev.filename = ce_memory_a0->str_dup(ev->filename, alloc);
-//
-//                    celib::eventstream::push<ce_watchdog_ev_header>(
-//                            fs_inst->event_stream,
-//                            CE_WATCHDOG_EVENT_FILE_MODIFIED,
-//                            new_ev);
-//                }
-//
-//                wd_it = wd->event_next(wd, wd_it);
-//            }
-//        }
-//    }
-//}
-
-//static ce_watchdog_ev_header *event_begin(uint64_t root) {
-//    fs_root *fs_inst = get_fs_root(root);
-//
-//    return celib::eventstream::begin<ce_watchdog_ev_header>(
-//            fs_inst->event_stream);
-//}
-//
-//static ce_watchdog_ev_header *event_end(uint64_t root) {
-//    fs_root *fs_inst = get_fs_root(root);
-//
-//    return celib::eventstream::end<ce_watchdog_ev_header>(
-//            fs_inst->event_stream);
-//}
-//
-//static ce_watchdog_ev_header *event_next(ce_watchdog_ev_header *header) {
-//    return celib::eventstream::next<ce_watchdog_ev_header>(header);
-//}
-
 static void _get_full_path(uint64_t root,
                            const char *path,
                            char *fullpath,
@@ -370,13 +526,14 @@ static void _get_full_path(uint64_t root,
 static struct ce_fs_a0 _api = {
         .open = open,
         .map_root_dir = map_root_dir,
-        .close = close,
+        .close = _close,
         .listdir = listdir,
         .listdir_free = listdir_free,
         .listdir_iter = listdir2,
         .create_directory = create_directory,
         .file_mtime = get_file_mtime,
         .get_full_path = _get_full_path,
+        .changed_files = changed_files,
 };
 
 
@@ -394,12 +551,38 @@ static void _init(struct ce_api_a0 *api) {
             .allocator = ce_memory_a0->system,
     };
 
+    _watch_init();
+
     ce_log_a0->debug(LOG_WHERE, "Init");
 }
 
 static void _shutdown() {
     ce_log_a0->debug(LOG_WHERE, "Shutdown");
 
+    _watch_shutdown();
+
+    for (uint32_t i = 0; i < ce_array_size(_G.watches); ++i) {
+        CE_FREE(_G.allocator, _G.watches[i].dir);
+    }
+
+    for (uint32_t i = 0; i < ce_array_size(_G.roots); ++i) {
+        struct fs_root *fs_inst = &_G.roots[i];
+
+        for (uint32_t j = 0; j < ce_array_size(fs_inst->changed); ++j) {
+            free(fs_inst->changed[j]);
+        }
+
+        for (uint32_t j = 0; j < ce_array_size(fs_inst->mount_points); ++j) {
+            CE_FREE(_G.allocator, fs_inst->mount_points[j].root_path);
+        }
+
+        ce_array_free(fs_inst->changed, _G.allocator);
+        ce_array_free(fs_inst->mount_points, _G.allocator);
+    }
+
+    ce_array_free(_G.watches, _G.allocator);
+    ce_hash_free(&_G.watch_map, _G.allocator);
+
     ce_array_free(_G.roots, _G.allocator);
     ce_hash_free(&_G.root_map, _G.allocator);
 }
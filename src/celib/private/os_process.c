@@ -1,11 +1,30 @@
+#include <celib/platform.h>
+
+#if CE_PLATFORM_LINUX
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 
 #include "celib/macros.h"
 
+#if CE_PLATFORM_LINUX || CE_PLATFORM_OSX
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char **environ;
+#endif
+
 #include <celib/api_system.h>
 #include <celib/os.h>
 #include <celib/module.h>
 #include "celib/log.h"
+#include <celib/array.inl>
 
 
 int exec(const char *argv) {
@@ -30,12 +49,87 @@ int exec(const char *argv) {
 
     return status;
 #else
-#error "Implement this"
+    ce_log_a0->debug("os_sdl", "exec %s", argv);
+    return system(argv);
+#endif
+}
+
+int run(const char *const *argv,
+        char **output,
+        struct ce_alloc *allocator) {
+#if CE_PLATFORM_LINUX || CE_PLATFORM_OSX
+    ce_log_a0->debug("os_sdl", "run %s", argv[0]);
+
+    // Close on exec, pipe must not leak to processes spawned by other threads.
+    int fd[2];
+#if CE_PLATFORM_LINUX
+    if (pipe2(fd, O_CLOEXEC)) {
+        return -1;
+    }
+#else
+    if (pipe(fd)) {
+        return -1;
+    }
+
+    fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+#endif
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fd[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fd[1], STDERR_FILENO);
+
+    pid_t pid;
+    int err = posix_spawn(&pid, argv[0], &actions, NULL, (char *const *) argv,
+                          environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    close(fd[1]);
+
+    if (err) {
+        ce_log_a0->error("os_sdl", "could not run %s: %s", argv[0],
+                         strerror(err));
+        close(fd[0]);
+        return -1;
+    }
+
+    char buffer[4096];
+    for (;;) {
+        ssize_t n = read(fd[0], buffer, CE_ARRAY_LEN(buffer));
+
+        if (n > 0) {
+            if (output) {
+                ce_array_push_n(*output, buffer, n, allocator);
+            }
+        } else if (!n || (errno != EINTR)) {
+            break;
+        }
+    }
+
+    close(fd[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#else
+    CE_UNUSED(output);
+    CE_UNUSED(allocator);
+
+    ce_log_a0->error("os_sdl", "run not supported on this platform %s",
+                     argv[0]);
+    return -1;
 #endif
 }
 
 struct ce_os_process_a0 process_api = {
-        .exec = exec
+        .exec = exec,
+        .run = run,
 };
 
 struct ce_os_process_a0 *ct_process_a0 = &process_api;
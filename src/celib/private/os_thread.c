@@ -72,6 +72,22 @@ void thread_spin_unlock(struct ce_spinlock *lock) {
     SDL_AtomicUnlock((SDL_SpinLock *) lock);
 }
 
+ce_semaphore_t *thread_sem_create(uint32_t value) {
+    return (ce_semaphore_t *) SDL_CreateSemaphore(value);
+}
+
+void thread_sem_destroy(ce_semaphore_t *sem) {
+    SDL_DestroySemaphore((SDL_sem *) sem);
+}
+
+void thread_sem_wait(ce_semaphore_t *sem) {
+    SDL_SemWait((SDL_sem *) sem);
+}
+
+void thread_sem_post(ce_semaphore_t *sem) {
+    SDL_SemPost((SDL_sem *) sem);
+}
+
 struct ce_os_thread_a0 thread_api = {
         .create = thread_create,
         .kill = thread_kill,
@@ -80,7 +96,11 @@ struct ce_os_thread_a0 thread_api = {
         .actual_id = thread_actual_id,
         .yield = thread_yield,
         .spin_lock = thread_spin_lock,
-        .spin_unlock = thread_spin_unlock
+        .spin_unlock = thread_spin_unlock,
+        .sem_create = thread_sem_create,
+        .sem_destroy = thread_sem_destroy,
+        .sem_wait = thread_sem_wait,
+        .sem_post = thread_sem_post,
 };
 
 struct ce_os_thread_a0 *ct_thread_a0 = &thread_api;
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include <celib/os.h>
 #include <celib/module.h>
 #include <celib/api_system.h>
@@ -8,8 +10,20 @@
 #include "include/SDL2/SDL.h"
 #include "celib/allocator.h"
 
+#if CE_PLATFORM_LINUX || CE_PLATFORM_OSX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #define LOG_WHERE_OS "vio_sdl"
 
+struct vio_file {
+    struct ce_vio vio;
+    char path[];
+};
+
 int64_t vio_sdl_seek(struct ce_vio *file,
                      int64_t offset,
                      enum ce_vio_seek whence) {
@@ -52,37 +66,89 @@ int vio_sdl_close(struct ce_vio *file) {
     CE_ASSERT(LOG_WHERE_OS, file != NULL);
 
     SDL_RWclose((SDL_RWops *) file->inst);
+    CE_FREE(ce_memory_a0->system, file);
     return 1;
 }
 
+const void *vio_file_map(struct ce_vio *file) {
+    CE_ASSERT(LOG_WHERE_OS, file != NULL);
+
+#if CE_PLATFORM_LINUX || CE_PLATFORM_OSX
+    struct vio_file *vio_file = (struct vio_file *) file;
+
+    int fd = open(vio_file->path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) < 0) || !st.st_size) {
+        close(fd);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (MAP_FAILED == data) {
+        return NULL;
+    }
+
+    return data;
+#else
+    return NULL;
+#endif
+}
+
+void vio_file_unmap(const void *data,
+                    uint64_t size) {
+#if CE_PLATFORM_LINUX || CE_PLATFORM_OSX
+    munmap((void *) data, size);
+#else
+    CE_UNUSED(data);
+    CE_UNUSED(size);
+#endif
+}
+
 
 struct ce_vio *vio_from_file(const char *path,
                              enum ce_vio_open_mode mode) {
 
     struct ce_alloc *alloc =ce_memory_a0->system;
 
-    struct ce_vio *vio = CE_ALLOC(alloc,
-                                  struct ce_vio,
-                                  sizeof(struct ce_vio));
+    const size_t path_len = strlen(path) + 1;
+
+    struct vio_file *vio_file = CE_ALLOC(alloc,
+                                         struct vio_file,
+                                         sizeof(struct vio_file) + path_len);
 
-    CE_ASSERT(LOG_WHERE_OS, vio != NULL);
+    CE_ASSERT(LOG_WHERE_OS, vio_file != NULL);
 
-    if (!vio) {
+    if (!vio_file) {
         return NULL;
     }
 
     SDL_RWops *rwops = SDL_RWFromFile(path, mode == VIO_OPEN_WRITE ? "w" : "r");
 
     if (!rwops) {
+        CE_FREE(alloc, vio_file);
         return NULL;
     }
 
-    vio->inst = rwops;
-    vio->write = vio_sdl_write;
-    vio->read = vio_sdl_read;
-    vio->seek = vio_sdl_seek;
-    vio->size = vio_sdl_size;
-    vio->close = vio_sdl_close;
+    memcpy(vio_file->path, path, path_len);
+
+    struct ce_vio *vio = &vio_file->vio;
+
+    *vio = (struct ce_vio) {
+            .inst = rwops,
+            .write = vio_sdl_write,
+            .read = vio_sdl_read,
+            .seek = vio_sdl_seek,
+            .size = vio_sdl_size,
+            .close = vio_sdl_close,
+            .map = mode == VIO_OPEN_READ ? vio_file_map : NULL,
+            .unmap = vio_file_unmap,
+    };
 
     return vio;
 }
@@ -0,0 +1,174 @@
+#ifndef CE_QUEUE_WS_H
+#define CE_QUEUE_WS_H
+
+//==============================================================================
+// Includes
+//==============================================================================
+
+#include <stdatomic.h>
+#include <celib/os.h>
+#include <celib/macros.h>
+#include "celib/allocator.h"
+
+//==============================================================================
+// Implementation
+//==============================================================================
+
+// Chase-Lev work-stealing deque.
+// Owner push/pop on bottom, other threads steal from top.
+// Array grows when full, old arrays are freed in queue_ws_destroy because
+// stealers can still read them.
+
+struct queue_ws_array {
+    int64_t capacity;
+    struct queue_ws_array *prev;
+    _Atomic(uint64_t) data[];
+};
+
+struct queue_ws {
+    atomic_llong _top;
+    char _pad1[64];
+    atomic_llong _bottom;
+    char _pad2[64];
+    _Atomic(struct queue_ws_array *) _array;
+    struct ce_alloc *allocator;
+};
+
+static struct queue_ws_array *_queue_ws_new_array(struct ce_alloc *allocator,
+                                                  int64_t capacity) {
+    struct queue_ws_array *a;
+    a = CE_ALLOC(allocator, struct queue_ws_array,
+                 sizeof(struct queue_ws_array) +
+                 (sizeof(uint64_t) * capacity));
+
+    a->capacity = capacity;
+    a->prev = NULL;
+
+    return a;
+}
+
+void queue_ws_init(struct queue_ws *q,
+                   uint32_t capacity,
+                   struct ce_alloc *allocator) {
+    *q = (struct queue_ws) {};
+
+    // capacity must be power of two
+    CE_ASSERT("QUEUEWS", 0 == (capacity & (capacity - 1)));
+
+    q->allocator = allocator;
+
+    atomic_init(&q->_top, 0);
+    atomic_init(&q->_bottom, 0);
+    atomic_init(&q->_array, _queue_ws_new_array(allocator, capacity));
+}
+
+void queue_ws_destroy(struct queue_ws *q) {
+    struct queue_ws_array *a = atomic_load(&q->_array);
+
+    while (a) {
+        struct queue_ws_array *prev = a->prev;
+        CE_FREE(q->allocator, a);
+        a = prev;
+    }
+}
+
+uint32_t queue_ws_size(struct queue_ws *q) {
+    int64_t b = atomic_load_explicit(&q->_bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&q->_top, memory_order_relaxed);
+
+    return b > t ? (uint32_t) (b - t) : 0;
+}
+
+// Owner only
+void queue_ws_push(struct queue_ws *q,
+                   uint64_t value) {
+    int64_t b = atomic_load_explicit(&q->_bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&q->_top, memory_order_acquire);
+    struct queue_ws_array *a = atomic_load_explicit(&q->_array,
+                                                    memory_order_relaxed);
+
+    if ((b - t) > (a->capacity - 1)) {
+        struct queue_ws_array *new_a;
+        new_a = _queue_ws_new_array(q->allocator, a->capacity * 2);
+
+        for (int64_t i = t; i < b; ++i) {
+            uint64_t v = atomic_load_explicit(
+                    &a->data[i & (a->capacity - 1)], memory_order_relaxed);
+
+            atomic_store_explicit(&new_a->data[i & (new_a->capacity - 1)], v,
+                                  memory_order_relaxed);
+        }
+
+        new_a->prev = a;
+        atomic_store_explicit(&q->_array, new_a, memory_order_release);
+        a = new_a;
+    }
+
+    atomic_store_explicit(&a->data[b & (a->capacity - 1)], value,
+                          memory_order_relaxed);
+
+    atomic_store_explicit(&q->_bottom, b + 1, memory_order_release);
+}
+
+// Owner only
+int queue_ws_pop(struct queue_ws *q,
+                 uint64_t *value) {
+    int64_t b = atomic_load_explicit(&q->_bottom, memory_order_relaxed) - 1;
+    struct queue_ws_array *a = atomic_load_explicit(&q->_array,
+                                                    memory_order_relaxed);
+
+    atomic_store_explicit(&q->_bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    int64_t t = atomic_load_explicit(&q->_top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&q->_bottom, b + 1, memory_order_relaxed);
+        return 0;
+    }
+
+    *value = atomic_load_explicit(&a->data[b & (a->capacity - 1)],
+                                  memory_order_relaxed);
+
+    if (t != b) {
+        return 1;
+    }
+
+    // Last item, race with stealers
+    int ok = atomic_compare_exchange_strong_explicit(&q->_top, &t, t + 1,
+                                                     memory_order_seq_cst,
+                                                     memory_order_relaxed);
+
+    atomic_store_explicit(&q->_bottom, b + 1, memory_order_relaxed);
+
+    return ok;
+}
+
+// Any thread. Return 0 if queue is empty or other thread win the race.
+int queue_ws_steal(struct queue_ws *q,
+                   uint64_t *value) {
+    int64_t t = atomic_load_explicit(&q->_top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&q->_bottom, memory_order_acquire);
+
+    if (t >= b) {
+        return 0;
+    }
+
+    struct queue_ws_array *a = atomic_load_explicit(&q->_array,
+                                                    memory_order_acquire);
+
+    uint64_t v = atomic_load_explicit(&a->data[t & (a->capacity - 1)],
+                                      memory_order_relaxed);
+
+    if (!atomic_compare_exchange_strong_explicit(&q->_top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+        return 0;
+    }
+
+    *value = v;
+    return 1;
+}
+
+#endif //CE_QUEUE_WS_H
@@ -2,6 +2,13 @@
 // Includes
 //==============================================================================
 
+#if defined(__APPLE__)
+#define _XOPEN_SOURCE 600
+#endif
+
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include <celib/api_system.h>
 #include <celib/memory.h>
@@ -10,17 +17,33 @@
 #include <celib/task.h>
 #include <celib/module.h>
 
-#include "queue_mpmc.h"
+#include "queue_ws.h"
 
 
 //==============================================================================
 // Defines
 //==============================================================================
 
-#define make_task(i) (task_id_t){.id = i}
+#define QUEUE_INIT_SIZE 1024
+
+// Idle loops before worker park
+#define WORKER_SPIN_COUNT 64
+
+// Ranges per worker for parallel_for with auto grain
+#define RANGES_PER_WORKER 8
+
+// Continuation list of counter that already hit zero
+#define TASK_FIRED ((struct task_t *) UINTPTR_MAX)
+
+#define FIBER_STACK_SIZE (512 * 1024)
+
+// Stack for tasks with big_stack (resource compilers, deep recursion).
+#define FIBER_BIG_STACK_SIZE (8 * 1024 * 1024)
+
+// Max fibers alive per class, tasks over limit run on worker stack.
+#define MAX_FIBERS 1024
+#define MAX_BIG_FIBERS 64
 
-#define MAX_TASK 4096
-#define MAX_COUNTERS 4096
 #define LOG_WHERE "taskmanager"
 #define _G TaskManagerGlobal
 
@@ -28,37 +51,110 @@
 // Globals
 //==============================================================================
 
+struct fiber_t;
+
+enum fiber_class {
+    FIBER_CLASS_SMALL = 0,
+    FIBER_CLASS_BIG,
+    FIBER_CLASS_COUNT,
+};
+
+static const size_t _fiber_stack_size[FIBER_CLASS_COUNT] = {
+        [FIBER_CLASS_SMALL] = FIBER_STACK_SIZE,
+        [FIBER_CLASS_BIG] = FIBER_BIG_STACK_SIZE,
+};
+
+static const int _fiber_max[FIBER_CLASS_COUNT] = {
+        [FIBER_CLASS_SMALL] = MAX_FIBERS,
+        [FIBER_CLASS_BIG] = MAX_BIG_FIBERS,
+};
+
 struct task_t {
     void *data;
 
     void (*task_work)(void *data);
 
+    // Resume suspended fiber instead of work
+    struct fiber_t *fiber;
+
+    // parallel_for range
+    ce_task_range_fce_t range_work;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t grain;
+
     const char *name;
-    uint32_t counter;
+    struct ce_task_counter_t *counter;
+
+    bool big_stack;
+
+    // free list or continuation list
+    struct task_t *next;
 };
 
-typedef struct {
-    uint32_t id;
-} task_id_t;
+// Counter is freed when holder release it and all tasks are done.
+struct ce_task_counter_t {
+    atomic_int value;
+    atomic_int refs;
 
-static const task_id_t task_null = (task_id_t) {.id = 0};
+    // Tasks to push when value hits zero
+    _Atomic(struct task_t *) continuation;
 
-static struct _G {
-    ce_thread_t *workers[TASK_MAX_WORKERS - 1];
+    // free list
+    struct ce_task_counter_t *next;
+};
+
+// Every task run on fiber. Waiting task suspend its fiber and worker continue
+// with other task, fiber is resumed as continuation of counter.
+struct fiber_t {
+    ucontext_t ctx;
 
-    // TASK
-    struct task_t task_pool[MAX_TASK];
-    atomic_int task_pool_idx;
-    struct queue_mpmc free_task;
+    // Mapping with guard page at bottom, overflow fault instead of
+    // overwrite heap.
+    void *stack;
+    size_t stack_size;
+    enum fiber_class cls;
+
+    struct task_t *task;
+
+    // free list
+    struct fiber_t *next;
+};
 
-    // COUNTERS
-    atomic_int counter_pool_idx;
-    atomic_int counter_pool[MAX_COUNTERS];
-    struct queue_mpmc free_counter;
+// Free lists are touched only by owner worker so need no lock.
+// Task is returned to list of worker that executed it.
+struct worker_t {
+    struct queue_ws queue;
+
+    struct task_t *free_task;
+    struct ce_task_counter_t *free_counter;
+    struct fiber_t *free_fiber[FIBER_CLASS_COUNT];
+
+    uint32_t steal_idx;
+
+    // Scheduler context, fibers switch back here
+    ucontext_t sched_ctx;
+    struct fiber_t *fiber;
+
+    // Counter that current fiber wait for, set before switch to scheduler
+    struct ce_task_counter_t *wait_counter;
+
+    char _pad[64];
+};
+
+static struct _G {
+    ce_thread_t *threads[TASK_MAX_WORKERS - 1];
+    struct worker_t workers[TASK_MAX_WORKERS];
 
     uint32_t workers_count;
 
-    struct queue_mpmc job_queue;
+    // Parked workers
+    ce_semaphore_t *wake_sem;
+    atomic_int sleeping;
+
+    // Fibers alive per class
+    atomic_int fibers_n[FIBER_CLASS_COUNT];
+
     atomic_bool is_running;
     struct ce_alloc *allocator;
 } _G;
@@ -69,81 +165,343 @@ static __thread uint8_t _worker_id = 0;
 //==============================================================================
 //==============================================================================
 
-static task_id_t _new_task() {
-    uint32_t idx;
-    queue_task_pop(&_G.free_task, &idx, UINT32_MAX);
+// Fiber can be resumed on other thread so thread local must be reloaded after
+// switch, noinline prevent caching it.
+static __attribute__((noinline)) struct worker_t *_worker() {
+    return &_G.workers[_worker_id];
+}
+
+static struct task_t *_new_task() {
+    struct worker_t *worker = _worker();
+
+    struct task_t *task = worker->free_task;
+    if (task) {
+        worker->free_task = task->next;
+        return task;
+    }
+
+    return CE_ALLOC(_G.allocator, struct task_t, sizeof(struct task_t));
+}
+
+static void _free_task(struct task_t *task) {
+    struct worker_t *worker = _worker();
+
+    task->next = worker->free_task;
+    worker->free_task = task;
+}
+
+static struct ce_task_counter_t *_new_counter(int32_t value) {
+    struct worker_t *worker = _worker();
+
+    struct ce_task_counter_t *counter = worker->free_counter;
+    if (counter) {
+        worker->free_counter = counter->next;
+    } else {
+        counter = CE_ALLOC(_G.allocator, struct ce_task_counter_t,
+                           sizeof(struct ce_task_counter_t));
+    }
+
+    // holder + pending tasks
+    atomic_init(&counter->value, value);
+    atomic_init(&counter->refs, value ? 2 : 1);
+    atomic_init(&counter->continuation, value ? NULL : TASK_FIRED);
 
-    if (idx == UINT32_MAX) {
-        idx = atomic_fetch_add(&_G.task_pool_idx, 1);
+    return counter;
+}
+
+static void _release_counter(struct ce_task_counter_t *counter) {
+    if (atomic_fetch_sub(&counter->refs, 1) != 1) {
+        return;
+    }
+
+    struct worker_t *worker = _worker();
+
+    counter->next = worker->free_counter;
+    worker->free_counter = counter;
+}
+
+static bool _has_work() {
+    for (uint32_t i = 0; i <= _G.workers_count; ++i) {
+        if (queue_ws_size(&_G.workers[i].queue)) {
+            return true;
+        }
     }
 
-    return make_task(idx);
+    return false;
+}
+
+static void _wake_workers(uint32_t count) {
+    atomic_thread_fence(memory_order_seq_cst);
+
+    while (count) {
+        int sleeping = atomic_load(&_G.sleeping);
+        if (sleeping <= 0) {
+            return;
+        }
+
+        if (atomic_compare_exchange_weak(&_G.sleeping, &sleeping,
+                                         sleeping - 1)) {
+            ce_os_a0->thread->sem_post(_G.wake_sem);
+            --count;
+        }
+    }
 }
 
-static uint32_t _new_counter_task(uint32_t value) {
-    uint32_t idx;
-    queue_task_pop(&_G.free_counter, &idx, UINT32_MAX);
+static void _park() {
+    atomic_fetch_add(&_G.sleeping, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (_has_work() || !_G.is_running) {
+        int sleeping = atomic_load(&_G.sleeping);
+        while (sleeping > 0) {
+            if (atomic_compare_exchange_weak(&_G.sleeping, &sleeping,
+                                             sleeping - 1)) {
+                return;
+            }
+        }
 
-    if (idx == UINT32_MAX) {
-        idx = atomic_fetch_add(&_G.counter_pool_idx, 1);
+        // Somebody already woke us, consume post.
     }
 
-    atomic_int *counter = &_G.counter_pool[idx];
-    atomic_init(counter, value);
+    ce_os_a0->thread->sem_wait(_G.wake_sem);
+}
 
-    return idx;
+static void _push_task(struct task_t *task) {
+    queue_ws_push(&_worker()->queue, (uint64_t) task);
 }
 
-static void _push_task(task_id_t t) {
-    struct queue_mpmc *q;
-    q = &_G.job_queue;
+static void _counter_done(struct ce_task_counter_t *counter) {
+    if (atomic_fetch_sub_explicit(&counter->value, 1,
+                                  memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    struct task_t *task = atomic_exchange(&counter->continuation, TASK_FIRED);
+
+    uint32_t task_n = 0;
+    while (task) {
+        struct task_t *next = task->next;
+        _push_task(task);
+        task = next;
+        ++task_n;
+    }
 
-    queue_task_push(q, t.id);
+    _wake_workers(task_n);
+    _release_counter(counter);
 }
 
+// Push list of tasks first..last to continuation of counter *after*.
+static void _chain_after(struct ce_task_counter_t *after,
+                         struct task_t *first,
+                         struct task_t *last,
+                         uint32_t count) {
+    struct task_t *head = atomic_load(&after->continuation);
+    do {
+        if (TASK_FIRED == head) {
+            break;
+        }
 
-static task_id_t _try_pop(struct queue_mpmc *q) {
-    uint32_t poped_task;
+        last->next = head;
+    } while (!atomic_compare_exchange_weak(&after->continuation, &head,
+                                           first));
 
-    if (!queue_task_size(q)) {
-        return task_null;
+    if (TASK_FIRED != head) {
+        return;
     }
 
-    if (queue_task_pop(q, &poped_task, 0)) {
-        if (poped_task != 0) {
-            return make_task(poped_task);
+    // Counter already hit zero
+    while (first) {
+        struct task_t *next = first->next;
+        _push_task(first);
+        first = next;
+    }
+
+    _wake_workers(count);
+}
+
+// Split range in half until it fits grain, upper halves go to queue
+// for stealing.
+static void _run_range(struct task_t *task) {
+    uint32_t end = task->end;
+    uint32_t task_n = 0;
+
+    while ((end - task->begin) > task->grain) {
+        const uint32_t mid = task->begin + ((end - task->begin) / 2);
+
+        struct task_t *sub = _new_task();
+        *sub = *task;
+        sub->begin = mid;
+        sub->end = end;
+
+        atomic_fetch_add(&task->counter->value, 1);
+        _push_task(sub);
+
+        end = mid;
+        ++task_n;
+    }
+
+    _wake_workers(task_n);
+
+    task->range_work(task->begin, end, task->data);
+}
+
+// Own queue first (LIFO), then steal from others (FIFO).
+static struct task_t *_pop_task() {
+    struct worker_t *worker = _worker();
+
+    uint64_t task;
+    if (queue_ws_pop(&worker->queue, &task)) {
+        return (struct task_t *) task;
+    }
+
+    const uint32_t worker_n = _G.workers_count + 1;
+    for (uint32_t i = 0; i < worker_n; ++i) {
+        const uint32_t victim = (worker->steal_idx + i) % worker_n;
+
+        if (victim == _worker_id) {
+            continue;
+        }
+
+        if (queue_ws_steal(&_G.workers[victim].queue, &task)) {
+            worker->steal_idx = victim;
+            return (struct task_t *) task;
         }
     }
 
-    return task_null;
+    return NULL;
+}
+
+static void _fiber_main() {
+    for (;;) {
+        struct worker_t *worker = _worker();
+        struct task_t *task = worker->fiber->task;
+
+        if (task->range_work) {
+            _run_range(task);
+        } else {
+            task->task_work(task->data);
+        }
+
+        // Task can finish on other worker than it started
+        worker = _worker();
+
+        _counter_done(task->counter);
+        _free_task(task);
+
+        worker->fiber->task = NULL;
+        swapcontext(&worker->fiber->ctx, &worker->sched_ctx);
+    }
 }
 
-static task_id_t _task_pop_new_work() {
-    task_id_t pop_task;
-    struct queue_mpmc *qg = &_G.job_queue;
+static struct fiber_t *_new_fiber(enum fiber_class cls) {
+    struct worker_t *worker = _worker();
+
+    struct fiber_t *fiber = worker->free_fiber[cls];
+    if (fiber) {
+        worker->free_fiber[cls] = fiber->next;
+        return fiber;
+    }
+
+    if (atomic_fetch_add(&_G.fibers_n[cls], 1) >= _fiber_max[cls]) {
+        atomic_fetch_sub(&_G.fibers_n[cls], 1);
+        return NULL;
+    }
+
+    const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t stack_size = _fiber_stack_size[cls] + page_size;
+
+    void *stack = mmap(NULL, stack_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
-    pop_task = _try_pop(qg);
-    if (pop_task.id != 0) {
-        return pop_task;
+    if (MAP_FAILED == stack) {
+        atomic_fetch_sub(&_G.fibers_n[cls], 1);
+        ce_log_a0->error(LOG_WHERE, "Could not map fiber stack");
+        return NULL;
     }
 
-    return task_null;
+    mprotect(stack, page_size, PROT_NONE);
+
+    fiber = CE_ALLOC(_G.allocator, struct fiber_t, sizeof(struct fiber_t));
+    *fiber = (struct fiber_t) {
+            .stack = stack,
+            .stack_size = stack_size,
+            .cls = cls,
+    };
+
+    getcontext(&fiber->ctx);
+    fiber->ctx.uc_stack.ss_sp = (uint8_t *) stack + page_size;
+    fiber->ctx.uc_stack.ss_size = _fiber_stack_size[cls];
+    fiber->ctx.uc_link = NULL;
+    makecontext(&fiber->ctx, _fiber_main, 0);
+
+    return fiber;
+}
+
+static void _free_fiber(struct fiber_t *fiber) {
+    struct worker_t *worker = _worker();
+
+    fiber->next = worker->free_fiber[fiber->cls];
+    worker->free_fiber[fiber->cls] = fiber;
 }
 
+// Switch to fiber and handle why it switched back.
+static void _run_fiber(struct fiber_t *fiber) {
+    struct worker_t *worker = _worker();
+
+    worker->fiber = fiber;
+    swapcontext(&worker->sched_ctx, &fiber->ctx);
+
+    worker->fiber = NULL;
+
+    struct ce_task_counter_t *wait_counter = worker->wait_counter;
+    if (!wait_counter) {
+        _free_fiber(fiber);
+        return;
+    }
+
+    // Fiber is saved now so it is safe to let others resume it.
+    worker->wait_counter = NULL;
+
+    struct task_t *resume = _new_task();
+    *resume = (struct task_t) {.fiber = fiber};
+
+    _chain_after(wait_counter, resume, resume, 1);
+}
 
 int do_work() {
-    task_id_t t = _task_pop_new_work();
+    struct task_t *task = _pop_task();
 
-    if (t.id == 0) {
+    if (!task) {
         return 0;
     }
 
-    struct task_t *task = &_G.task_pool[t.id];
+    if (task->fiber) {
+        struct fiber_t *fiber = task->fiber;
+        _free_task(task);
 
-    task->task_work(_G.task_pool[t.id].data);
+        _run_fiber(fiber);
+        return 1;
+    }
+
+    struct fiber_t *fiber = _new_fiber(task->big_stack ? FIBER_CLASS_BIG
+                                                       : FIBER_CLASS_SMALL);
+
+    // Out of stacks, run on worker stack, wait falls back to do_work.
+    if (!fiber) {
+        if (task->range_work) {
+            _run_range(task);
+        } else {
+            task->task_work(task->data);
+        }
+
+        _counter_done(task->counter);
+        _free_task(task);
+        return 1;
+    }
 
-    atomic_fetch_sub(&_G.counter_pool[task->counter], 1);
-    queue_task_push(&_G.free_task, t.id);
+    fiber->task = task;
+
+    _run_fiber(fiber);
 
     return 1;
 }
@@ -157,10 +515,20 @@ static int _task_worker(void *o) {
 
     ce_log_a0->debug("task_worker", "Worker %d init", _worker_id);
 
+    uint32_t idle = 0;
     while (_G.is_running) {
-        if (!do_work()) {
+        if (do_work()) {
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < WORKER_SPIN_COUNT) {
             ce_os_a0->thread->yield();
+            continue;
         }
+
+        _park();
+        idle = 0;
     }
 
     ce_log_a0->debug("task_worker", "Worker %d shutdown", _worker_id);
@@ -175,34 +543,131 @@ static int _task_worker(void *o) {
 void add(struct ce_task_item *items,
          uint32_t count,
          struct ce_task_counter_t **counter) {
-    uint32_t new_counter = _new_counter_task(count);
+    struct ce_task_counter_t *new_counter = _new_counter(count);
 
-    *counter = (struct ce_task_counter_t *) &_G.counter_pool[new_counter];
+    *counter = new_counter;
 
     for (uint32_t i = 0; i < count; ++i) {
-        task_id_t task = _new_task();
-        _G.task_pool[task.id] = (struct task_t) {
+        struct task_t *task = _new_task();
+
+        *task = (struct task_t) {
                 .name = items[i].name,
                 .task_work = items[i].work,
-                .counter = new_counter
+                .data = items[i].data,
+                .big_stack = items[i].big_stack,
+                .counter = new_counter,
         };
 
-        _G.task_pool[task.id].data = items[i].data;
-
         _push_task(task);
     }
+
+    _wake_workers(count);
+}
+
+void add_after(struct ce_task_counter_t *after,
+               struct ce_task_item *items,
+               uint32_t count,
+               struct ce_task_counter_t **counter) {
+    struct ce_task_counter_t *new_counter = _new_counter(count);
+
+    *counter = new_counter;
+
+    if (!count) {
+        return;
+    }
+
+    struct task_t *first = NULL;
+    struct task_t *last = NULL;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        struct task_t *task = _new_task();
+
+        *task = (struct task_t) {
+                .name = items[i].name,
+                .task_work = items[i].work,
+                .data = items[i].data,
+                .big_stack = items[i].big_stack,
+                .counter = new_counter,
+                .next = first,
+        };
+
+        if (!last) {
+            last = task;
+        }
+
+        first = task;
+    }
+
+    _chain_after(after, first, last, count);
+}
+
+void parallel_for(uint32_t count,
+                  uint32_t grain,
+                  ce_task_range_fce_t fce,
+                  void *data,
+                  struct ce_task_counter_t **counter) {
+    if (!count) {
+        *counter = _new_counter(0);
+        return;
+    }
+
+    if (!grain) {
+        grain = count / ((_G.workers_count + 1) * RANGES_PER_WORKER);
+
+        if (!grain) {
+            grain = 1;
+        }
+    }
+
+    struct ce_task_counter_t *new_counter = _new_counter(1);
+
+    *counter = new_counter;
+
+    struct task_t *task = _new_task();
+
+    *task = (struct task_t) {
+            .name = "parallel_for",
+            .range_work = fce,
+            .data = data,
+            .begin = 0,
+            .end = count,
+            .grain = grain,
+            .counter = new_counter,
+    };
+
+    _push_task(task);
+    _wake_workers(1);
 }
 
 
 void wait_atomic(struct ce_task_counter_t *signal,
                  int32_t value) {
-    while (atomic_load_explicit((atomic_int *) signal, memory_order_acquire) !=
+    struct worker_t *worker = _worker();
+
+    // Inside task suspend fiber until counter hits zero.
+    if (worker->fiber && !value) {
+        if (atomic_load_explicit(&signal->value, memory_order_acquire)) {
+            worker->wait_counter = signal;
+            swapcontext(&worker->fiber->ctx, &worker->sched_ctx);
+        }
+
+        _release_counter(signal);
+        return;
+    }
+
+    while (atomic_load_explicit(&signal->value, memory_order_acquire) !=
            value) {
-        do_work();
+        // Fiber can not run other fibers
+        if (worker->fiber || !do_work()) {
+            ce_os_a0->thread->yield();
+        }
     }
 
-    uint32_t counter_idx = ((atomic_int *) signal) - _G.counter_pool;
-    queue_task_push(&_G.free_counter, counter_idx);
+    _release_counter(signal);
+}
+
+void release_counter(struct ce_task_counter_t *counter) {
+    _release_counter(counter);
 }
 
 char worker_id() {
@@ -217,7 +682,10 @@ static struct ce_task_a0 _task_api = {
         .worker_id = worker_id,
         .worker_count = worker_count,
         .add = add,
-        .wait_for_counter = wait_atomic
+        .wait_for_counter = wait_atomic,
+        .release_counter = release_counter,
+        .parallel_for = parallel_for,
+        .add_after = add_after,
 };
 
 struct ce_task_a0 *ce_task_a0 = &_task_api;
@@ -230,22 +698,26 @@ static void _init(struct ce_api_a0 *api) {
     int core_count = ce_os_a0->cpu->count();
 
     static const uint32_t main_threads_count = 1 ;//+ 1/* Renderer */;
-    const uint32_t worker_count = core_count - main_threads_count;
+    uint32_t worker_count = core_count - main_threads_count;
+
+    if (worker_count > (TASK_MAX_WORKERS - 1)) {
+        worker_count = TASK_MAX_WORKERS - 1;
+    }
 
     ce_log_a0->info("task", "Core/Main/Worker: %d, %d, %d",
                     core_count, main_threads_count, worker_count);
 
     _G.workers_count = worker_count;
 
-    queue_task_init(&_G.job_queue, MAX_TASK, _G.allocator);
-    queue_task_init(&_G.free_task, MAX_TASK, _G.allocator);
-    queue_task_init(&_G.free_counter, MAX_TASK, _G.allocator);
+    for (uint32_t i = 0; i <= worker_count; ++i) {
+        queue_ws_init(&_G.workers[i].queue, QUEUE_INIT_SIZE, _G.allocator);
+    }
 
-    atomic_init(&_G.counter_pool_idx, 1);
-    atomic_init(&_G.task_pool_idx, 1);
+    _G.wake_sem = ce_os_a0->thread->sem_create(0);
+    atomic_init(&_G.sleeping, 0);
 
     for (uint32_t j = 0; j < worker_count; ++j) {
-        _G.workers[j] = ce_os_a0->thread->create(_task_worker,
+        _G.threads[j] = ce_os_a0->thread->create(_task_worker,
                                                     "cetech_worker",
                                                     (void *) ((intptr_t) (j +
                                                                           1)));
@@ -256,15 +728,45 @@ static void _init(struct ce_api_a0 *api) {
 
 static void _shutdown() {
     _G.is_running = 0;
-    int status = 0;
 
     for (uint32_t i = 0; i < _G.workers_count; ++i) {
-        ce_os_a0->thread->wait(_G.workers[i], &status);
+        ce_os_a0->thread->sem_post(_G.wake_sem);
+    }
+
+    int status = 0;
+    for (uint32_t i = 0; i < _G.workers_count; ++i) {
+        ce_os_a0->thread->wait(_G.threads[i], &status);
+    }
+
+    for (uint32_t i = 0; i <= _G.workers_count; ++i) {
+        struct worker_t *worker = &_G.workers[i];
+
+        queue_ws_destroy(&worker->queue);
+
+        while (worker->free_task) {
+            struct task_t *next = worker->free_task->next;
+            CE_FREE(_G.allocator, worker->free_task);
+            worker->free_task = next;
+        }
+
+        while (worker->free_counter) {
+            struct ce_task_counter_t *next = worker->free_counter->next;
+            CE_FREE(_G.allocator, worker->free_counter);
+            worker->free_counter = next;
+        }
+
+        for (uint32_t cls = 0; cls < FIBER_CLASS_COUNT; ++cls) {
+            while (worker->free_fiber[cls]) {
+                struct fiber_t *fiber = worker->free_fiber[cls];
+                worker->free_fiber[cls] = fiber->next;
+
+                munmap(fiber->stack, fiber->stack_size);
+                CE_FREE(_G.allocator, fiber);
+            }
+        }
     }
 
-    queue_task_destroy(&_G.job_queue);
-    queue_task_destroy(&_G.free_task);
-    queue_task_destroy(&_G.free_counter);
+    ce_os_a0->thread->sem_destroy(_G.wake_sem);
 
     _G = (struct _G) {
             .allocator = ce_memory_a0->system
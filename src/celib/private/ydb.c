@@ -34,11 +34,15 @@ void expire_document_in_cache(const char *path,
         return;
     }
 
+    // Slot is kept, get load document to it again.
     ce_os_a0->thread->spin_lock(&_G.cache_lock);
     struct ce_yng_doc *doc = _G.document_cache[idx];
-    ce_hash_remove(&_G.document_cache_map, path_key);
-    ce_yng_a0->destroy(doc);
+    _G.document_cache[idx] = NULL;
     ce_os_a0->thread->spin_unlock(&_G.cache_lock);
+
+    if (doc) {
+        ce_yng_a0->destroy(doc);
+    }
 }
 
 struct ce_yng_doc *load_to_cache(const char *path,
@@ -86,7 +90,7 @@ struct ce_yng_doc *get(const char *path) {
     uint64_t path_key = ce_id_a0->id64(path);
 
     uint32_t idx = ce_hash_lookup(&_G.document_cache_map, path_key, UINT32_MAX);
-    if (UINT32_MAX == idx) {
+    if ((UINT32_MAX == idx) || !_G.document_cache[idx]) {
         ce_os_a0->thread->spin_unlock(&_G.cache_lock);
         return load_to_cache(path, path_key);
     }
@@ -479,36 +483,14 @@ void parent_files(const char *path,
     d->parent_files(d, files, count);
 }
 
-//void check_fs() {
-//    ce_alloc *alloc = ce_memory_a0->system;
-//
-//    static uint64_t root = CE_ID64_0("source", 0x921f1370045bad6eULL);
-//
-//    auto *wd_it = ce_fs_a0->event_begin(root);
-//    const auto *wd_end = ce_fs_a0->event_end(root);
-//
-//    while (wd_it != wd_end) {
-//        if (wd_it->type == CE_WATCHDOG_EVENT_FILE_MODIFIED) {
-//            ce_wd_ev_file_write_end *ev = (ce_wd_ev_file_write_end *) wd_it;
-//
-//            char *path = NULL;
-//            ce_os_path_a0->join(&path, alloc, 2, ev->dir, ev->filename);
-//
-//            uint64_t path_key = CE_ID64_0(path);
-//
-//            if (ce_hash_contain(&_G.document_cache_map, path_key)) {
-//                ce_log_a0->debug(LOG_WHERE, "Reload cached file %s", path);
-//
-//                expire_document_in_cache(path, path_key);
-//                load_to_cache(path, path_key);
-//            }
-//
-//            ce_buffer_free(path, alloc);
-//        }
-//
-//        wd_it = ce_fs_a0->event_next(wd_it);
-//    }
-//}
+static void expire(const char *path) {
+    uint64_t path_key = ce_id_a0->id64(path);
+
+    if (ce_hash_contain(&_G.document_cache_map, path_key)) {
+        ce_log_a0->debug(LOG_WHERE, "Expire cached file %s", path);
+        expire_document_in_cache(path, path_key);
+    }
+}
 
 
 void save(const char *path) {
@@ -564,6 +546,7 @@ static struct ce_ydb_a0 ydb_api = {
         .parent_files = parent_files,
         .save = save,
         .save_all_modified = save_all_modified,
+        .expire = expire,
 };
 
 struct ce_ydb_a0 *ce_ydb_a0 = &ydb_api;
@@ -576,7 +559,9 @@ static void _init(struct ce_api_a0 *api) {
 
 static void _shutdown() {
     for (int i = 0; i < ce_array_size(_G.document_cache); ++i) {
-        ce_yng_a0->destroy(_G.document_cache[i]);
+        if (_G.document_cache[i]) {
+            ce_yng_a0->destroy(_G.document_cache[i]);
+        }
     }
 
     ce_array_free(_G.document_path, _G.allocator);
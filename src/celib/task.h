@@ -7,6 +7,7 @@
 //==============================================================================
 
 #include <stdatomic.h>
+#include <stdbool.h>
 
 //==============================================================================
 // Enums
@@ -28,10 +29,16 @@ struct ce_task_item {
     const char *name;               //!< Task name
     void (*work)(void *data);       //!< Task work
     void *data;                     //!< Worker data
+    bool big_stack;                 //!< Run on big fiber stack (compilers)
 };
 
 struct ce_task_counter_t;
 
+//! Range work, process items [begin, end)
+typedef void (*ce_task_range_fce_t)(uint32_t begin,
+                                    uint32_t end,
+                                    void *data);
+
 //==============================================================================
 // Api
 //==============================================================================
@@ -53,8 +60,27 @@ struct ce_task_a0 {
                 uint32_t count,
                 struct ce_task_counter_t **counter);
 
+    //! Wait for counter and release it
     void (*wait_for_counter)(struct ce_task_counter_t *signal,
                              int32_t value);
+
+    //! Release counter without waiting
+    void (*release_counter)(struct ce_task_counter_t *counter);
+
+    //! Run fce over [0, count) split to ranges of at most grain items.
+    //! \param grain Max items per range, 0 = choose by worker count
+    void (*parallel_for)(uint32_t count,
+                         uint32_t grain,
+                         ce_task_range_fce_t fce,
+                         void *data,
+                         struct ce_task_counter_t **counter);
+
+    //! Add tasks that run when *after* counter hits zero.
+    //! Does not block, *after* still must be waited or released.
+    void (*add_after)(struct ce_task_counter_t *after,
+                      struct ce_task_item *items,
+                      uint32_t count,
+                      struct ce_task_counter_t **counter);
 };
 
 CE_MODULE(ce_task_a0);
@@ -123,6 +123,8 @@ struct ce_ydb_a0 {
 
     void (*save_all_modified)();
 
+    // Drop cached document, next get parse file again.
+    void (*expire)(const char *path);
 };
 
 CE_MODULE(ce_ydb_a0);
@@ -26,12 +26,6 @@
 #define ENTITY_RESOURCE \
     CE_ID64_0("entity_resource", 0xf8623393c111abd5ULL)
 
-#define ENTITY_TYPE \
-    CE_ID64_0("entity_type", 0x61c464fe6c327f9fULL)
-
-#define ENTITY_DATA_IDX  \
-    CE_ID64_0("entity_data_idx", 0x1fa649061369a0eeULL)
-
 #define ENTITY_UID \
     CE_ID64_0("entity_uid", 0xa3b266878c572abdULL)
 
@@ -62,6 +56,7 @@ enum {
 };
 
 struct ct_cdb_obj_t;
+struct ct_ecs_cmd_buffer_t;
 typedef void ct_entity_storage_t;
 
 //==============================================================================
@@ -80,6 +75,29 @@ struct ct_entity {
     uint64_t h;
 };
 
+#define CT_ECS_MAX_COMPONENTS 256
+
+//! Component set, one bit per registered component
+struct ct_component_mask {
+    uint64_t bits[CT_ECS_MAX_COMPONENTS / 64];
+};
+
+//! World memory stats
+struct ct_ecs_world_stats {
+    uint32_t archetype_count;   //!< Archetypes
+    uint32_t chunk_count;       //!< Allocated chunks
+    uint32_t page_count;        //!< Allocated pool pages
+    uint32_t entity_count;      //!< Entities with components
+    uint64_t chunk_size;        //!< Bytes allocated for chunks
+    uint64_t used_size;         //!< Bytes used by entity rows
+    uint64_t index_size;        //!< Bytes used by entity index and archetypes
+};
+
+//! Persistent query, see ct_system_a0.create_query
+struct ct_ecs_query {
+    uint64_t h;
+};
+
 //==============================================================================
 // Structs
 //==============================================================================
@@ -93,6 +111,23 @@ typedef void (*ct_process_fce_t)(struct ct_world world,
 typedef void (*ct_simulate_fce_t)(struct ct_world world,
                                   float dt);
 
+//! System description.
+//! Systems whose written components do not overlap components read or
+//! written by another system run concurrently on task workers.
+//! Concurrent systems must not create/destroy entities or add/remove
+//! components directly, structural changes go through cmd_buffer(world)
+//! and are applied after all systems finish.
+struct ct_system_desc {
+    const char *name;               //!< System name
+    ct_simulate_fce_t simulation;   //!< Simulation fce
+
+    const uint64_t *read;           //!< Read components
+    uint32_t read_count;            //!< Read components count
+
+    const uint64_t *write;          //!< Written components
+    uint32_t write_count;           //!< Written components count
+};
+
 typedef void ce_cdb_obj_o;
 //==============================================================================
 // Api
@@ -118,6 +153,13 @@ struct ct_component_i0 {
 
     void (*spawner)(uint64_t obj,
                     void *data);
+
+    //! Optional batched spawner used by spawn_n. *data* is array of *n*
+    //! components, obj[i] is component object of i-th entity. All objects are
+    //! instances of same prefab object.
+    void (*spawner_n)(const uint64_t *obj,
+                      void *data,
+                      uint32_t n);
 };
 
 struct ct_editor_component_i0 {
@@ -138,7 +180,10 @@ struct ct_editor_component_i0 {
 struct ct_component_a0 {
     struct ct_component_i0 *(*get_interface)(uint64_t name);
 
-    uint64_t (*mask)(uint64_t component_name);
+    struct ct_component_mask (*mask)(uint64_t component_name);
+
+    struct ct_component_mask (*combine_mask)(const uint64_t *component_name,
+                                             uint32_t name_count);
 
     void *(*get_all)(uint64_t component_name,
                      ct_entity_storage_t *item);
@@ -177,6 +222,12 @@ struct ct_entity_a0 {
     struct ct_entity (*spawn)(struct ct_world world,
                               uint64_t name);
 
+    //! Spawn *count* entities from entity resource *name*.
+    void (*spawn_n)(struct ct_world world,
+                    uint64_t name,
+                    uint32_t count,
+                    struct ct_entity *out);
+
 
     bool (*has)(struct ct_world world,
                 struct ct_entity ent,
@@ -185,6 +236,39 @@ struct ct_entity_a0 {
 
     struct ct_entity (*find_by_name)(struct ct_world world,
                                      struct ct_entity ent, uint64_t name);
+
+    void (*world_stats)(struct ct_world world,
+                        struct ct_ecs_world_stats *stats);
+
+    //! Command buffer of world, flushed at end of simulate.
+    struct ct_ecs_cmd_buffer_t *(*cmd_buffer)(struct ct_world world);
+
+    struct ct_ecs_cmd_buffer_t *(*create_cmd_buffer)(struct ct_world world);
+
+    void (*destroy_cmd_buffer)(struct ct_ecs_cmd_buffer_t *buffer);
+
+    //! Apply recorded commands. Call from main thread when no system
+    //! is processing world.
+    void (*flush_cmd_buffer)(struct ct_ecs_cmd_buffer_t *buffer);
+
+    //! Record structural changes. Can be called from main thread and
+    //! task workers.
+    void (*cmd_add)(struct ct_ecs_cmd_buffer_t *buffer,
+                    struct ct_entity ent,
+                    uint64_t *component_name,
+                    uint32_t name_count);
+
+    void (*cmd_remove)(struct ct_ecs_cmd_buffer_t *buffer,
+                       struct ct_entity ent,
+                       uint64_t *component_name,
+                       uint32_t name_count);
+
+    void (*cmd_destroy)(struct ct_ecs_cmd_buffer_t *buffer,
+                        struct ct_entity *entity,
+                        uint32_t count);
+
+    void (*cmd_spawn)(struct ct_ecs_cmd_buffer_t *buffer,
+                      uint64_t name);
 };
 
 struct ct_system_a0 {
@@ -192,12 +276,40 @@ struct ct_system_a0 {
                      float dt);
 
     void (*process)(struct ct_world world,
-                    uint64_t components_mask,
+                    struct ct_component_mask components_mask,
                     ct_process_fce_t fce,
                     void *data);
 
+    //! Same as process but chunks are split among task workers.
+    //! fce must not add/remove components or spawn/destroy entities.
+    void (*process_parallel)(struct ct_world world,
+                             struct ct_component_mask components_mask,
+                             ct_process_fce_t fce,
+                             void *data);
+
+    //! Create persistent query for archetypes with all *include* and none of
+    //! *exclude* components. Matching archetypes are tracked as they are
+    //! created so processing query touches only matching chunks.
+    struct ct_ecs_query (*create_query)(struct ct_component_mask include,
+                                        struct ct_component_mask exclude);
+
+    void (*process_query)(struct ct_world world,
+                          struct ct_ecs_query query,
+                          ct_process_fce_t fce,
+                          void *data);
+
+    void (*process_query_parallel)(struct ct_world world,
+                                   struct ct_ecs_query query,
+                                   ct_process_fce_t fce,
+                                   void *data);
+
+    //! Register simulation that reads/writes anything. Runs on main thread.
     void (*register_simulation)(const char *name,
                                 ct_simulate_fce_t simulation);
+
+    //! Register simulation with declared component access.
+    //! Structural changes only through command buffer, see ct_system_desc.
+    void (*register_system)(const struct ct_system_desc *desc);
 };
 
 struct ct_ecs_a0 {
@@ -3,7 +3,7 @@
 //==============================================================================
 
 #include <stdio.h>
-#include <sys/mman.h>
+#include <stdlib.h>
 
 #include <celib/api_system.h>
 #include <celib/memory.h>
@@ -27,16 +27,97 @@
 // Globals
 //==============================================================================
 
-#define MAX_COMPONENTS 64
-#define MAX_ENTITIES 100000
+#define LOG_WHERE "ecs"
+
+#define MAX_COMPONENTS CT_ECS_MAX_COMPONENTS
+#define MASK_WORDS (MAX_COMPONENTS / 64)
+#define CHUNK_SIZE (16 * 1024)
+#define CHUNK_PAGE_CHUNKS 64
+
+// Entity index page, entity objects are indexed by cdb object index.
+#define ENTITY_PAGE_SHIFT 12
+#define ENTITY_PAGE_MASK ((1U << ENTITY_PAGE_SHIFT) - 1)
+
+// Bump when compiled entity format change.
+#define ENTITY_COMPILER_VERSION 1
 
 #define _G EntityMaagerGlobals
 
-struct entity_storage {
-    uint64_t mask;
+struct entity_storage;
+
+// Fixed-size block of rows for one archetype.
+// Columns (entity, slot, components...) follow the header in the same block.
+struct entity_chunk {
+    struct entity_storage *storage;
     uint32_t n;
+
+    // pool page or UINT32_MAX for chunk bigger than CHUNK_SIZE
+    uint32_t page;
+
     struct ct_entity *entity;
-    uint8_t *entity_data[MAX_COMPONENTS];
+    uint64_t *slot;
+};
+
+// CHUNK_PAGE_CHUNKS chunks, released when all chunks are free.
+struct chunk_page {
+    uint8_t *mem;
+    uint64_t free_mask;
+};
+
+// Chunk memory of one world
+struct chunk_pool {
+    struct chunk_page *pages;
+    uint32_t page_count;
+    uint32_t chunk_count;
+    uint64_t large_size;
+};
+
+// Archetype
+struct entity_storage {
+    struct ct_component_mask mask;
+
+    // next archetype with same mask hash
+    uint32_t next;
+
+    uint32_t chunk_size;
+    uint32_t chunk_capacity;
+    uint32_t row_size;
+
+    struct chunk_pool *pool;
+
+    uint32_t *components;
+    uint32_t offset[MAX_COMPONENTS];
+
+    struct entity_chunk **chunks;
+};
+
+// Entity index entry: entity -> (archetype, chunk, row)
+struct entity_slot {
+    struct ct_entity ent;
+    struct entity_chunk *chunk;
+    uint32_t row;
+};
+
+struct system_info {
+    const char *name;
+    ct_simulate_fce_t simulation;
+
+    // Run alone on main thread
+    bool exclusive;
+
+    uint64_t *read;
+    uint64_t *write;
+
+    struct ct_component_mask read_mask;
+    struct ct_component_mask write_mask;
+};
+
+struct query_info {
+    struct ct_component_mask include;
+    struct ct_component_mask exclude;
+
+    // next query with same include hash and empty exclude
+    uint32_t next;
 };
 
 struct world_instance {
@@ -44,22 +125,43 @@ struct world_instance {
     struct ce_cdb_t db;
 
     // Storage
+    // mask hash -> first archetype idx
     struct ce_hash_t entity_storage_map;
-    struct entity_storage *entity_storage;
+    struct entity_storage **entity_storage;
+
+    // Matching archetypes per query
+    struct entity_storage ***query_storage;
+
+    struct ct_ecs_cmd_buffer_t *cmd_buffer;
+
+    struct chunk_pool *pool;
+
+    // Entity index, pages map entity object index to slot handler + 1.
+    struct ce_handler_t entity_handler;
+    uint64_t **entity_page;
+    struct entity_slot *entity_slot;
 };
 
 static struct _G {
     struct ce_cdb_t db;
 
     // WORLD
-    struct ce_hash_t world_map;
     struct ce_handler_t world_handler;
     struct world_instance *world_array;
 
-    ct_simulate_fce_t *simulations;
+    struct system_info *systems;
+    uint32_t systems_component_count;
+
+    // include hash -> first query idx, only queries without exclude
+    // Systems can create query while other systems run, guard queries and
+    // query_storage of worlds.
+    struct query_info *queries;
+    struct ce_hash_t query_map;
+    struct ce_spinlock query_lock;
 
     uint32_t component_count;
     struct ce_hash_t component_types;
+    uint64_t component_size[MAX_COMPONENTS];
 
     uint64_t *components_name;
     struct ce_hash_t component_interface_map;
@@ -67,19 +169,6 @@ static struct _G {
     struct ce_alloc *allocator;
 } _G;
 
-static void *virtual_alloc(uint64_t size) {
-    return mmap(NULL,
-                size,
-                PROT_READ | PROT_WRITE,
-                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-}
-
-//static void virtual_free(void* ptr, uint64_t size) {
-//    munmap(ptr, size);
-//}
-
-
-
 static struct ct_component_i0 *get_interface(uint64_t name) {
     return (struct ct_component_i0 *) ce_hash_lookup(
             &_G.component_interface_map, name, 0);
@@ -102,13 +191,11 @@ static int compile(uint64_t type,
 
 
 static struct world_instance *get_world_instance(struct ct_world world) {
-    uint64_t idx = ce_hash_lookup(&_G.world_map, world.h, UINT64_MAX);
-
-    if (UINT64_MAX == idx) {
+    if (!ce_handler_alive(&_G.world_handler, world.h)) {
         return NULL;
     }
 
-    return &_G.world_array[idx];
+    return &_G.world_array[_idx(world.h)];
 }
 
 
@@ -116,347 +203,1104 @@ const uint64_t *component_names() {
     return _G.components_name;
 }
 
-static uint64_t component_mask(uint64_t name) {
-    return (uint64_t) (1llu << ce_hash_lookup(&_G.component_types, name, 0));
+//==============================================================================
+// Component mask
+//==============================================================================
+
+// Whole mask in one vector, compiler emits SIMD ops when target supports it.
+typedef uint64_t mask_vec_t __attribute__((vector_size(sizeof(struct ct_component_mask))));
+
+#define _MASK_LOAD(v, mask) \
+    mask_vec_t v; memcpy(&v, (mask), sizeof(v))
+
+static inline bool _mask_has(const struct ct_component_mask *mask,
+                             uint32_t comp_idx) {
+    return (mask->bits[comp_idx >> 6] & (1llu << (comp_idx & 63))) != 0;
+}
+
+static inline void _mask_set(struct ct_component_mask *mask,
+                             uint32_t comp_idx) {
+    mask->bits[comp_idx >> 6] |= (1llu << (comp_idx & 63));
+}
+
+static inline bool _mask_empty(const struct ct_component_mask *mask) {
+    uint64_t any = 0;
+    for (int i = 0; i < MASK_WORDS; ++i) {
+        any |= mask->bits[i];
+    }
+    return !any;
+}
+
+// All components from sub are in mask
+static inline bool _mask_contains(const struct ct_component_mask *mask,
+                                  const struct ct_component_mask *sub) {
+    _MASK_LOAD(a, mask);
+    _MASK_LOAD(b, sub);
+
+    struct ct_component_mask r;
+    mask_vec_t v = b & ~a;
+    memcpy(&r, &v, sizeof(r));
+    return _mask_empty(&r);
+}
+
+static inline bool _mask_intersect(const struct ct_component_mask *m1,
+                                   const struct ct_component_mask *m2) {
+    _MASK_LOAD(a, m1);
+    _MASK_LOAD(b, m2);
+
+    struct ct_component_mask r;
+    mask_vec_t v = a & b;
+    memcpy(&r, &v, sizeof(r));
+    return !_mask_empty(&r);
+}
+
+static inline bool _mask_equal(const struct ct_component_mask *m1,
+                               const struct ct_component_mask *m2) {
+    _MASK_LOAD(a, m1);
+    _MASK_LOAD(b, m2);
+
+    struct ct_component_mask r;
+    mask_vec_t v = a ^ b;
+    memcpy(&r, &v, sizeof(r));
+    return _mask_empty(&r);
+}
+
+static inline struct ct_component_mask _mask_or(struct ct_component_mask m1,
+                                                struct ct_component_mask m2) {
+    _MASK_LOAD(a, &m1);
+    _MASK_LOAD(b, &m2);
+
+    mask_vec_t v = a | b;
+    memcpy(&m1, &v, sizeof(v));
+    return m1;
+}
+
+static inline struct ct_component_mask _mask_andnot(struct ct_component_mask m1,
+                                                    struct ct_component_mask m2) {
+    _MASK_LOAD(a, &m1);
+    _MASK_LOAD(b, &m2);
+
+    mask_vec_t v = a & ~b;
+    memcpy(&m1, &v, sizeof(v));
+    return m1;
+}
+
+static inline uint64_t _mask_hash(const struct ct_component_mask *mask) {
+    return ce_hash_murmur2_64(mask, sizeof(struct ct_component_mask), 0);
 }
 
 static uint64_t component_idx(uint64_t component_name) {
     return ce_hash_lookup(&_G.component_types, component_name, UINT64_MAX);
 }
 
+static struct ct_component_mask combine_component(const uint64_t *component_name,
+                                                  uint32_t name_count) {
+    struct ct_component_mask mask = {};
+    for (int i = 0; i < name_count; ++i) {
+        uint64_t comp_idx = component_idx(component_name[i]);
+
+        if (UINT64_MAX == comp_idx) {
+            continue;
+        }
+
+        _mask_set(&mask, comp_idx);
+    }
+
+    return mask;
+}
+
+static struct ct_component_mask component_mask(uint64_t name) {
+    return combine_component(&name, 1);
+}
+
+static uint8_t *_component_data(struct entity_chunk *chunk,
+                                uint32_t comp_idx,
+                                uint32_t row) {
+    return ((uint8_t *) chunk) + chunk->storage->offset[comp_idx] +
+           (_G.component_size[comp_idx] * row);
+}
+
 static void *get_all(uint64_t component_name,
                      ct_entity_storage_t *_item) {
-    struct entity_storage *item = _item;
-    uint64_t com_mask = component_mask(component_name);
+    struct entity_chunk *chunk = _item;
+
+    uint64_t comp_idx = component_idx(component_name);
+    if (UINT64_MAX == comp_idx) {
+        return NULL;
+    }
 
-    if (!(com_mask & item->mask)) {
+    if (!_mask_has(&chunk->storage->mask, comp_idx)) {
         return NULL;
     }
 
-    uint32_t comp_idx = component_idx(component_name);
-    return item->entity_data[comp_idx];
+    return ((uint8_t *) chunk) + chunk->storage->offset[comp_idx];
 }
 
-static void *get_one(struct ct_world world,
-                     uint64_t component_name,
-                     struct ct_entity entity) {
-    if (!entity.h) {
-        return NULL;
+//==============================================================================
+// Entity index
+//==============================================================================
+
+// Index entry of entity, missing page is created only if *create*.
+static uint64_t *_entity_ref(struct world_instance *w,
+                             struct ct_entity ent,
+                             bool create) {
+    const uint32_t idx = ce_cdb_a0->obj_index(ent.h);
+    const uint32_t page = idx >> ENTITY_PAGE_SHIFT;
+
+    const uint32_t page_n = ce_array_size(w->entity_page);
+    if (page >= page_n) {
+        if (!create) {
+            return NULL;
+        }
+
+        ce_array_resize(w->entity_page, page + 1, _G.allocator);
+        memset(w->entity_page + page_n, 0,
+               sizeof(uint64_t *) * (page + 1 - page_n));
     }
 
-    struct world_instance *w = get_world_instance(world);
-    uint64_t ent_type = ce_cdb_a0->read_uint64(entity.h, ENTITY_TYPE, 0);
+    if (!w->entity_page[page]) {
+        if (!create) {
+            return NULL;
+        }
 
-    uint64_t type_idx = ce_hash_lookup(&w->entity_storage_map,
-                                       ent_type, UINT64_MAX);
+        w->entity_page[page] = CE_ALLOC(_G.allocator, uint64_t,
+                                        sizeof(uint64_t) << ENTITY_PAGE_SHIFT);
+        memset(w->entity_page[page], 0, sizeof(uint64_t) << ENTITY_PAGE_SHIFT);
+    }
 
-    if (UINT64_MAX == type_idx) {
-        return NULL;
+    return &w->entity_page[page][idx & ENTITY_PAGE_MASK];
+}
+
+static uint64_t _new_slot(struct world_instance *w,
+                          struct ct_entity ent) {
+    uint64_t h = ce_handler_create(&w->entity_handler, _G.allocator);
+
+    const uint32_t idx = _idx(h);
+    if (idx >= ce_array_size(w->entity_slot)) {
+        ce_array_resize(w->entity_slot, idx + 1, _G.allocator);
     }
 
-    uint64_t com_mask = component_mask(component_name);
+    w->entity_slot[idx] = (struct entity_slot) {.ent = ent};
+    *_entity_ref(w, ent, true) = h + 1;
 
-    if (!(com_mask & ent_type)) {
-        return NULL;
+    return h;
+}
+
+// Object index is reused after entity object is freed, so slot must belong
+// to same entity.
+static uint64_t _slot_handler(struct world_instance *w,
+                              struct ct_entity ent) {
+    const uint64_t *ref = _entity_ref(w, ent, false);
+    if (!ref || !*ref) {
+        return UINT64_MAX;
+    }
+
+    const uint64_t h = *ref - 1;
+    if (!ce_handler_alive(&w->entity_handler, h) ||
+        (w->entity_slot[_idx(h)].ent.h != ent.h)) {
+        return UINT64_MAX;
     }
 
-    struct ct_component_i0 *component_i = get_interface(component_name);
+    return h;
+}
+
+static struct entity_slot *_get_slot(struct world_instance *w,
+                                     struct ct_entity ent) {
+    uint64_t h = _slot_handler(w, ent);
+
+    if (UINT64_MAX == h) {
+        return NULL;
+    }
 
-    uint64_t com_idx = component_idx(component_name);
-    struct entity_storage *item = &w->entity_storage[type_idx];
-    void *comp_data = item->entity_data[com_idx];
+    return &w->entity_slot[_idx(h)];
+}
 
-    uint64_t entity_data_idx;
-    entity_data_idx = ce_cdb_a0->read_uint64(entity.h, ENTITY_DATA_IDX, 0);
+//==============================================================================
+// Query
+//==============================================================================
 
-    return comp_data + (component_i->size() * entity_data_idx);
+static bool _query_match(const struct query_info *query,
+                         const struct entity_storage *storage) {
+    return _mask_contains(&storage->mask, &query->include) &&
+           !_mask_intersect(&storage->mask, &query->exclude);
 }
 
-static void _remove_from_type_slot(struct world_instance *w,
-                                   struct ct_entity ent,
-                                   uint64_t ent_type) {
-    uint64_t type_idx = ce_hash_lookup(&w->entity_storage_map,
-                                       ent_type, UINT64_MAX);
+static void _query_add_storage(struct world_instance *w,
+                               struct entity_storage *storage) {
+    ce_os_a0->thread->spin_lock(&_G.query_lock);
 
-    if (UINT64_MAX != type_idx) {
-        struct entity_storage *item = &w->entity_storage[type_idx];
+    const uint32_t query_n = ce_array_size(w->query_storage);
+    for (int i = 0; i < query_n; ++i) {
+        if (!_query_match(&_G.queries[i], storage)) {
+            continue;
+        }
 
-        uint64_t entity_data_idx;
-        entity_data_idx = ce_cdb_a0->read_uint64(ent.h, ENTITY_DATA_IDX, 0);
+        ce_array_push(w->query_storage[i], storage, _G.allocator);
+    }
 
-        uint32_t last_idx = item->n - 1;
+    ce_os_a0->thread->spin_unlock(&_G.query_lock);
+}
 
-        ce_cdb_obj_o *ent_w = ce_cdb_a0->write_begin(item->entity[last_idx].h);
-        ce_cdb_a0->set_uint64(ent_w, ENTITY_DATA_IDX, entity_data_idx);
-        ce_cdb_a0->write_commit(ent_w);
+// Call with query lock
+static void _query_fill_world(struct world_instance *w) {
+    const uint32_t query_n = ce_array_size(_G.queries);
+    uint32_t world_query_n = ce_array_size(w->query_storage);
 
-        const uint32_t component_n = ce_array_size(_G.components_name);
-        for (int i = 0; i < component_n; ++i) {
-            uint64_t component_name = _G.components_name[i];
+    ce_array_resize(w->query_storage, query_n, _G.allocator);
 
-            const uint32_t comp_idx = component_idx(component_name);
+    const uint32_t type_count = ce_array_size(w->entity_storage);
+    for (; world_query_n < query_n; ++world_query_n) {
+        w->query_storage[world_query_n] = NULL;
 
-            if (!item->entity_data[comp_idx]) {
+        for (int i = 0; i < type_count; ++i) {
+            struct entity_storage *storage = w->entity_storage[i];
+
+            if (!_query_match(&_G.queries[world_query_n], storage)) {
                 continue;
             }
 
-            struct ct_component_i0 *component_i = get_interface(component_name);
-            uint64_t size = component_i->size();
+            ce_array_push(w->query_storage[world_query_n], storage,
+                          _G.allocator);
+        }
+    }
+}
+
+// Storages are added only by structural changes, which run on main thread.
+static struct entity_storage **_query_storages(struct world_instance *w,
+                                               struct ct_ecs_query query) {
+    CE_ASSERT(LOG_WHERE, query.h);
+
+    ce_os_a0->thread->spin_lock(&_G.query_lock);
+    struct entity_storage **storages = w->query_storage[query.h - 1];
+    ce_os_a0->thread->spin_unlock(&_G.query_lock);
+
+    return storages;
+}
+
+// Call with query lock, all worlds get matching storages.
+static struct ct_ecs_query _create_query(struct ct_component_mask include,
+                                         struct ct_component_mask exclude) {
+    struct query_info query = {
+            .include = include,
+            .exclude = exclude,
+            .next = UINT32_MAX,
+    };
+
+    ce_array_push(_G.queries, query, _G.allocator);
+
+    const uint32_t world_n = ce_array_size(_G.world_array);
+    for (uint32_t i = 0; i < world_n; ++i) {
+        if (!_G.world_array[i].world.h) {
+            continue;
+        }
+
+        _query_fill_world(&_G.world_array[i]);
+    }
+
+    return (struct ct_ecs_query) {.h = ce_array_size(_G.queries)};
+}
+
+static struct ct_ecs_query create_query(struct ct_component_mask include,
+                                        struct ct_component_mask exclude) {
+    ce_os_a0->thread->spin_lock(&_G.query_lock);
+    struct ct_ecs_query query = _create_query(include, exclude);
+    ce_os_a0->thread->spin_unlock(&_G.query_lock);
+
+    return query;
+}
+
+// Query for process(mask), created on first use.
+static struct ct_ecs_query _query_for_mask(const struct ct_component_mask *mask) {
+    const uint64_t hash = _mask_hash(mask);
+
+    ce_os_a0->thread->spin_lock(&_G.query_lock);
+
+    uint64_t query_idx = ce_hash_lookup(&_G.query_map, hash, UINT64_MAX);
 
-            memcpy(item->entity_data[i] + (entity_data_idx * size),
-                   item->entity_data[i] + (last_idx * size), size);
+    uint32_t last_idx = UINT32_MAX;
+    while (UINT64_MAX != query_idx) {
+        struct query_info *query = &_G.queries[query_idx];
+
+        if (_mask_equal(&query->include, mask) &&
+            _mask_empty(&query->exclude)) {
+            ce_os_a0->thread->spin_unlock(&_G.query_lock);
+            return (struct ct_ecs_query) {.h = query_idx + 1};
         }
 
-        item->n = item->n - 1;
+        last_idx = query_idx;
+        query_idx = (UINT32_MAX == query->next) ? UINT64_MAX : query->next;
+    }
+
+    struct ct_ecs_query query = _create_query(*mask,
+                                              (struct ct_component_mask) {});
+
+    if (UINT32_MAX == last_idx) {
+        ce_hash_add(&_G.query_map, hash, query.h - 1, _G.allocator);
+    } else {
+        _G.queries[last_idx].next = query.h - 1;
     }
+
+    ce_os_a0->thread->spin_unlock(&_G.query_lock);
+
+    return query;
 }
 
+//==============================================================================
+// Archetype storage
+//==============================================================================
 
-static void _add_to_type_slot(struct world_instance *w,
-                              struct ct_entity ent,
-                              uint64_t ent_type) {
-    uint64_t type_idx = ce_hash_lookup(&w->entity_storage_map, ent_type,
+static struct entity_storage *_get_storage(struct world_instance *w,
+                                           const struct ct_component_mask *mask) {
+    const uint64_t hash = _mask_hash(mask);
+
+    uint64_t type_idx = ce_hash_lookup(&w->entity_storage_map, hash,
                                        UINT64_MAX);
 
-    if (UINT64_MAX == type_idx) {
-        struct entity_storage storage = {
-                .mask=ent_type,
-                .n = 1,
-        };
-        ce_array_push(w->entity_storage, storage, _G.allocator);
+    uint32_t last_idx = UINT32_MAX;
+    while (UINT64_MAX != type_idx) {
+        struct entity_storage *storage = w->entity_storage[type_idx];
 
-        type_idx = ce_array_size(w->entity_storage) - 1;
-        ce_hash_add(&w->entity_storage_map, ent_type, type_idx, _G.allocator);
+        if (_mask_equal(&storage->mask, mask)) {
+            return storage;
+        }
 
-        struct entity_storage *item = &w->entity_storage[type_idx];
-        ce_array_push(item->entity, (struct ct_entity) {0}, _G.allocator);
+        last_idx = type_idx;
+        type_idx = (UINT32_MAX == storage->next) ? UINT64_MAX : storage->next;
+    }
 
+    struct entity_storage *storage = CE_ALLOC(_G.allocator,
+                                              struct entity_storage,
+                                              sizeof(struct entity_storage));
 
-        const uint32_t component_n = ce_array_size(_G.components_name);
-        for (int i = 0; i < component_n; ++i) {
-            uint64_t component_name = _G.components_name[i];
+    *storage = (struct entity_storage) {
+            .mask = *mask,
+            .next = UINT32_MAX,
+            .pool = w->pool,
+    };
 
-            const uint32_t comp_idx = component_idx(component_name);
+    // entity + slot
+    uint32_t columns = 2;
+    uint64_t row_size = sizeof(struct ct_entity) + sizeof(uint64_t);
 
-            struct ct_component_i0 *component_i = get_interface(component_name);
-            uint64_t size = component_i->size();
+    for (uint32_t i = 0; i < _G.component_count; ++i) {
+        if (!_mask_has(mask, i)) {
+            continue;
+        }
 
-            uint64_t mask = (1llu << comp_idx);
-            if (!(ent_type & mask)) {
-                continue;
+        ce_array_push(storage->components, i, _G.allocator);
+
+        row_size += _G.component_size[i];
+        ++columns;
+    }
+
+    const uint32_t header_size = CE_ALIGN_16(sizeof(struct entity_chunk));
+    const uint32_t padding = columns * 16;
+
+    uint32_t capacity = 1;
+    if (CHUNK_SIZE > (header_size + padding + row_size)) {
+        capacity = (CHUNK_SIZE - header_size - padding) / row_size;
+    }
+
+    uint32_t offset = header_size;
+    offset = CE_ALIGN_16(offset + (capacity * sizeof(struct ct_entity)));
+    offset = CE_ALIGN_16(offset + (capacity * sizeof(uint64_t)));
+
+    const uint32_t component_n = ce_array_size(storage->components);
+    for (uint32_t i = 0; i < component_n; ++i) {
+        const uint32_t comp_idx = storage->components[i];
+
+        storage->offset[comp_idx] = offset;
+        offset = CE_ALIGN_16(offset + (capacity * _G.component_size[comp_idx]));
+    }
+
+    storage->chunk_capacity = capacity;
+    storage->chunk_size = offset;
+    storage->row_size = row_size;
+
+    type_idx = ce_array_size(w->entity_storage);
+    ce_array_push(w->entity_storage, storage, _G.allocator);
+
+    if (UINT32_MAX == last_idx) {
+        ce_hash_add(&w->entity_storage_map, hash, type_idx, _G.allocator);
+    } else {
+        w->entity_storage[last_idx]->next = type_idx;
+    }
+
+    _query_add_storage(w, storage);
+
+    return storage;
+}
+
+//==============================================================================
+// Chunk pool
+//==============================================================================
+
+static void *_pool_alloc(struct chunk_pool *pool,
+                         uint32_t size,
+                         uint32_t *page_idx) {
+    ++pool->chunk_count;
+
+    if (size > CHUNK_SIZE) {
+        pool->large_size += size;
+        *page_idx = UINT32_MAX;
+        return CE_ALLOCATE_ALIGN(_G.allocator, uint8_t, size, 64);
+    }
+
+    uint32_t empty_idx = UINT32_MAX;
+
+    const uint32_t page_n = ce_array_size(pool->pages);
+    for (uint32_t i = 0; i < page_n; ++i) {
+        struct chunk_page *page = &pool->pages[i];
+
+        if (!page->mem) {
+            if (UINT32_MAX == empty_idx) {
+                empty_idx = i;
             }
+            continue;
+        }
 
-            item->entity_data[i] = virtual_alloc(MAX_ENTITIES * size);
+        if (!page->free_mask) {
+            continue;
         }
 
+        const uint32_t chunk_idx = __builtin_ctzll(page->free_mask);
+        page->free_mask &= ~(1llu << chunk_idx);
+
+        *page_idx = i;
+        return page->mem + (chunk_idx * CHUNK_SIZE);
+    }
+
+    if (UINT32_MAX == empty_idx) {
+        empty_idx = page_n;
+        ce_array_push(pool->pages, (struct chunk_page) {}, _G.allocator);
+    }
+
+    struct chunk_page *page = &pool->pages[empty_idx];
+
+    *page = (struct chunk_page) {
+            .mem = CE_ALLOCATE_ALIGN(_G.allocator, uint8_t,
+                                     CHUNK_PAGE_CHUNKS * CHUNK_SIZE, 64),
+            .free_mask = ~1llu,
+    };
+
+    ++pool->page_count;
+
+    *page_idx = empty_idx;
+    return page->mem;
+}
+
+static void _pool_free(struct chunk_pool *pool,
+                       struct entity_chunk *chunk) {
+    --pool->chunk_count;
+
+    if (UINT32_MAX == chunk->page) {
+        pool->large_size -= chunk->storage->chunk_size;
+        CE_FREE(_G.allocator, chunk);
+        return;
     }
 
-    struct entity_storage *item = &w->entity_storage[type_idx];
+    struct chunk_page *page = &pool->pages[chunk->page];
+
+    const uint32_t chunk_idx = (((uint8_t *) chunk) - page->mem) / CHUNK_SIZE;
+    page->free_mask |= (1llu << chunk_idx);
+
+    if (UINT64_MAX == page->free_mask) {
+        CE_FREE(_G.allocator, page->mem);
+        *page = (struct chunk_page) {};
+
+        --pool->page_count;
+    }
+}
+
+static void _pool_destroy(struct chunk_pool *pool) {
+    const uint32_t page_n = ce_array_size(pool->pages);
+    for (uint32_t i = 0; i < page_n; ++i) {
+        CE_FREE(_G.allocator, pool->pages[i].mem);
+    }
+
+    ce_array_free(pool->pages, _G.allocator);
+    CE_FREE(_G.allocator, pool);
+}
+
+static struct entity_chunk *_new_chunk(struct entity_storage *storage) {
+    uint32_t page = 0;
+    struct entity_chunk *chunk = _pool_alloc(storage->pool,
+                                             storage->chunk_size, &page);
+
+    const uint32_t header_size = CE_ALIGN_16(sizeof(struct entity_chunk));
+    const uint32_t entity_size = storage->chunk_capacity *
+                                 sizeof(struct ct_entity);
+
+    *chunk = (struct entity_chunk) {
+            .storage = storage,
+            .page = page,
+            .entity = (struct ct_entity *) (((uint8_t *) chunk) + header_size),
+            .slot = (uint64_t *) (((uint8_t *) chunk) +
+                                  CE_ALIGN_16(header_size + entity_size)),
+    };
+
+    ce_array_push(storage->chunks, chunk, _G.allocator);
 
-    const uint64_t ent_data_idx = item->n++;
+    return chunk;
+}
 
-    ce_cdb_obj_o *ent_w = ce_cdb_a0->write_begin(ent.h);
-    ce_cdb_a0->set_uint64(ent_w, ENTITY_TYPE, ent_type);
-    ce_cdb_a0->set_uint64(ent_w, ENTITY_DATA_IDX, ent_data_idx);
-    ce_cdb_a0->write_commit(ent_w);
+// Last chunk if it has free row or new one.
+static struct entity_chunk *_tail_chunk(struct entity_storage *storage) {
+    const uint32_t chunk_n = ce_array_size(storage->chunks);
 
-    ce_array_push(item->entity, ent, _G.allocator);
+    struct entity_chunk *chunk = chunk_n ? storage->chunks[chunk_n - 1] : NULL;
+    if (!chunk || (chunk->n == storage->chunk_capacity)) {
+        chunk = _new_chunk(storage);
+    }
 
-    const uint32_t component_n = ce_array_size(_G.components_name);
-    for (int i = 0; i < component_n; ++i) {
-        uint64_t component_name = _G.components_name[i];
+    return chunk;
+}
 
-        const uint32_t comp_idx = component_idx(component_name);
+// Copy components of dst archetype that src archetype has too.
+static void _copy_common(struct entity_chunk *dst,
+                         uint32_t dst_row,
+                         struct entity_chunk *src,
+                         uint32_t src_row) {
+    struct entity_storage *storage = dst->storage;
+    const struct ct_component_mask *src_type = &src->storage->mask;
 
-        struct ct_component_i0 *component_i = get_interface(component_name);
-        uint64_t size = component_i->size();
+    const uint32_t component_n = ce_array_size(storage->components);
+    for (uint32_t i = 0; i < component_n; ++i) {
+        const uint32_t comp_idx = storage->components[i];
 
-        uint64_t mask = (1llu << comp_idx);
-        if (!(ent_type & mask)) {
+        if (!_mask_has(src_type, comp_idx)) {
             continue;
         }
 
-        memset(item->entity_data[i] + (size * ent_data_idx), 0, size);
+        memcpy(_component_data(dst, comp_idx, dst_row),
+               _component_data(src, comp_idx, src_row),
+               _G.component_size[comp_idx]);
     }
 }
 
-static void _move_from_type_slot(struct world_instance *w,
-                                 struct ct_entity ent,
-                                 uint64_t ent_type,
-                                 uint64_t new_type) {
+static void _add_row(struct entity_storage *storage,
+                     struct entity_slot *slot,
+                     uint64_t slot_h) {
+    struct entity_chunk *chunk = _tail_chunk(storage);
 
-    uint64_t type_idx = ce_hash_lookup(&w->entity_storage_map, ent_type,
-                                       UINT64_MAX);
+    const uint32_t row = chunk->n++;
 
-    uint64_t new_type_idx = ce_hash_lookup(&w->entity_storage_map, new_type,
-                                           UINT64_MAX);
+    chunk->entity[row] = slot->ent;
+    chunk->slot[row] = slot_h;
 
-    struct entity_storage *item = &w->entity_storage[type_idx];
-    struct entity_storage *new_item = &w->entity_storage[new_type_idx];
+    const uint32_t component_n = ce_array_size(storage->components);
+    for (uint32_t i = 0; i < component_n; ++i) {
+        const uint32_t comp_idx = storage->components[i];
 
-    uint32_t idx = ce_cdb_a0->read_uint64(ent.h, ENTITY_DATA_IDX, 0);
+        memset(_component_data(chunk, comp_idx, row), 0,
+               _G.component_size[comp_idx]);
+    }
 
-    const uint32_t component_n = ce_array_size(_G.components_name);
-    for (int i = 0; i < component_n; ++i) {
-        uint64_t component_name = _G.components_name[i];
+    slot->chunk = chunk;
+    slot->row = row;
+}
 
-        const uint32_t comp_idx = component_idx(component_name);
+// Swap-remove row with the last row of the archetype so chunks stay dense.
+static void _remove_row(struct world_instance *w,
+                        struct entity_chunk *chunk,
+                        uint32_t row) {
+    struct entity_storage *storage = chunk->storage;
 
-        struct ct_component_i0 *component_i = get_interface(component_name);
-        uint64_t size = component_i->size();
+    struct entity_chunk *last_chunk = ce_array_back(storage->chunks);
+    const uint32_t last_row = last_chunk->n - 1;
 
-        uint64_t mask = (1llu << comp_idx);
-        if (!(ent_type & mask)) {
-            continue;
+    if ((last_chunk != chunk) || (last_row != row)) {
+        chunk->entity[row] = last_chunk->entity[last_row];
+        chunk->slot[row] = last_chunk->slot[last_row];
+
+        const uint32_t component_n = ce_array_size(storage->components);
+        for (uint32_t i = 0; i < component_n; ++i) {
+            const uint32_t comp_idx = storage->components[i];
+
+            memcpy(_component_data(chunk, comp_idx, row),
+                   _component_data(last_chunk, comp_idx, last_row),
+                   _G.component_size[comp_idx]);
         }
 
-        if (!(new_type & mask)) {
-            continue;
+        struct entity_slot *moved = &w->entity_slot[_idx(chunk->slot[row])];
+        moved->chunk = chunk;
+        moved->row = row;
+    }
+
+    last_chunk->n -= 1;
+
+    if (!last_chunk->n) {
+        ce_array_pop_back(storage->chunks);
+        _pool_free(storage->pool, last_chunk);
+    }
+}
+
+// Move entity to archetype *new_type* and copy components present in both.
+static void _set_type(struct world_instance *w,
+                      struct ct_entity ent,
+                      const struct ct_component_mask *new_type) {
+    uint64_t h = _slot_handler(w, ent);
+    if (UINT64_MAX == h) {
+        h = _new_slot(w, ent);
+    }
+
+    struct entity_slot *slot = &w->entity_slot[_idx(h)];
+
+    struct entity_chunk *old_chunk = slot->chunk;
+    const uint32_t old_row = slot->row;
+
+    if (!old_chunk && _mask_empty(new_type)) {
+        return;
+    }
+
+    if (old_chunk && _mask_equal(&old_chunk->storage->mask, new_type)) {
+        return;
+    }
+
+    if (_mask_empty(new_type)) {
+        _remove_row(w, old_chunk, old_row);
+        slot->chunk = NULL;
+        slot->row = 0;
+        return;
+    }
+
+    struct entity_storage *storage = _get_storage(w, new_type);
+    _add_row(storage, slot, h);
+
+    if (!old_chunk) {
+        return;
+    }
+
+    _copy_common(slot->chunk, slot->row, old_chunk, old_row);
+    _remove_row(w, old_chunk, old_row);
+}
+
+// Move entities to archetype *storage*. Rows are appended chunk by chunk
+// and new columns are cleared for whole chunk range at once.
+static void _move_rows(struct world_instance *w,
+                       struct entity_storage *storage,
+                       const uint64_t *slot_h,
+                       uint32_t n) {
+    const uint32_t component_n = ce_array_size(storage->components);
+
+    uint32_t done = 0;
+    while (done < n) {
+        struct entity_chunk *chunk = _tail_chunk(storage);
+
+        const uint32_t first_row = chunk->n;
+
+        uint32_t count = storage->chunk_capacity - first_row;
+        if (count > (n - done)) {
+            count = n - done;
+        }
+
+        for (uint32_t i = 0; i < component_n; ++i) {
+            const uint32_t comp_idx = storage->components[i];
+
+            memset(_component_data(chunk, comp_idx, first_row), 0,
+                   _G.component_size[comp_idx] * count);
+        }
+
+        for (uint32_t i = 0; i < count; ++i) {
+            const uint64_t h = slot_h[done + i];
+            const uint32_t row = first_row + i;
+
+            struct entity_slot *slot = &w->entity_slot[_idx(h)];
+
+            struct entity_chunk *old_chunk = slot->chunk;
+            const uint32_t old_row = slot->row;
+
+            chunk->entity[row] = slot->ent;
+            chunk->slot[row] = h;
+            chunk->n = row + 1;
+
+            slot->chunk = chunk;
+            slot->row = row;
+
+            if (old_chunk) {
+                _copy_common(chunk, row, old_chunk, old_row);
+                _remove_row(w, old_chunk, old_row);
+            }
         }
 
-        memcpy(new_item->entity_data[i] + (idx * size),
-               item->entity_data[i] + (idx * size), size);
+        done += count;
+    }
+}
+
+static void _destroy_slot(struct world_instance *w,
+                          struct ct_entity ent) {
+    uint64_t h = _slot_handler(w, ent);
+    if (UINT64_MAX == h) {
+        return;
+    }
+
+    struct entity_slot *slot = &w->entity_slot[_idx(h)];
+    if (slot->chunk) {
+        _remove_row(w, slot->chunk, slot->row);
+    }
+
+    *slot = (struct entity_slot) {};
+
+    *_entity_ref(w, ent, false) = 0;
+    ce_handler_destroy(&w->entity_handler, h, _G.allocator);
+}
+
+static void *get_one(struct ct_world world,
+                     uint64_t component_name,
+                     struct ct_entity entity) {
+    if (!entity.h) {
+        return NULL;
+    }
+
+    struct world_instance *w = get_world_instance(world);
+    if (!w) {
+        return NULL;
+    }
+
+    struct entity_slot *slot = _get_slot(w, entity);
+    if (!slot || !slot->chunk) {
+        return NULL;
+    }
+
+    uint64_t comp_idx = component_idx(component_name);
+    if (UINT64_MAX == comp_idx) {
+        return NULL;
+    }
+
+    if (!_mask_has(&slot->chunk->storage->mask, comp_idx)) {
+        return NULL;
+    }
+
+    return _component_data(slot->chunk, comp_idx, slot->row);
+}
+
+static struct ct_component_mask _entity_type(struct world_instance *w,
+                                             struct ct_entity ent) {
+    struct entity_slot *slot = _get_slot(w, ent);
+
+    if (!slot || !slot->chunk) {
+        return (struct ct_component_mask) {};
     }
 
+    return slot->chunk->storage->mask;
 }
 
 static bool has(struct ct_world world,
                 struct ct_entity ent,
                 uint64_t *component_name,
                 uint32_t name_count) {
-    uint64_t ent_type = ce_cdb_a0->read_uint64(ent.h, ENTITY_TYPE, 0);
+    struct world_instance *w = get_world_instance(world);
+    struct ct_component_mask ent_type = _entity_type(w, ent);
 
-    uint64_t mask = 0;
-    for (int i = 0; i < name_count; ++i) {
-        mask |= (1 << ce_hash_lookup(&_G.component_types,
-                                     component_name[i], 0));
+    struct ct_component_mask mask = combine_component(component_name,
+                                                      name_count);
+
+    return _mask_contains(&ent_type, &mask);
+}
+
+static void add_components(struct ct_world world,
+                           struct ct_entity ent,
+                           uint64_t *component_name,
+                           uint32_t name_count) {
+    struct world_instance *w = get_world_instance(world);
+
+    struct ct_component_mask ent_type = _entity_type(w, ent);
+    struct ct_component_mask new_type = combine_component(component_name,
+                                                          name_count);
+
+    new_type = _mask_or(ent_type, new_type);
+    _set_type(w, ent, &new_type);
+}
+
+static void remove_components(struct ct_world world,
+                              struct ct_entity ent,
+                              uint64_t *component_name,
+                              uint32_t name_count) {
+    struct world_instance *w = get_world_instance(world);
+
+    struct ct_component_mask ent_type = _entity_type(w, ent);
+    struct ct_component_mask new_type = combine_component(component_name,
+                                                          name_count);
+
+    new_type = _mask_andnot(ent_type, new_type);
+    _set_type(w, ent, &new_type);
+}
+
+static void register_simulation(const char *name,
+                                ct_simulate_fce_t simulation) {
+    struct system_info system = {
+            .name = name,
+            .simulation = simulation,
+            .exclusive = true,
+    };
+
+    ce_array_push(_G.systems, system, _G.allocator);
+}
+
+static void register_system(const struct ct_system_desc *desc) {
+    struct system_info system = {
+            .name = desc->name,
+            .simulation = desc->simulation,
+    };
+
+    ce_array_push_n(system.read, desc->read, desc->read_count, _G.allocator);
+    ce_array_push_n(system.write, desc->write, desc->write_count,
+                    _G.allocator);
+
+    ce_array_push(_G.systems, system, _G.allocator);
+
+    // force mask resolve
+    _G.systems_component_count = UINT32_MAX;
+}
+
+// Components can be registered after systems so masks are resolved lazily.
+static void _resolve_system_masks() {
+    if (_G.systems_component_count == _G.component_count) {
+        return;
+    }
+
+    const uint32_t systems_n = ce_array_size(_G.systems);
+    for (int i = 0; i < systems_n; ++i) {
+        struct system_info *system = &_G.systems[i];
+
+        system->read_mask = combine_component(system->read,
+                                              ce_array_size(system->read));
+
+        system->write_mask = combine_component(system->write,
+                                               ce_array_size(system->write));
+
+        // Create queries before systems run in parallel.
+        struct ct_component_mask mask = _mask_or(system->read_mask,
+                                                 system->write_mask);
+        if (!_mask_empty(&mask)) {
+            _query_for_mask(&mask);
+        }
+    }
+
+    _G.systems_component_count = _G.component_count;
+}
+
+static void process_query(struct ct_world world,
+                          struct ct_ecs_query query,
+                          ct_process_fce_t fce,
+                          void *data) {
+    struct world_instance *w = get_world_instance(world);
+
+    struct entity_storage **storages = _query_storages(w, query);
+
+    const uint32_t type_count = ce_array_size(storages);
+    for (int i = 0; i < type_count; ++i) {
+        struct entity_storage *item = storages[i];
+
+        const uint32_t chunk_n = ce_array_size(item->chunks);
+        for (int j = 0; j < chunk_n; ++j) {
+            struct entity_chunk *chunk = item->chunks[j];
+            fce(world, chunk->entity, chunk, chunk->n, data);
+        }
     }
+}
+
+static void process(struct ct_world world,
+                    struct ct_component_mask components_mask,
+                    ct_process_fce_t fce,
+                    void *data) {
+    process_query(world, _query_for_mask(&components_mask), fce, data);
+}
+
+struct process_task {
+    struct ct_world world;
+    ct_process_fce_t fce;
+    void *data;
+
+    struct entity_chunk **chunks;
+};
 
-    return ((ent_type & mask) == mask);
-}
+static void _process_range(uint32_t begin,
+                           uint32_t end,
+                           void *data) {
+    struct process_task *task = data;
 
-static uint64_t combine_component(uint64_t *component_name,
-                                  uint32_t name_count) {
-    uint64_t new_type = 0;
-    for (int i = 0; i < name_count; ++i) {
-        new_type |= (1 << ce_hash_lookup(&_G.component_types,
-                                         component_name[i], 0));
+    for (uint32_t i = begin; i < end; ++i) {
+        struct entity_chunk *chunk = task->chunks[i];
+        task->fce(task->world, chunk->entity, chunk, chunk->n, task->data);
     }
-
-    return new_type;
 }
 
-static void _add_components(struct ct_world world,
-                            struct ct_entity ent,
-                            uint64_t new_type) {
+static void process_query_parallel(struct ct_world world,
+                                   struct ct_ecs_query query,
+                                   ct_process_fce_t fce,
+                                   void *data) {
     struct world_instance *w = get_world_instance(world);
 
-    uint64_t ent_type = ce_cdb_a0->read_uint64(ent.h, ENTITY_TYPE, 0);
+    struct entity_storage **storages = _query_storages(w, query);
 
-    new_type = ent_type | new_type;
+    struct entity_chunk **chunks = NULL;
 
-    _add_to_type_slot(w, ent, new_type);
+    const uint32_t type_count = ce_array_size(storages);
+    for (int i = 0; i < type_count; ++i) {
+        struct entity_storage *item = storages[i];
 
-    if (ent_type) {
-        _move_from_type_slot(w, ent, ent_type, new_type);
-        _remove_from_type_slot(w, ent, ent_type);
+        ce_array_push_n(chunks, item->chunks, ce_array_size(item->chunks),
+                        _G.allocator);
     }
-}
 
-static void add_components(struct ct_world world,
-                           struct ct_entity ent,
-                           uint64_t *component_name,
-                           uint32_t name_count) {
-    uint64_t new_type = combine_component(component_name, name_count);
-    _add_components(world, ent, new_type);
+    struct process_task task = {
+            .world = world,
+            .fce = fce,
+            .data = data,
+            .chunks = chunks,
+    };
 
+    struct ce_task_counter_t *counter = NULL;
+    ce_task_a0->parallel_for(ce_array_size(chunks), 0, _process_range, &task,
+                             &counter);
+    ce_task_a0->wait_for_counter(counter, 0);
+
+    ce_array_free(chunks, _G.allocator);
 }
 
-static void remove_components(struct ct_world world,
-                              struct ct_entity ent,
-                              uint64_t *component_name,
-                              uint32_t name_count) {
-    struct world_instance *w = get_world_instance(world);
+static void process_parallel(struct ct_world world,
+                             struct ct_component_mask components_mask,
+                             ct_process_fce_t fce,
+                             void *data) {
+    process_query_parallel(world, _query_for_mask(&components_mask), fce,
+                           data);
+}
 
-    uint64_t ent_type = ce_cdb_a0->read_uint64(ent.h, ENTITY_TYPE, 0);
+struct simulate_task {
+    struct ct_world world;
+    float dt;
+    ct_simulate_fce_t simulation;
+};
 
-    uint64_t new_type = combine_component(component_name, name_count);
-    new_type &= ~(1 << new_type);
+static void _simulate_task(void *data) {
+    struct simulate_task *task = data;
+    task->simulation(task->world, task->dt);
+}
 
-    _add_to_type_slot(w, ent, new_type);
+static void _run_simulate_batch(struct ce_task_item *items,
+                                uint32_t n) {
+    if (!n) {
+        return;
+    }
 
-    // REMOVE FROM PREVIOUS TYPESLOT
-    if (ent_type) {
-        _move_from_type_slot(w, ent, new_type, ent_type);
+    if (1 == n) {
+        items[0].work(items[0].data);
+        return;
     }
 
-    _remove_from_type_slot(w, ent, ent_type);
+    struct ce_task_counter_t *counter = NULL;
+    ce_task_a0->add(items, n, &counter);
+    ce_task_a0->wait_for_counter(counter, 0);
 }
 
-static void register_simulation(const char *name,
-                                ct_simulate_fce_t simulation) {
-    CE_UNUSED(name);
-
-    ce_array_push(_G.simulations, simulation, _G.allocator);
-}
+static void flush_cmd_buffer(struct ct_ecs_cmd_buffer_t *buffer);
 
-static void process(struct ct_world world,
-                    uint64_t components_mask,
-                    ct_process_fce_t fce,
-                    void *data) {
+// Systems run in registration order. Consecutive systems without
+// read/write conflict form one batch that runs on task workers.
+// Command buffer of world is flushed after last system.
+static void simulate(struct ct_world world,
+                     float dt) {
     struct world_instance *w = get_world_instance(world);
+    if (!w) {
+        return;
+    }
 
-    const uint32_t type_count = ce_array_size(w->entity_storage);
+    _resolve_system_masks();
 
-    for (int i = 0; i < type_count; ++i) {
-        struct entity_storage *item = &w->entity_storage[i];
+    const uint32_t systems_n = ce_array_size(_G.systems);
+    if (!systems_n) {
+        flush_cmd_buffer(w->cmd_buffer);
+        return;
+    }
+
+    struct simulate_task tasks[systems_n];
+    struct ce_task_item items[systems_n];
+
+    uint32_t batch_n = 0;
+    struct ct_component_mask batch_read = {};
+    struct ct_component_mask batch_write = {};
+
+    for (int i = 0; i < systems_n; ++i) {
+        struct system_info *system = &_G.systems[i];
+
+        const bool conflict = system->exclusive ||
+                              _mask_intersect(&system->write_mask,
+                                              &batch_read) ||
+                              _mask_intersect(&system->write_mask,
+                                              &batch_write) ||
+                              _mask_intersect(&system->read_mask,
+                                              &batch_write);
+
+        if (conflict) {
+            _run_simulate_batch(items, batch_n);
 
-        if ((item->mask & components_mask) != components_mask) {
+            batch_n = 0;
+            batch_read = (struct ct_component_mask) {};
+            batch_write = (struct ct_component_mask) {};
+        }
+
+        if (system->exclusive) {
+            system->simulation(world, dt);
             continue;
         }
 
-        fce(world, item->entity, item, item->n, data);
-    }
-}
+        tasks[i] = (struct simulate_task) {
+                .world = world,
+                .dt = dt,
+                .simulation = system->simulation,
+        };
 
-static void simulate(struct ct_world world,
-                     float dt) {
-    for (int j = 0; j < ce_array_size(_G.simulations); ++j) {
-        ct_simulate_fce_t fce = (ct_simulate_fce_t) _G.simulations[j];
-        fce(world, dt);
+        items[batch_n++] = (struct ce_task_item) {
+                .name = system->name,
+                .work = _simulate_task,
+                .data = &tasks[i],
+        };
+
+        batch_read = _mask_or(batch_read, system->read_mask);
+        batch_write = _mask_or(batch_write, system->write_mask);
     }
+
+    _run_simulate_batch(items, batch_n);
+
+    flush_cmd_buffer(w->cmd_buffer);
 }
 
 static void create_entities(struct ct_world world,
                             struct ct_entity *entity,
                             uint32_t count) {
+    struct world_instance *w = get_world_instance(world);
 
     for (int i = 0; i < count; ++i) {
         uint64_t entity_obj;
         entity_obj = ce_cdb_a0->create_object(ce_cdb_a0->db(), ENTITY_INSTANCE);
 
         ce_cdb_obj_o *ent_w = ce_cdb_a0->write_begin(entity_obj);
-        ce_cdb_a0->set_uint64(ent_w, ENTITY_TYPE, 0);
-        ce_cdb_a0->set_uint64(ent_w, ENTITY_DATA_IDX, 0);
+        ce_cdb_a0->set_uint64(ent_w, ENTITY_WORLD, world.h);
         ce_cdb_a0->set_uint64(ent_w, ENTITY_UID, 0);
         ce_cdb_a0->write_commit(ent_w);
 
         entity[i] = (struct ct_entity) {.h = entity_obj};
+
+        _new_slot(w, entity[i]);
     }
 }
 
 
 static void _destroy_with_child(struct world_instance *w,
                                 uint64_t ent) {
+    _destroy_slot(w, (struct ct_entity) {.h=ent});
+
     uint64_t childrens;
     childrens = ce_cdb_a0->read_subobject(ent, ENTITY_CHILDREN, 0);
+    if (!childrens) {
+        return;
+    }
+
     uint32_t children_n = ce_cdb_a0->prop_count(childrens);
     uint64_t children_keys[children_n];
     ce_cdb_a0->prop_keys(childrens, children_keys);
 
-    uint64_t ent_type = ce_cdb_a0->read_uint64(ent, ENTITY_TYPE, 0);
-    _remove_from_type_slot(w, (struct ct_entity) {.h=ent}, ent_type);
-
     for (int i = 0; i < children_n; ++i) {
         uint64_t children = ce_cdb_a0->read_subobject(childrens,
                                                       children_keys[i], 0);
@@ -525,17 +1369,9 @@ static void online(uint64_t name,
                    uint64_t obj) {
     CE_UNUSED(name);
 
-    const uint64_t size = input->size(input);
-    char *data = CE_ALLOC(_G.allocator, char, size);
-    input->read(input, data, 1, size);
-
-    ce_cdb_a0->load(_G.db, data, obj, _G.allocator);
+    ce_cdb_a0->load_mapped(_G.db, input, obj, _G.allocator);
 
     _load(obj, 0);
-
-    ce_cdb_obj_o *writer = ce_cdb_a0->write_begin(obj);
-    ce_cdb_a0->set_ptr(writer, PROP_RESOURECE_DATA, data);
-    ce_cdb_a0->write_commit(writer);
 }
 
 static void offline(uint64_t name,
@@ -547,6 +1383,10 @@ static uint64_t cdb_type() {
     return ENTITY_RESOURCE_ID;
 }
 
+static uint64_t compiler_version() {
+    return ENTITY_COMPILER_VERSION;
+}
+
 static struct ct_entity load(struct ct_resource_id resourceid,
                              struct ct_world world) {
     struct ct_entity ent = ct_ecs_a0->entity->spawn(world, resourceid.name);
@@ -577,6 +1417,7 @@ static struct ct_resource_i0 ct_resource_i0 = {
         .online = online,
         .offline = offline,
         .compilator = resource_compiler,
+        .compiler_version = compiler_version,
         .get_interface = get_resource_interface,
 };
 
@@ -586,79 +1427,162 @@ static struct ct_resource_i0 ct_resource_i0 = {
 //==============================================================================
 static bool alive(struct ct_world world,
                   struct ct_entity entity) {
-    return true;
+    struct world_instance *w = get_world_instance(world);
+
+    if (!w) {
+        return false;
+    }
+
+    return _get_slot(w, entity) != NULL;
 }
 
 
-static struct ct_entity _spawn_entity(struct ct_world world,
-                                      uint64_t resource_ent) {
+// Call spawners for entities spawned from same prefab. Entities occupy
+// consecutive rows so spawners fill contiguous arrays.
+static void _spawn_components(struct world_instance *w,
+                              const struct ct_entity *ent,
+                              const uint64_t *slot_h,
+                              uint32_t count,
+                              const uint64_t *components_keys,
+                              uint32_t components_n) {
+    uint64_t *objs = NULL;
+    ce_array_resize(objs, count * components_n, _G.allocator);
 
-    uint64_t root_obj;
-    root_obj = ce_cdb_a0->create_from(ce_cdb_a0->db(), resource_ent);
+    for (uint32_t i = 0; i < count; ++i) {
+        uint64_t components;
+        components = ce_cdb_a0->read_subobject(ent[i].h, ENTITY_COMPONENTS, 0);
 
-    struct world_instance *w = get_world_instance(world);
-    ce_cdb_obj_o *wr = ce_cdb_a0->write_begin(root_obj);
-    ce_cdb_a0->set_uint64(wr, ENTITY_WORLD, world.h);
-    ce_cdb_a0->set_uint64(wr, ENTITY_DATA_IDX, 0);
-    ce_cdb_a0->set_uint64(wr, ENTITY_UID, 0);
-    ce_cdb_a0->write_commit(wr);
+        for (uint32_t j = 0; j < components_n; ++j) {
+            objs[(j * count) + i] = ce_cdb_a0->read_subobject(components,
+                                                              components_keys[j],
+                                                              0);
+        }
+    }
+
+    for (uint32_t j = 0; j < components_n; ++j) {
+        uint64_t component_type = components_keys[j];
+        uint64_t comp_idx = component_idx(component_type);
+
+        if (UINT64_MAX == comp_idx) {
+            continue;
+        }
+
+        struct ct_component_i0 *component_i;
+        component_i = get_interface(component_type);
+
+        const uint64_t component_size = _G.component_size[comp_idx];
+        const uint64_t *comp_objs = objs + (j * count);
+
+        for (uint32_t i = 0; i < count;) {
+            struct entity_chunk *chunk = w->entity_slot[_idx(slot_h[i])].chunk;
+            const uint32_t first_row = w->entity_slot[_idx(slot_h[i])].row;
+
+            uint32_t n = 1;
+            while (((i + n) < count) &&
+                   (w->entity_slot[_idx(slot_h[i + n])].chunk == chunk)) {
+                ++n;
+            }
+
+            uint8_t *data = _component_data(chunk, comp_idx, first_row);
+
+            if (component_i->spawner_n) {
+                component_i->spawner_n(comp_objs + i, data, n);
+            } else {
+                for (uint32_t k = 0; k < n; ++k) {
+                    component_i->spawner(comp_objs[i + k],
+                                         data + (k * component_size));
+                }
+            }
+
+            i += n;
+        }
+    }
+
+    ce_array_free(objs, _G.allocator);
+}
+
+// Prefab is walked once for all *count* instances.
+static void _spawn_n(struct world_instance *w,
+                     uint64_t resource_ent,
+                     uint32_t count,
+                     struct ct_entity *out) {
+    if (!count) {
+        return;
+    }
 
     uint64_t components;
-    components = ce_cdb_a0->read_subobject(root_obj, ENTITY_COMPONENTS, 0);
+    components = ce_cdb_a0->read_subobject(resource_ent, ENTITY_COMPONENTS, 0);
 
     uint32_t components_n = ce_cdb_a0->prop_count(components);
     uint64_t components_keys[components_n];
     ce_cdb_a0->prop_keys(components, components_keys);
 
-    uint64_t ent_type = combine_component(components_keys, components_n);
+    struct ct_component_mask ent_type = combine_component(components_keys,
+                                                          components_n);
 
-    _add_components(world, (struct ct_entity) {.h = root_obj}, ent_type);
+    uint64_t *slot_h = NULL;
+    ce_array_resize(slot_h, count, _G.allocator);
 
-    uint64_t type_idx = ce_hash_lookup(&w->entity_storage_map,
-                                       ent_type, UINT64_MAX);
-
-    struct entity_storage *item = &w->entity_storage[type_idx];
+    for (uint32_t i = 0; i < count; ++i) {
+        uint64_t root_obj;
+        root_obj = ce_cdb_a0->create_from(ce_cdb_a0->db(), resource_ent);
 
-    const uint64_t idx = ce_cdb_a0->read_uint64(root_obj, ENTITY_DATA_IDX, 0);
+        ce_cdb_obj_o *wr = ce_cdb_a0->write_begin(root_obj);
+        ce_cdb_a0->set_uint64(wr, ENTITY_WORLD, w->world.h);
+        ce_cdb_a0->set_uint64(wr, ENTITY_UID, 0);
+        ce_cdb_a0->write_commit(wr);
 
-    for (int i = 0; i < components_n; ++i) {
-        uint64_t component_type = components_keys[i];
-        uint64_t j = component_idx(component_type);
+        out[i] = (struct ct_entity) {.h = root_obj};
+        slot_h[i] = _new_slot(w, out[i]);
+    }
 
-        struct ct_component_i0 *component_i;
-        component_i = get_interface(component_type);
+    if (!_mask_empty(&ent_type)) {
+        struct entity_storage *storage = _get_storage(w, &ent_type);
 
-        void *comp_data = item->entity_data[j];
+        const uint32_t chunk_n = ce_array_size(storage->chunks);
+        ce_array_set_capacity(storage->chunks,
+                              chunk_n + (count / storage->chunk_capacity) + 1,
+                              _G.allocator);
 
-        uint64_t component_obj;
-        component_obj = ce_cdb_a0->read_subobject(components,
-                                                  component_type, 0);
+        _move_rows(w, storage, slot_h, count);
 
-        component_i->spawner(component_obj,
-                             comp_data + (component_i->size() * idx));
+        _spawn_components(w, out, slot_h, count,
+                          components_keys, components_n);
     }
 
+    ce_array_free(slot_h, _G.allocator);
+
     uint64_t children;
-    children = ce_cdb_a0->read_subobject(root_obj, ENTITY_CHILDREN, 0);
+    children = ce_cdb_a0->read_subobject(resource_ent, ENTITY_CHILDREN, 0);
+    if (!children) {
+        return;
+    }
+
     uint32_t children_n = ce_cdb_a0->prop_count(children);
     uint64_t children_keys[children_n];
     ce_cdb_a0->prop_keys(children, children_keys);
 
+    struct ct_entity *child_ent = NULL;
+    ce_array_resize(child_ent, count, _G.allocator);
 
     for (int i = 0; i < children_n; ++i) {
         uint64_t child;
         child = ce_cdb_a0->read_subobject(children, children_keys[i], 0);
 
-        uint64_t new_obj = _spawn_entity(world, child).h;
+        _spawn_n(w, child, count, child_ent);
 
-        ce_cdb_obj_o *ch_w = ce_cdb_a0->write_begin(children);
-        ce_cdb_a0->set_subobject(ch_w, children_keys[i], new_obj);
-        ce_cdb_a0->write_commit(ch_w);
+        for (uint32_t j = 0; j < count; ++j) {
+            uint64_t ent_children;
+            ent_children = ce_cdb_a0->read_subobject(out[j].h,
+                                                     ENTITY_CHILDREN, 0);
 
-//        link(world, root_ent, child_ent);
+            ce_cdb_obj_o *ch_w = ce_cdb_a0->write_begin(ent_children);
+            ce_cdb_a0->set_subobject(ch_w, children_keys[i], child_ent[j].h);
+            ce_cdb_a0->write_commit(ch_w);
+        }
     }
 
-    return (struct ct_entity) {.h=root_obj};
+    ce_array_free(child_ent, _G.allocator);
 }
 
 static struct ct_entity spawn_entity(struct ct_world world,
@@ -670,22 +1594,352 @@ static struct ct_entity spawn_entity(struct ct_world world,
 
     uint64_t obj = ct_resource_a0->get(rid);
 
-    struct ct_entity root_ent = _spawn_entity(world, obj);
+    struct world_instance *w = get_world_instance(world);
+
+    struct ct_entity root_ent = {};
+    _spawn_n(w, obj, 1, &root_ent);
 
     return root_ent;
 }
 
+static void spawn_n(struct ct_world world,
+                    uint64_t name,
+                    uint32_t count,
+                    struct ct_entity *out) {
+    struct ct_resource_id rid = (struct ct_resource_id) {
+            .type = ENTITY_RESOURCE_ID,
+            .name = name,
+    };
+
+    uint64_t obj = ct_resource_a0->get(rid);
+
+    struct world_instance *w = get_world_instance(world);
+    _spawn_n(w, obj, count, out);
+}
+
+//==============================================================================
+// Command buffer
+//==============================================================================
+
+enum ecs_cmd_type {
+    ECS_CMD_ADD = 0,
+    ECS_CMD_REMOVE,
+    ECS_CMD_DESTROY,
+    ECS_CMD_SPAWN,
+};
+
+struct ecs_cmd {
+    enum ecs_cmd_type type;
+
+    // entity or resource name for spawn
+    uint64_t h;
+    struct ct_component_mask mask;
+};
+
+// Commands are recorded to stream of current worker so recording need no lock.
+// Stream 0 is shared by main thread and threads outside task system.
+struct ct_ecs_cmd_buffer_t {
+    struct ct_world world;
+    struct ce_spinlock stream0_lock;
+    struct ecs_cmd *stream[TASK_MAX_WORKERS];
+};
+
+// Final state of entity after all commands
+struct ecs_cmd_target {
+    uint64_t slot_h;
+    struct ct_component_mask type;
+    struct entity_storage *storage;
+    struct entity_chunk *chunk;
+    bool destroy;
+};
+
+static struct ct_ecs_cmd_buffer_t *create_cmd_buffer(struct ct_world world) {
+    struct ct_ecs_cmd_buffer_t *buffer = CE_ALLOC(_G.allocator,
+                                                  struct ct_ecs_cmd_buffer_t,
+                                                  sizeof(struct ct_ecs_cmd_buffer_t));
+
+    *buffer = (struct ct_ecs_cmd_buffer_t) {.world = world};
+
+    return buffer;
+}
+
+static void destroy_cmd_buffer(struct ct_ecs_cmd_buffer_t *buffer) {
+    for (int i = 0; i < TASK_MAX_WORKERS; ++i) {
+        ce_array_free(buffer->stream[i], _G.allocator);
+    }
+
+    CE_FREE(_G.allocator, buffer);
+}
+
+static struct ct_ecs_cmd_buffer_t *cmd_buffer(struct ct_world world) {
+    return get_world_instance(world)->cmd_buffer;
+}
+
+static void _push_cmd(struct ct_ecs_cmd_buffer_t *buffer,
+                      struct ecs_cmd cmd) {
+    const int worker_id = ce_task_a0->worker_id();
+    CE_ASSERT(LOG_WHERE, (worker_id >= 0) && (worker_id < TASK_MAX_WORKERS));
+
+    if (worker_id) {
+        ce_array_push(buffer->stream[worker_id], cmd, _G.allocator);
+        return;
+    }
+
+    ce_os_a0->thread->spin_lock(&buffer->stream0_lock);
+    ce_array_push(buffer->stream[0], cmd, _G.allocator);
+    ce_os_a0->thread->spin_unlock(&buffer->stream0_lock);
+}
+
+static void cmd_add(struct ct_ecs_cmd_buffer_t *buffer,
+                    struct ct_entity ent,
+                    uint64_t *component_name,
+                    uint32_t name_count) {
+    _push_cmd(buffer, (struct ecs_cmd) {
+            .type = ECS_CMD_ADD,
+            .h = ent.h,
+            .mask = combine_component(component_name, name_count),
+    });
+}
+
+static void cmd_remove(struct ct_ecs_cmd_buffer_t *buffer,
+                       struct ct_entity ent,
+                       uint64_t *component_name,
+                       uint32_t name_count) {
+    _push_cmd(buffer, (struct ecs_cmd) {
+            .type = ECS_CMD_REMOVE,
+            .h = ent.h,
+            .mask = combine_component(component_name, name_count),
+    });
+}
+
+static void cmd_destroy(struct ct_ecs_cmd_buffer_t *buffer,
+                        struct ct_entity *entity,
+                        uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        _push_cmd(buffer, (struct ecs_cmd) {
+                .type = ECS_CMD_DESTROY,
+                .h = entity[i].h,
+        });
+    }
+}
+
+static void cmd_spawn(struct ct_ecs_cmd_buffer_t *buffer,
+                      uint64_t name) {
+    _push_cmd(buffer, (struct ecs_cmd) {
+            .type = ECS_CMD_SPAWN,
+            .h = name,
+    });
+}
+
+static int _cmd_target_cmp(const void *a,
+                           const void *b) {
+    const struct ecs_cmd_target *ta = a;
+    const struct ecs_cmd_target *tb = b;
+
+    if (ta->storage != tb->storage) {
+        return ta->storage < tb->storage ? -1 : 1;
+    }
+
+    if (ta->chunk != tb->chunk) {
+        return ta->chunk < tb->chunk ? -1 : 1;
+    }
+
+    return 0;
+}
+
+// Commands are folded to final type per entity, sorted by target archetype
+// and every archetype get all its entities in one pass.
+static void flush_cmd_buffer(struct ct_ecs_cmd_buffer_t *buffer) {
+    if (!buffer) {
+        return;
+    }
+
+    struct world_instance *w = get_world_instance(buffer->world);
+
+    struct ce_hash_t target_map = {};
+    struct ecs_cmd_target *targets = NULL;
+    uint64_t *spawns = NULL;
+
+    for (int i = 0; i < TASK_MAX_WORKERS; ++i) {
+        struct ecs_cmd *stream = buffer->stream[i];
+
+        const uint32_t cmd_n = ce_array_size(stream);
+        for (uint32_t j = 0; j < cmd_n; ++j) {
+            struct ecs_cmd *cmd = &stream[j];
+
+            if (ECS_CMD_SPAWN == cmd->type) {
+                ce_array_push(spawns, cmd->h, _G.allocator);
+                continue;
+            }
+
+            uint64_t idx = ce_hash_lookup(&target_map, cmd->h, UINT64_MAX);
+            if (UINT64_MAX == idx) {
+                struct ct_entity ent = {.h = cmd->h};
+
+                uint64_t h = _slot_handler(w, ent);
+                if (UINT64_MAX == h) {
+                    continue;
+                }
+
+                idx = ce_array_size(targets);
+                ce_array_push(targets, ((struct ecs_cmd_target) {
+                        .slot_h = h,
+                        .type = _entity_type(w, ent),
+                }), _G.allocator);
+
+                ce_hash_add(&target_map, cmd->h, idx, _G.allocator);
+            }
+
+            struct ecs_cmd_target *target = &targets[idx];
+
+            switch (cmd->type) {
+                case ECS_CMD_ADD:
+                    target->type = _mask_or(target->type, cmd->mask);
+                    break;
+
+                case ECS_CMD_REMOVE:
+                    target->type = _mask_andnot(target->type, cmd->mask);
+                    break;
+
+                case ECS_CMD_DESTROY:
+                    target->destroy = true;
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        ce_array_clean(buffer->stream[i]);
+    }
+
+    const uint32_t target_n = ce_array_size(targets);
+
+    for (uint32_t i = 0; i < target_n; ++i) {
+        struct ecs_cmd_target *target = &targets[i];
+
+        // child of entity destroyed before
+        if (!target->destroy ||
+            !ce_handler_alive(&w->entity_handler, target->slot_h)) {
+            continue;
+        }
+
+        struct ct_entity ent = w->entity_slot[_idx(target->slot_h)].ent;
+        _destroy_with_child(w, ent.h);
+    }
+
+    uint32_t move_n = 0;
+    for (uint32_t i = 0; i < target_n; ++i) {
+        struct ecs_cmd_target *target = &targets[i];
+
+        // destroyed or child of destroyed entity
+        if (!ce_handler_alive(&w->entity_handler, target->slot_h)) {
+            continue;
+        }
+
+        struct entity_slot *slot = &w->entity_slot[_idx(target->slot_h)];
+
+        if (_mask_empty(&target->type)) {
+            _set_type(w, slot->ent, &target->type);
+            continue;
+        }
+
+        if (slot->chunk &&
+            _mask_equal(&slot->chunk->storage->mask, &target->type)) {
+            continue;
+        }
+
+        target->storage = _get_storage(w, &target->type);
+        target->chunk = slot->chunk;
+
+        targets[move_n++] = *target;
+    }
+
+    qsort(targets, move_n, sizeof(struct ecs_cmd_target), _cmd_target_cmp);
+
+    uint64_t *slot_h = NULL;
+    for (uint32_t i = 0; i < move_n;) {
+        struct entity_storage *storage = targets[i].storage;
+
+        ce_array_clean(slot_h);
+        for (; (i < move_n) && (targets[i].storage == storage); ++i) {
+            ce_array_push(slot_h, targets[i].slot_h, _G.allocator);
+        }
+
+        _move_rows(w, storage, slot_h, ce_array_size(slot_h));
+    }
+
+    const uint32_t spawn_n = ce_array_size(spawns);
+    for (uint32_t i = 0; i < spawn_n; ++i) {
+        spawn_entity(buffer->world, spawns[i]);
+    }
+
+    ce_array_free(slot_h, _G.allocator);
+    ce_array_free(spawns, _G.allocator);
+    ce_array_free(targets, _G.allocator);
+    ce_hash_free(&target_map, _G.allocator);
+}
+
 //==============================================================================
 // Public interface
 //==============================================================================
 static struct world_instance *_new_world(struct ct_world world) {
-    uint32_t idx = ce_array_size(_G.world_array);
-    ce_array_push(_G.world_array, (struct world_instance) {{0}},
-                  _G.allocator);
-    ce_hash_add(&_G.world_map, world.h, idx, _G.allocator);
+    const uint32_t idx = _idx(world.h);
+    const uint32_t world_n = ce_array_size(_G.world_array);
+    if (idx >= world_n) {
+        ce_array_resize(_G.world_array, idx + 1, _G.allocator);
+
+        // Queries iterate all worlds, unused must be empty.
+        memset(_G.world_array + world_n, 0,
+               sizeof(struct world_instance) * (idx + 1 - world_n));
+    }
+
+    _G.world_array[idx] = (struct world_instance) {{0}};
     return &_G.world_array[idx];
 }
 
+static void _destroy_world(struct world_instance *w) {
+    const uint32_t type_count = ce_array_size(w->entity_storage);
+    for (int i = 0; i < type_count; ++i) {
+        struct entity_storage *storage = w->entity_storage[i];
+
+        const uint32_t chunk_n = ce_array_size(storage->chunks);
+        for (int j = 0; j < chunk_n; ++j) {
+            if (UINT32_MAX == storage->chunks[j]->page) {
+                CE_FREE(_G.allocator, storage->chunks[j]);
+            }
+        }
+
+        ce_array_free(storage->chunks, _G.allocator);
+        ce_array_free(storage->components, _G.allocator);
+        CE_FREE(_G.allocator, storage);
+    }
+
+    ce_array_free(w->entity_storage, _G.allocator);
+    ce_hash_free(&w->entity_storage_map, _G.allocator);
+
+    const uint32_t query_n = ce_array_size(w->query_storage);
+    for (int i = 0; i < query_n; ++i) {
+        ce_array_free(w->query_storage[i], _G.allocator);
+    }
+    ce_array_free(w->query_storage, _G.allocator);
+
+    destroy_cmd_buffer(w->cmd_buffer);
+    _pool_destroy(w->pool);
+
+    ce_array_free(w->entity_slot, _G.allocator);
+
+    const uint32_t page_n = ce_array_size(w->entity_page);
+    for (uint32_t i = 0; i < page_n; ++i) {
+        CE_FREE(_G.allocator, w->entity_page[i]);
+    }
+    ce_array_free(w->entity_page, _G.allocator);
+
+    ce_handler_free(&w->entity_handler, _G.allocator);
+
+    *w = (struct world_instance) {{0}};
+}
+
 static struct ct_world create_world() {
     struct ct_world world = {.h = ce_handler_create(&_G.world_handler,
                                                     _G.allocator)};
@@ -694,6 +1948,15 @@ static struct ct_world create_world() {
 
     w->world = world;
     w->db = ce_cdb_a0->db();
+    w->cmd_buffer = create_cmd_buffer(world);
+
+    ce_os_a0->thread->spin_lock(&_G.query_lock);
+    _query_fill_world(w);
+    ce_os_a0->thread->spin_unlock(&_G.query_lock);
+
+    w->pool = CE_ALLOC(_G.allocator, struct chunk_pool,
+                       sizeof(struct chunk_pool));
+    *w->pool = (struct chunk_pool) {};
 
     uint64_t event = ce_cdb_a0->create_object(ce_cdb_a0->db(),
                                               ECS_WORLD_CREATE);
@@ -717,10 +1980,51 @@ static void destroy_world(struct ct_world world) {
 
     ce_ebus_a0->broadcast(ECS_EBUS, event);
 
-    struct world_instance *w = _new_world(world);
+    struct world_instance *w = get_world_instance(world);
+
+    _destroy_world(w);
     ce_handler_destroy(&_G.world_handler, world.h, _G.allocator);
+}
+
+static void world_stats(struct ct_world world,
+                        struct ct_ecs_world_stats *stats) {
+    struct world_instance *w = get_world_instance(world);
 
-    ce_cdb_a0->destroy_db(w->db);
+    *stats = (struct ct_ecs_world_stats) {
+            .archetype_count = ce_array_size(w->entity_storage),
+            .chunk_count = w->pool->chunk_count,
+            .page_count = w->pool->page_count,
+            .chunk_size = w->pool->large_size +
+                          ((uint64_t) w->pool->page_count *
+                           CHUNK_PAGE_CHUNKS * CHUNK_SIZE),
+            .index_size = (ce_array_capacity(w->entity_slot) *
+                           sizeof(struct entity_slot)) +
+                          (ce_array_capacity(w->entity_page) *
+                           sizeof(uint64_t *)) +
+                          (ce_array_capacity(w->entity_storage) *
+                           (sizeof(struct entity_storage) +
+                            sizeof(struct entity_storage *))),
+    };
+
+    const uint32_t page_n = ce_array_size(w->entity_page);
+    for (uint32_t i = 0; i < page_n; ++i) {
+        if (w->entity_page[i]) {
+            stats->index_size += sizeof(uint64_t) << ENTITY_PAGE_SHIFT;
+        }
+    }
+
+    const uint32_t type_count = ce_array_size(w->entity_storage);
+    for (int i = 0; i < type_count; ++i) {
+        struct entity_storage *storage = w->entity_storage[i];
+
+        const uint32_t chunk_n = ce_array_size(storage->chunks);
+        for (int j = 0; j < chunk_n; ++j) {
+            const uint32_t n = storage->chunks[j]->n;
+
+            stats->entity_count += n;
+            stats->used_size += (uint64_t) n * storage->row_size;
+        }
+    }
 }
 
 struct ct_entity find_by_name(struct ct_world world,
@@ -760,16 +2064,29 @@ struct ct_entity_a0 ct_entity_a0 = {
         .destroy = destroy,
         .alive = alive,
         .spawn = spawn_entity,
+        .spawn_n = spawn_n,
         .has = has,
         .find_by_name = find_by_name,
 
         .create_world = create_world,
         .destroy_world = destroy_world,
+
+        .world_stats = world_stats,
+
+        .cmd_buffer = cmd_buffer,
+        .create_cmd_buffer = create_cmd_buffer,
+        .destroy_cmd_buffer = destroy_cmd_buffer,
+        .flush_cmd_buffer = flush_cmd_buffer,
+        .cmd_add = cmd_add,
+        .cmd_remove = cmd_remove,
+        .cmd_destroy = cmd_destroy,
+        .cmd_spawn = cmd_spawn,
 };
 
 struct ct_component_a0 ct_component_a0 = {
         .get_interface = get_interface,
         .mask = component_mask,
+        .combine_mask = combine_component,
         .get_all = get_all,
         .get_one = get_one,
         .add = add_components,
@@ -778,8 +2095,13 @@ struct ct_component_a0 ct_component_a0 = {
 
 struct ct_system_a0 ct_system_a0 = {
         .register_simulation = register_simulation,
+        .register_system = register_system,
         .simulate = simulate,
         .process = process,
+        .process_parallel = process_parallel,
+        .create_query = create_query,
+        .process_query = process_query,
+        .process_query_parallel = process_query_parallel,
 };
 
 
@@ -800,6 +2122,12 @@ static void _componet_api_add(uint64_t name,
                               void *api) {
     struct ct_component_i0 *component_i = api;
 
+    if (_G.component_count >= MAX_COMPONENTS) {
+        ce_log_a0->error(LOG_WHERE, "Too many components, max is %d",
+                         MAX_COMPONENTS);
+        return;
+    }
+
     ce_array_push(_G.components_name, component_i->cdb_type(), _G.allocator);
 
     ce_hash_add(&_G.component_interface_map, component_i->cdb_type(),
@@ -808,6 +2136,8 @@ static void _componet_api_add(uint64_t name,
     const uint64_t cid = _G.component_count++;
     ce_hash_add(&_G.component_types, component_i->cdb_type(), cid,
                 _G.allocator);
+
+    _G.component_size[cid] = component_i->size();
 }
 
 static void _init(struct ce_api_a0 *api) {
@@ -827,7 +2157,6 @@ static void _init(struct ce_api_a0 *api) {
 }
 
 static void _shutdown() {
-    ce_cdb_a0->destroy_db(_G.db);
 }
 
 
@@ -843,6 +2172,7 @@ CE_MODULE_DEF(
             CE_INIT_API(api, ce_cdb_a0);
             CE_INIT_API(api, ce_task_a0);
             CE_INIT_API(api, ce_ebus_a0);
+            CE_INIT_API(api, ce_log_a0);
         },
 
         {
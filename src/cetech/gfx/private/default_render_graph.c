@@ -89,7 +89,7 @@ void foreach_camera(struct ct_world world,
     struct ct_camera_component *camera_data;
     camera_data = ct_ecs_a0->component->get_all(CAMERA_COMPONENT, item);
 
-    for (uint32_t i = 1; i < n; ++i) {
+    for (uint32_t i = 0; i < n; ++i) {
         uint32_t idx = cameras->n++;
 
         cameras->ent[idx].h = ent[i].h;
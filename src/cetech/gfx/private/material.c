@@ -40,6 +40,9 @@ int materialcompiler_init(struct ce_api_a0 *api);
 #define _G MaterialGlobals
 #define LOG_WHERE "material"
 
+// Bump when compiled material format change.
+#define MATERIAL_COMPILER_VERSION 1
+
 
 //==============================================================================
 // GLobals
@@ -47,6 +50,16 @@ int materialcompiler_init(struct ce_api_a0 *api);
 
 static struct _G {
     struct ce_cdb_t db;
+
+    // submit
+    struct ce_cdb_prop_h layers_prop;
+    struct ce_cdb_prop_h variables_prop;
+    struct ce_cdb_prop_h shader_prop;
+    struct ce_cdb_prop_h state_prop;
+    struct ce_cdb_prop_h var_type_prop;
+    struct ce_cdb_prop_h var_handler_prop;
+    struct ce_cdb_prop_h var_value_prop;
+
     struct ce_alloc *allocator;
 } _G;
 
@@ -69,11 +82,7 @@ static void online(uint64_t name,
                    uint64_t obj) {
     CE_UNUSED(name);
 
-    const uint64_t size = input->size(input);
-    char *data = CE_ALLOC(_G.allocator, char, size);
-    input->read(input, data, 1, size);
-
-    ce_cdb_a0->load(ce_cdb_a0->db(), data, obj, _G.allocator);
+    ce_cdb_a0->load_mapped(ce_cdb_a0->db(), input, obj, _G.allocator);
 
     uint64_t layers_obj = ce_cdb_a0->read_subobject(obj, MATERIAL_LAYERS, 0);
 
@@ -123,6 +132,10 @@ static uint64_t cdb_type() {
     return MATERIAL_TYPE;
 }
 
+static uint64_t compiler_version() {
+    return MATERIAL_COMPILER_VERSION;
+}
+
 static void ui_vec4(uint64_t var) {
     const char *str;
     str = ce_cdb_a0->read_str(var, MATERIAL_VAR_NAME_PROP, "");
@@ -339,6 +352,7 @@ static struct ct_resource_i0 ct_resource_i0 = {
         .online = online,
         .offline = offline,
         .compilator = material_compiler,
+        .compiler_version = compiler_version,
         .get_interface = get_interface
 };
 
@@ -378,16 +392,14 @@ static void set_texture_handler(uint64_t material,
 static void submit(uint64_t material,
                    uint64_t _layer,
                    uint8_t viewid) {
-    uint64_t layers_obj = ce_cdb_a0->read_ref(material, MATERIAL_LAYERS, 0);
+    uint64_t layers_obj = ce_cdb_a0->read_ref_h(material, _G.layers_prop, 0);
     uint64_t layer = ce_cdb_a0->read_ref(layers_obj, _layer, 0);
 
     if (!layer) {
         return;
     }
 
-    uint64_t variables = ce_cdb_a0->read_ref(layer,
-                                             MATERIAL_VARIABLES_PROP,
-                                             0);
+    uint64_t variables = ce_cdb_a0->read_ref_h(layer, _G.variables_prop, 0);
 
     uint64_t key_count = ce_cdb_a0->prop_count(variables);
     uint64_t keys[key_count];
@@ -397,12 +409,12 @@ static void submit(uint64_t material,
 
     for (int j = 0; j < key_count; ++j) {
         uint64_t var = ce_cdb_a0->read_ref(variables, keys[j], 0);
-        uint64_t type = ce_cdb_a0->read_uint64(var, MATERIAL_VAR_TYPE_PROP, 0);
+        uint64_t type = ce_cdb_a0->read_uint64_h(var, _G.var_type_prop, 0);
 
         ct_render_uniform_handle_t handle = {
-                .idx = (uint16_t) ce_cdb_a0->read_uint64(var,
-                                                         MATERIAL_VAR_HANDLER_PROP,
-                                                         0)
+                .idx = (uint16_t) ce_cdb_a0->read_uint64_h(var,
+                                                           _G.var_handler_prop,
+                                                           0)
         };
 
         switch (type) {
@@ -410,15 +422,15 @@ static void submit(uint64_t material,
                 break;
 
             case MAT_VAR_INT: {
-                uint32_t v = ce_cdb_a0->read_uint64(var,
-                                                    MATERIAL_VAR_VALUE_PROP, 0);
+                uint32_t v = ce_cdb_a0->read_uint64_h(var,
+                                                      _G.var_value_prop, 0);
                 ct_renderer_a0->set_uniform(handle, &v, 1);
             }
                 break;
 
             case MAT_VAR_TEXTURE: {
-                uint64_t t = ce_cdb_a0->read_uint64(var,
-                                                    MATERIAL_VAR_VALUE_PROP, 0);
+                uint64_t t = ce_cdb_a0->read_uint64_h(var,
+                                                      _G.var_value_prop, 0);
                 ct_render_texture_handle_t texture = ct_texture_a0->get(t);
                 ct_renderer_a0->set_texture(texture_stage++, handle,
                                             texture, 0);
@@ -426,8 +438,8 @@ static void submit(uint64_t material,
                 break;
 
             case MAT_VAR_TEXTURE_HANDLER: {
-                uint64_t t = ce_cdb_a0->read_uint64(var,
-                                                    MATERIAL_VAR_VALUE_PROP, 0);
+                uint64_t t = ce_cdb_a0->read_uint64_h(var,
+                                                      _G.var_value_prop, 0);
                 ct_renderer_a0->set_texture(texture_stage++, handle,
                                             (ct_render_texture_handle_t) {.idx=(uint16_t) t},
                                             0);
@@ -437,7 +449,7 @@ static void submit(uint64_t material,
             case MAT_VAR_COLOR4:
             case MAT_VAR_VEC4: {
                 float v[4] = {1.0f, 1.0f, 1.0f, 1.0f};
-                ce_cdb_a0->read_vec4(var, MATERIAL_VAR_VALUE_PROP, v),
+                ce_cdb_a0->read_vec4_h(var, _G.var_value_prop, v),
                         ct_renderer_a0->set_uniform(handle, &v, 1);
             }
                 break;
@@ -449,9 +461,9 @@ static void submit(uint64_t material,
 
     uint64_t shader_obj = ct_resource_a0->get(
             (struct ct_resource_id) {
-                    .name = ce_cdb_a0->read_uint64(layer,
-                                                   MATERIAL_SHADER_PROP,
-                                                   0),
+                    .name = ce_cdb_a0->read_uint64_h(layer,
+                                                     _G.shader_prop,
+                                                     0),
                     .type = SHADER_TYPE,
             });
 
@@ -461,7 +473,7 @@ static void submit(uint64_t material,
 
     ct_render_program_handle_t shader = ct_shader_a0->get(shader_obj);
 
-    uint64_t state = ce_cdb_a0->read_uint64(layer, MATERIAL_STATE_PROP, 0);
+    uint64_t state = ce_cdb_a0->read_uint64_h(layer, _G.state_prop, 0);
 
     ct_renderer_a0->set_state(state, 0);
     ct_renderer_a0->submit(viewid, shader, 0, false);
@@ -480,6 +492,15 @@ static int init(struct ce_api_a0 *api) {
             .allocator = ce_memory_a0->system,
             .db = ce_cdb_a0->db()
     };
+
+    _G.layers_prop = ce_cdb_a0->prop_handle(MATERIAL_LAYERS);
+    _G.variables_prop = ce_cdb_a0->prop_handle(MATERIAL_VARIABLES_PROP);
+    _G.shader_prop = ce_cdb_a0->prop_handle(MATERIAL_SHADER_PROP);
+    _G.state_prop = ce_cdb_a0->prop_handle(MATERIAL_STATE_PROP);
+    _G.var_type_prop = ce_cdb_a0->prop_handle(MATERIAL_VAR_TYPE_PROP);
+    _G.var_handler_prop = ce_cdb_a0->prop_handle(MATERIAL_VAR_HANDLER_PROP);
+    _G.var_value_prop = ce_cdb_a0->prop_handle(MATERIAL_VAR_VALUE_PROP);
+
     api->register_api("ct_material_a0", &material_api);
 
     ce_api_a0->register_api(RESOURCE_I_NAME, &ct_resource_i0);
@@ -490,7 +511,6 @@ static int init(struct ce_api_a0 *api) {
 }
 
 static void shutdown() {
-    ce_cdb_a0->destroy_db(_G.db);
 }
 
 CE_MODULE_DEF(
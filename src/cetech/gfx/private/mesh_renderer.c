@@ -32,6 +32,13 @@
 #define _G mesh_render_global
 
 static struct _G {
+    struct ct_ecs_query query;
+
+    struct ce_cdb_prop_h ib_count_prop;
+    struct ce_cdb_prop_h vb_count_prop;
+    struct ce_cdb_prop_h ib_prop;
+    struct ce_cdb_prop_h vb_prop;
+
     struct ce_alloc *allocator;
 } _G;
 
@@ -88,7 +95,7 @@ void foreach_mesh_renderer(struct ct_world world,
     struct ct_transform_comp *transforms;
     transforms = ct_ecs_a0->component->get_all(TRANSFORM_COMPONENT, item);
 
-    for (int i = 1; i < n; ++i) {
+    for (int i = 0; i < n; ++i) {
         struct ct_transform_comp t = transforms[i];
         struct ct_mesh m = mesh_renderers[i];
 
@@ -116,16 +123,19 @@ void foreach_mesh_renderer(struct ct_world world,
             continue;
         }
 
-        uint64_t size = ce_cdb_a0->read_uint64(geom_obj, SCENE_SIZE_PROP, 0);
-        uint64_t ib = ce_cdb_a0->read_uint64(geom_obj, SCENE_IB_PROP, 0);
-        uint64_t vb = ce_cdb_a0->read_uint64(geom_obj, SCENE_VB_PROP, 0);
+        uint64_t ib_count = ce_cdb_a0->read_uint64_h(geom_obj,
+                                                     _G.ib_count_prop, 0);
+        uint64_t vb_count = ce_cdb_a0->read_uint64_h(geom_obj,
+                                                     _G.vb_count_prop, 0);
+        uint64_t ib = ce_cdb_a0->read_uint64_h(geom_obj, _G.ib_prop, 0);
+        uint64_t vb = ce_cdb_a0->read_uint64_h(geom_obj, _G.vb_prop, 0);
 
         ct_render_index_buffer_handle_t ibh = {.idx = (uint16_t) ib};
         ct_render_vertex_buffer_handle_t vbh = {.idx = (uint16_t) vb};
 
         ct_renderer_a0->set_transform(&final_w, 1);
-        ct_renderer_a0->set_vertex_buffer(0, vbh, 0, size);
-        ct_renderer_a0->set_index_buffer(ibh, 0, size);
+        ct_renderer_a0->set_vertex_buffer(0, vbh, 0, vb_count);
+        ct_renderer_a0->set_index_buffer(ibh, 0, ib_count);
 
         ct_material_a0->submit(m.material, data->layer_name, data->viewid);
 
@@ -138,11 +148,18 @@ void mesh_render_all(struct ct_world world,
                      uint8_t viewid,
                      uint64_t layer_name) {
     struct mesh_render_data render_data = {.viewid = viewid, .layer_name = layer_name};
-    ct_ecs_a0->system->process(
-            world,
-            ct_ecs_a0->component->mask(MESH_RENDERER_COMPONENT) |
-            ct_ecs_a0->component->mask(TRANSFORM_COMPONENT),
-            foreach_mesh_renderer, &render_data);
+
+    // Components are registered by other modules so query is created lazily.
+    if (!_G.query.h) {
+        _G.query = ct_ecs_a0->system->create_query(
+                ct_ecs_a0->component->combine_mask(
+                        (uint64_t[]) {MESH_RENDERER_COMPONENT,
+                                      TRANSFORM_COMPONENT}, 2),
+                (struct ct_component_mask) {});
+    }
+
+    ct_ecs_a0->system->process_query(world, _G.query,
+                                     foreach_mesh_renderer, &render_data);
 }
 
 
@@ -252,7 +269,8 @@ static void _component_spawner(uint64_t obj,
             .scene_id = ce_cdb_a0->read_uint64(obj, PROP_SCENE_ID, 0),
     };
 
-    ce_cdb_a0->register_notify(obj, (ce_cdb_notify) _on_obj_change, NULL);
+    ce_cdb_a0->register_notify_deferred(obj, (ce_cdb_notify) _on_obj_change,
+                                        NULL);
 }
 
 
@@ -332,6 +350,10 @@ static void _init(struct ce_api_a0 *api) {
 
     _G = (struct _G) {
             .allocator = ce_memory_a0->system,
+            .ib_count_prop = ce_cdb_a0->prop_handle(SCENE_IB_COUNT),
+            .vb_count_prop = ce_cdb_a0->prop_handle(SCENE_VB_COUNT),
+            .ib_prop = ce_cdb_a0->prop_handle(SCENE_IB_PROP),
+            .vb_prop = ce_cdb_a0->prop_handle(SCENE_VB_PROP),
     };
 
     api->register_api("ct_component_i0", &ct_component_i0);
@@ -25,6 +25,8 @@
 
 int scenecompiler_init(struct ce_api_a0 *api);
 
+uint64_t scene_compiler_version();
+
 //==============================================================================
 // Structs
 //==============================================================================
@@ -49,11 +51,7 @@ static void online(uint64_t name,
                    uint64_t obj) {
     CE_UNUSED(name);
 
-    const uint64_t size = input->size(input);
-    char *data = CE_ALLOC(_G.allocator, char, size);
-    input->read(input, data, 1, size);
-
-    ce_cdb_a0->load(ce_cdb_a0->db(), data, obj, _G.allocator);
+    ce_cdb_a0->load_mapped(ce_cdb_a0->db(), input, obj, _G.allocator);
 
     uint64_t geom_count = ce_cdb_a0->read_uint64(obj, SCENE_GEOM_COUNT, 0);
     ct_render_vertex_decl_t *vb_decl = (ce_cdb_a0->read_blob(obj, SCENE_VB_DECL,
@@ -66,6 +64,8 @@ static void online(uint64_t name,
                                                 NULL, NULL));
     uint32_t *ib_size = (ce_cdb_a0->read_blob(obj, SCENE_IB_SIZE, NULL, NULL));
     uint32_t *vb_size = (ce_cdb_a0->read_blob(obj, SCENE_VB_SIZE, NULL, NULL));
+    uint32_t *vb_count = (ce_cdb_a0->read_blob(obj, SCENE_VB_COUNT, NULL,
+                                               NULL));
     uint32_t *ib = (ce_cdb_a0->read_blob(obj, SCENE_IB_PROP, NULL, NULL));
     uint8_t *vb = (ce_cdb_a0->read_blob(obj, SCENE_VB_PROP, NULL, NULL));
 
@@ -92,7 +92,8 @@ static void online(uint64_t name,
         ce_cdb_obj_o *geom_writer = ce_cdb_a0->write_begin(geom_obj);
         ce_cdb_a0->set_uint64(geom_writer, SCENE_IB_PROP, ib_handle.idx);
         ce_cdb_a0->set_uint64(geom_writer, SCENE_VB_PROP, bv_handle.idx);
-        ce_cdb_a0->set_uint64(geom_writer, SCENE_SIZE_PROP, size);
+        ce_cdb_a0->set_uint64(geom_writer, SCENE_IB_COUNT, ib_size[i]);
+        ce_cdb_a0->set_uint64(geom_writer, SCENE_VB_COUNT, vb_count[i]);
         ce_cdb_a0->write_commit(geom_writer);
 
         ce_cdb_a0->set_ref(writer, geom_name[i], geom_obj);
@@ -120,6 +121,7 @@ static struct ct_resource_i0 ct_resource_i0 = {
         .online = online,
         .offline = offline,
         .compilator = scene_compiler,
+        .compiler_version = scene_compiler_version,
 };
 
 
@@ -32,6 +32,9 @@
 
 #define _G scene_compiler_globals
 
+// Bump when compiled scene format change.
+#define SCENE_COMPILER_VERSION 2
+
 struct _G {
     struct ce_alloc *allocator;
 } _G;
@@ -81,6 +84,7 @@ struct compile_output {
     ct_render_vertex_decl_t *vb_decl;
     uint32_t *ib_size;
     uint32_t *vb_size;
+    uint32_t *vb_count;
     uint32_t *ib;
     uint8_t *vb;
     uint64_t *node_name;
@@ -107,6 +111,7 @@ static void _destroy_compile_output(struct compile_output *output) {
     ce_array_free(output->vb_decl, _G.allocator);
     ce_array_free(output->ib_size, _G.allocator);
     ce_array_free(output->vb_size, _G.allocator);
+    ce_array_free(output->vb_count, _G.allocator);
     ce_array_free(output->ib, _G.allocator);
     ce_array_free(output->vb, _G.allocator);
     ce_array_free(output->node_name, _G.allocator);
@@ -316,6 +321,7 @@ static void foreach_geometries_clb(struct ce_yng_node key,
 
     ce_array_push(output->ib_size, vertex_count, _G.allocator);
     ce_array_push(output->vb_size, vertex_size * vertex_count, _G.allocator);
+    ce_array_push(output->vb_count, vertex_count, _G.allocator);
 
     for (uint32_t i = 0; i < vertex_count; ++i) {
         for (uint32_t j = 0; j < CE_ARRAY_LEN(_chanel_types); ++j) {
@@ -572,6 +578,7 @@ static int _compile_assimp(const char *filename,
         ce_array_push(output->vb_decl, vertex_decl, _G.allocator);
         ce_array_push(output->vb_size, v_size * mesh->mNumVertices,
                       _G.allocator);
+        ce_array_push(output->vb_count, mesh->mNumVertices, _G.allocator);
 
         for (uint32_t j = 0; j < mesh->mNumVertices; ++j) {
             if (mesh->mVertices != NULL) {
@@ -655,6 +662,9 @@ extern "C" void scene_compiler(const char *filename,
     ce_cdb_a0->set_blob(w, SCENE_VB_SIZE, output->vb_size,
                         sizeof(*output->vb_size) *
                         ce_array_size(output->vb_size));
+    ce_cdb_a0->set_blob(w, SCENE_VB_COUNT, output->vb_count,
+                        sizeof(*output->vb_count) *
+                        ce_array_size(output->vb_count));
     ce_cdb_a0->set_blob(w, SCENE_IB_PROP, output->ib,
                         sizeof(*output->ib) * ce_array_size(output->ib));
     ce_cdb_a0->set_blob(w, SCENE_VB_PROP, output->vb,
@@ -679,12 +689,24 @@ extern "C" void scene_compiler(const char *filename,
                         ce_array_size(output->node_str));
     ce_cdb_a0->write_commit(w);
 
-    ce_cdb_a0->dump(obj, output_blob, ce_memory_a0->system);
+    ce_cdb_a0->dump_compressed(obj, output_blob, ce_memory_a0->system);
     ce_cdb_a0->destroy_object(obj);
 
     _destroy_compile_output(output);
 }
 
+// Imported scene depends on assimp version.
+extern "C" uint64_t scene_compiler_version() {
+    const uint32_t version[] = {
+            SCENE_COMPILER_VERSION,
+            aiGetVersionMajor(),
+            aiGetVersionMinor(),
+            aiGetVersionRevision(),
+    };
+
+    return ce_hash_murmur2_64(version, sizeof(version), 0);
+}
+
 extern "C" int scenecompiler_init(struct ce_api_a0 *api) {
     CE_INIT_API(api, ce_memory_a0);
     CE_INIT_API(api, ct_resource_a0);
@@ -26,6 +26,18 @@
 #include <celib/yng.h>
 #include <cetech/kernel/kernel.h>
 #include <cetech/resource/builddb.h>
+#include <celib/fs.h>
+#include <celib/hash.inl>
+
+//==============================================================================
+// Defines
+//==============================================================================
+
+// Bump when compiled shader format change.
+#define SHADER_COMPILER_VERSION 1
+
+// shaderc read varyings from this file in input dir.
+#define SHADER_VARYING_DEF "varying.def.sc"
 
 //==============================================================================
 // GLobals
@@ -50,29 +62,29 @@ static int _shaderc(const char *input,
                     const char *profile) {
     struct ce_alloc *a = ce_memory_a0->system;
 
-    char *buffer = NULL;
-
     char *shaderc = ct_resource_a0->compiler_external_join(a, "shaderc");
 
-    ce_buffer_printf(&buffer, a, "%s", shaderc);
-
-    ce_buffer_free(shaderc, a);
-
-    ce_buffer_printf(&buffer, a,
-                     ""
-                     " -f %s"
-                     " -o %s"
-                     " -i %s"
-                     " --type %s"
-                     " --platform %s"
-                     " --profile %s"
+    const char *argv[] = {
+            shaderc,
+            "-f", input,
+            "-o", output,
+            "-i", include_path,
+            "--type", type,
+            "--platform", platform,
+            "--profile", profile,
+            NULL
+    };
 
-                     " 2>&1",  // TODO: move to exec
-                     input, output, include_path, type, platform, profile);
+    char *log = NULL;
+    int status = ce_os_a0->process->run(argv, &log, a);
 
-    int status = ce_os_a0->process->exec(buffer);
+    if (status) {
+        ce_log_a0->error("shaderc", "%s (%d):\n%.*s", input, status,
+                         ce_array_size(log), log);
+    }
 
-    ce_log_a0->debug("shaderc", "STATUS %d", status);
+    ce_array_free(log, a);
+    ce_buffer_free(shaderc, a);
 
     return status;
 }
@@ -116,20 +128,107 @@ const char* vs_profile = "vs_4_0";
 const char* fs_profile = "ps_4_0";
 #endif
 
-static void _compile(const char* filename, uint64_t obj) {
+static bool _add_source_dependency(const char *filename,
+                                   const char *path,
+                                   struct ce_hash_t *visited);
+
+// Include is searched in dir of including file, then in bgfxshaders dir.
+static void _add_include_dependencies(const char *filename,
+                                      const char *path,
+                                      const char *source,
+                                      struct ce_hash_t *visited) {
+    struct ce_alloc *a = ce_memory_a0->system;
+
+    char dir[1024] = {};
+    ce_os_a0->path->dir(dir, path);
+
+    for (const char *line = source; line; line = strchr(line, '\n')) {
+        line += ('\n' == *line);
+
+        char include[512] = {};
+        if (1 != sscanf(line, " # include %*[\"<]%511[^\">\n]", include)) {
+            continue;
+        }
+
+        char *include_path = NULL;
+        ce_os_a0->path->join(&include_path, a, 2, dir, include);
+
+        if (!_add_source_dependency(filename, include_path, visited)) {
+            ce_buffer_clear(include_path);
+            ce_os_a0->path->join(&include_path, a, 2, "bgfxshaders", include);
+
+            _add_source_dependency(filename, include_path, visited);
+        }
+
+        ce_buffer_free(include_path, a);
+    }
+}
+
+// Add shader source and all its includes as dependency of filename.
+static bool _add_source_dependency(const char *filename,
+                                   const char *path,
+                                   struct ce_hash_t *visited) {
+    struct ce_alloc *a = ce_memory_a0->system;
+
+    const uint64_t path_id = ce_id_a0->id64(path);
+    if (ce_hash_contain(visited, path_id)) {
+        return true;
+    }
+
+    char full_path[1024] = {};
+    ce_fs_a0->get_full_path(SOURCE_ROOT, path, full_path,
+                            CE_ARRAY_LEN(full_path));
+
+    struct ce_vio *vio = ce_os_a0->vio->from_file(full_path, VIO_OPEN_READ);
+    if (!vio) {
+        return false;
+    }
+
+    ce_hash_add(visited, path_id, 1, a);
+    ct_builddb_a0->add_dependency(filename, path);
+
+    const int64_t size = vio->size(vio);
+    char *source = CE_ALLOC(a, char, size + 1);
+    source[vio->read(vio, source, 1, size)] = '\0';
+    vio->close(vio);
+
+    _add_include_dependencies(filename, path, source, visited);
+
+    CE_FREE(a, source);
+    return true;
+}
+
+static void _add_shader_dependencies(const char *filename,
+                                     const char *input,
+                                     struct ce_hash_t *visited) {
+    struct ce_alloc *a = ce_memory_a0->system;
+
+    ct_builddb_a0->add_dependency(filename, input);
+    _add_source_dependency(filename, input, visited);
+
+    char dir[1024] = {};
+    ce_os_a0->path->dir(dir, input);
+
+    char *varying_path = NULL;
+    ce_os_a0->path->join(&varying_path, a, 2, dir, SHADER_VARYING_DEF);
+    _add_source_dependency(filename, varying_path, visited);
+    ce_buffer_free(varying_path, a);
+}
+
+static bool _compile(const char* filename, uint64_t obj) {
     const char *vs_input = ce_cdb_a0->read_str(obj, SHADER_VS_INPUT, "");
     const char *fs_input = ce_cdb_a0->read_str(obj, SHADER_FS_INPUT, "");
 
-    ct_builddb_a0->add_dependency(filename, vs_input);
-    ct_builddb_a0->add_dependency(filename, fs_input);
+    struct ce_hash_t visited = {};
+    _add_shader_dependencies(filename, vs_input, &visited);
+    _add_shader_dependencies(filename, fs_input, &visited);
+    ce_hash_free(&visited, ce_memory_a0->system);
 
     struct ce_alloc *a = ce_memory_a0->system;
 
     const char *source_dir =  ce_cdb_a0->read_str(ce_config_a0->obj(), CONFIG_SRC, "");
     const char *core_dir = ce_cdb_a0->read_str(ce_config_a0->obj(), CONFIG_CORE, "");
 
-    ce_cdb_obj_o *w = ce_cdb_a0->write_begin(obj);
-
     char *include_dir = NULL;
     ce_os_a0->path->join(&include_dir, a, 2, core_dir, "bgfxshaders");
 
@@ -159,16 +258,18 @@ static void _compile(const char* filename, uint64_t obj) {
 
     if (result != 0) {
         ce_buffer_free(include_dir, a);
-        return;
+        return false;
     }
 
 
+    // Output is complete, shaderc exited.
     struct ce_vio *tmp_file;
-
-    do {
-        tmp_file = ce_os_a0->vio->from_file(output_path, VIO_OPEN_READ);
-    } while (tmp_file == NULL);
-
+    tmp_file = ce_os_a0->vio->from_file(output_path, VIO_OPEN_READ);
+    if (!tmp_file) {
+        ce_log_a0->error("shaderc", "Could not open output %s", output_path);
+        ce_buffer_free(include_dir, a);
+        return false;
+    }
 
     char *vs_data = CE_ALLOC(ce_memory_a0->system, char,
                              tmp_file->size(tmp_file) + 1);
@@ -177,8 +278,6 @@ static void _compile(const char* filename, uint64_t obj) {
     tmp_file->read(tmp_file, vs_data, sizeof(char), vs_data_size);
     tmp_file->close(tmp_file);
 
-    ce_cdb_a0->set_blob(w, SHADER_VS_DATA, vs_data, vs_data_size);
-
     ///////
 
     //////// FS
@@ -196,11 +295,19 @@ static void _compile(const char* filename, uint64_t obj) {
     ce_buffer_free(input_path, a);
 
     if (result != 0) {
+        CE_FREE(a, vs_data);
         ce_buffer_free(include_dir, a);
-        return;
+        return false;
     }
 
     tmp_file = ce_os_a0->vio->from_file(output_path, VIO_OPEN_READ);
+    if (!tmp_file) {
+        ce_log_a0->error("shaderc", "Could not open output %s", output_path);
+        CE_FREE(a, vs_data);
+        ce_buffer_free(include_dir, a);
+        return false;
+    }
+
     char *fs_data = CE_ALLOC(ce_memory_a0->system, char,
                              tmp_file->size(tmp_file) + 1);
 
@@ -208,12 +315,15 @@ static void _compile(const char* filename, uint64_t obj) {
     tmp_file->read(tmp_file, fs_data, sizeof(char), fs_data_size);
     tmp_file->close(tmp_file);
 
+    ce_cdb_obj_o *w = ce_cdb_a0->write_begin(obj);
+    ce_cdb_a0->set_blob(w, SHADER_VS_DATA, vs_data, vs_data_size);
     ce_cdb_a0->set_blob(w, SHADER_FS_DATA, fs_data, fs_data_size);
     ce_cdb_a0->write_commit(w);
 
     CE_FREE(a, vs_data);
     CE_FREE(a, fs_data);
     ce_buffer_free(include_dir, a);
+    return true;
 }
 
 void shader_compiler(const char *filename,
@@ -242,9 +352,11 @@ void shader_compiler(const char *filename,
 
     ce_cdb_a0->write_commit(w);
 
-    _compile(filename, obj);
+    // Empty output fail resource.
+    if (_compile(filename, obj)) {
+        ce_cdb_a0->dump(obj, output, a);
+    }
 
-    ce_cdb_a0->dump(obj, output, a);
     ce_cdb_a0->destroy_object(obj);
 }
 
@@ -252,11 +364,7 @@ void shader_compiler(const char *filename,
 static void online(uint64_t name,
                    struct ce_vio *input,
                    uint64_t obj) {
-    const uint64_t size = input->size(input);
-    char *data = CE_ALLOC(_G.allocator, char, size);
-    input->read(input, data, 1, size);
-
-    ce_cdb_a0->load(ce_cdb_a0->db(), data, obj, _G.allocator);
+    ce_cdb_a0->load_mapped(ce_cdb_a0->db(), input, obj, _G.allocator);
 
 //    ce_cdb_a0->register_notify(obj, _on_obj_change, NULL);
 
@@ -297,6 +405,27 @@ static uint64_t cdb_type() {
     return SHADER_TYPE;
 }
 
+// Compiled shader depends on shaderc binary and arguments not in source.
+static uint64_t compiler_version() {
+    const uint64_t config = ce_config_a0->obj();
+
+    const char *args[] = {
+            ce_cdb_a0->read_str(config, CONFIG_CORE, ""),
+            ce_cdb_a0->read_str(config, CONFIG_PLATFORM, ""),
+            vs_profile,
+            fs_profile,
+    };
+
+    uint64_t version = SHADER_COMPILER_VERSION;
+    version += ct_resource_a0->compiler_external_hash("shaderc");
+
+    for (uint32_t i = 0; i < CE_ARRAY_LEN(args); ++i) {
+        version = ce_hash_murmur2_64(args[i], strlen(args[i]), version);
+    }
+
+    return version;
+}
+
 void shader_compiler(const char *filename,
                      char **output);
 
@@ -305,6 +434,7 @@ static struct ct_resource_i0 ct_resource_i0 = {
         .online = online,
         .offline = offline,
         .compilator = shader_compiler,
+        .compiler_version = compiler_version,
 };
 
 //==============================================================================
@@ -346,6 +476,7 @@ CE_MODULE_DEF(
             CE_INIT_API(api, ce_id_a0);
             CE_INIT_API(api, ce_cdb_a0);
             CE_INIT_API(api, ct_renderer_a0);
+            CE_INIT_API(api, ce_fs_a0);
         },
         {
             CE_UNUSED(reload);
@@ -28,6 +28,13 @@
 #include <cetech/resource/builddb.h>
 #include <cetech/editor/asset_preview.h>
 
+//==============================================================================
+// Defines
+//==============================================================================
+
+// Bump when compiled texture format change.
+#define TEXTURE_COMPILER_VERSION 1
+
 //==============================================================================
 // GLobals
 //==============================================================================
@@ -56,11 +63,7 @@ void _texture_resource_online(uint64_t name,
                               struct ce_vio *input,
                               uint64_t obj) {
 
-    const uint64_t size = input->size(input);
-    char *data = CE_ALLOC(_G.allocator, char, size);
-    input->read(input, data, 1, size);
-
-    ce_cdb_a0->load(ce_cdb_a0->db(), data, obj, _G.allocator);
+    ce_cdb_a0->load_mapped(ce_cdb_a0->db(), input, obj, _G.allocator);
 
     ce_cdb_a0->register_notify(obj, _on_obj_change, NULL);
 
@@ -94,28 +97,30 @@ static int _texturec(const char *input,
                      int gen_mipmaps,
                      int is_normalmap) {
     struct ce_alloc *alloc = ce_memory_a0->system;
-    char *buffer = NULL;
 
     char *texturec = ct_resource_a0->compiler_external_join(alloc, "texturec");
 
-    ce_buffer_printf(&buffer, alloc, "%s", texturec);
-    ce_buffer_free(texturec, alloc);
-
-    ce_buffer_printf(&buffer, alloc, " -f %s -o %s", input, output);
+    const char *argv[8] = {texturec, "-f", input, "-o", output};
+    uint32_t argc = 5;
 
     if (gen_mipmaps) {
-        ce_buffer_printf(&buffer, alloc, " %s", "--mips");
+        argv[argc++] = "--mips";
     }
 
     if (is_normalmap) {
-        ce_buffer_printf(&buffer, alloc, " %s", "--normalmap");
+        argv[argc++] = "--normalmap";
     }
 
-    ce_buffer_printf(&buffer, alloc, " %s", "2>&1");
+    char *log = NULL;
+    int status = ce_os_a0->process->run(argv, &log, alloc);
 
-    int status = ce_os_a0->process->exec(buffer);
+    if (status) {
+        ce_log_a0->error("texturec", "%s (%d):\n%.*s", input, status,
+                         ce_array_size(log), log);
+    }
 
-    ce_log_a0->info("application", "STATUS %d", status);
+    ce_array_free(log, alloc);
+    ce_buffer_free(texturec, alloc);
 
     return status;
 }
@@ -143,7 +148,7 @@ static int _gen_tmp_name(char *tmp_filename,
     return ret;
 }
 
-static void _compile(uint64_t obj) {
+static bool _compile(uint64_t obj) {
     const char *input = ce_cdb_a0->read_str(obj, TEXTURE_INPUT, "");
     bool gen_mipmaps = ce_cdb_a0->read_bool(obj, TEXTURE_GEN_MIPMAPS, false);
     bool is_normalmap = ce_cdb_a0->read_bool(obj, TEXTURE_IS_NORMALMAP, false);
@@ -169,11 +174,15 @@ static void _compile(uint64_t obj) {
 
     int result = _texturec(input_path, output_path, gen_mipmaps, is_normalmap);
     if (result != 0) {
-        return;
+        return false;
     }
 
     struct ce_vio *tmp_file = NULL;
     tmp_file = ce_os_a0->vio->from_file(output_path, VIO_OPEN_READ);
+    if (!tmp_file) {
+        ce_log_a0->error("texturec", "Could not open output %s", output_path);
+        return false;
+    }
 
     const uint64_t size = tmp_file->size(tmp_file);
     char *tmp_data = CE_ALLOC(ce_memory_a0->system, char, size + 1);
@@ -183,6 +192,7 @@ static void _compile(uint64_t obj) {
     ce_cdb_obj_o *w = ce_cdb_a0->write_begin(obj);
     ce_cdb_a0->set_blob(w, TEXTURE_DATA, tmp_data, size);
     ce_cdb_a0->write_commit(w);
+    return true;
 }
 
 
@@ -203,9 +213,7 @@ static void _on_obj_change(uint64_t obj,
         }
     }
 
-    if (change) {
-        _compile(obj);
-
+    if (change && _compile(obj)) {
         uint64_t blob_size = 0;
         void *blob;
         blob = ce_cdb_a0->read_blob(obj, TEXTURE_DATA, &blob_size, 0);
@@ -246,9 +254,11 @@ void texture_compiler(const char *filename,
     ce_cdb_a0->set_bool(w, TEXTURE_IS_NORMALMAP, is_normalmap);
     ce_cdb_a0->write_commit(w);
 
-    _compile(obj);
+    // Empty output fail resource.
+    if (_compile(obj)) {
+        ce_cdb_a0->dump(obj, output, a);
+    }
 
-    ce_cdb_a0->dump(obj, output, a);
     ce_cdb_a0->destroy_object(obj);
 
     ct_builddb_a0->add_dependency(filename, input_str);
@@ -258,6 +268,12 @@ static uint64_t cdb_type() {
     return TEXTURE_TYPE;
 }
 
+// texturec options are read from source, only binary is not in source key.
+static uint64_t compiler_version() {
+    return TEXTURE_COMPILER_VERSION +
+           ct_resource_a0->compiler_external_hash("texturec");
+}
+
 static void draw_property(uint64_t obj) {
 
     ct_editor_ui_a0->ui_str(obj, TEXTURE_INPUT, "Input", 0);
@@ -329,6 +345,7 @@ static struct ct_resource_i0 ct_resource_i0 = {
         .online =_texture_resource_online,
         .offline =_texture_resource_offline,
         .compilator = texture_compiler,
+        .compiler_version = compiler_version,
 };
 
 
@@ -27,8 +27,11 @@ struct ct_entity;
 #define SCENE_VB_PROP   \
     CE_ID64_0("vb", 0x483690c3614b4c35ULL)
 
-#define SCENE_SIZE_PROP \
-    CE_ID64_0("size", 0x6687058679006e12ULL)
+#define SCENE_IB_COUNT \
+    CE_ID64_0("ib_count", 0x366d49d40fbd3bf6ULL)
+
+#define SCENE_VB_COUNT \
+    CE_ID64_0("vb_count", 0xfdc50be24e000fcfULL)
 
 #define SCENE_GEOM_COUNT \
     CE_ID64_0("geom_count", 0x423934fe3be0af59ULL)
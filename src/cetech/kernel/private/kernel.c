@@ -264,6 +264,7 @@ static void cetech_kernel_start() {
         float dt = ((float) (now_ticks - last_tick)) / fq;
         last_tick = now_ticks;
 
+        // Destroy events broadcasted in last frame.
         ce_ebus_a0->begin_frame();
 
         uint64_t event;
@@ -272,6 +273,8 @@ static void cetech_kernel_start() {
         ce_cdb_a0->set_float(w, KERNEL_EVENT_DT, dt);
         ce_cdb_a0->write_commit(w);
 
+        ce_cdb_a0->flush_notify();
+
         ce_ebus_a0->broadcast(KERNEL_EBUS, event);
 
         ce_cdb_a0->gc();
@@ -282,6 +285,9 @@ static void cetech_kernel_start() {
 
     ce_ebus_a0->disconnect(KERNEL_EBUS, KERNEL_QUIT_EVENT, on_quit);
 
+    ce_ebus_a0->begin_frame();
+    ce_cdb_a0->gc();
+
     _boot_unload();
 }
 
@@ -1,6 +1,7 @@
 #ifndef CETECH_BUILDDB_H
 #define CETECH_BUILDDB_H
 
+struct ce_alloc;
 
 struct ct_builddb_a0 {
     void (*put_file)(const char *filename,
@@ -22,6 +23,22 @@ struct ct_builddb_a0 {
                          const char *depend_on_filename);
 
     int (*need_compile)(const char *filename);
+
+    // Files that filename depend on, strings are owned by builddb.
+    void (*get_dependencies)(const char *filename,
+                             const char ***depends,
+                             struct ce_alloc *allocator);
+
+    // Files that depend on filename, strings are owned by builddb.
+    void (*get_dependents)(const char *filename,
+                           const char ***dependents,
+                           struct ce_alloc *allocator);
+
+    // Forget dependencies of filename before compile record new one.
+    void (*clear_dependencies)(const char *filename);
+
+    // Write changes to disk in one transaction, call after compile batch.
+    void (*flush)();
 };
 
 CE_MODULE(ct_builddb_a0);
@@ -15,6 +15,8 @@
 #include <celib/cdb.h>
 #include <celib/config.h>
 #include <celib/buffer.inl>
+#include <celib/array.inl>
+#include <celib/hash.inl>
 #include <cetech/resource/resource.h>
 
 #include "cetech/resource/builddb.h"
@@ -55,14 +57,54 @@ static int _step(sqlite3 *db,
 
 
 
-static char *_logdb_path = NULL;
+#define _G BuildDBGlobal
+
+struct file_t {
+    char *filename;
+    uint64_t type;
+    uint64_t name;
+    time_t mtime;
+
+    // Have row in files table, dependency only files have not.
+    bool stored;
+    bool dirty;
+    bool depend_cleared;
+
+    uint32_t *depend_on;
+};
+
+struct depend_t {
+    uint32_t file;
+    uint32_t depend_on;
+};
+
+static struct _G {
+    char *logdb_path;
+    sqlite3 *db;
+    sqlite3_stmt *put_file_stmt;
+    sqlite3_stmt *set_depend_stmt;
+    sqlite3_stmt *clear_depend_stmt;
+
+    // Resident index, file_t are never removed so idx are stable.
+    struct file_t *files;
+    struct ce_hash_t file_map;
+    struct ce_hash_t build_map;
+
+    // Changes waiting for flush
+    uint32_t *dirty_files;
+    uint32_t *cleared_files;
+    struct depend_t *dirty_depends;
+
+    struct ce_spinlock lock;
+    struct ce_alloc *allocator;
+} _G;
 
 static sqlite3 *_opendb() {
     sqlite3 *_db;
-    sqlite3_open_v2(_logdb_path,
+    sqlite3_open_v2(_G.logdb_path,
                     &_db,
                     SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
-                    SQLITE_OPEN_SHAREDCACHE | SQLITE_OPEN_FULLMUTEX,
+                    SQLITE_OPEN_FULLMUTEX,
                     NULL);
 
     // thanks http://stackoverflow.com/questions/1711631/improve-insert-per-second-performance-of-sqlite
@@ -74,24 +116,166 @@ static sqlite3 *_opendb() {
 
 
 static int _do_sql(const char *sql) {
-    sqlite3 *_db = _opendb();
     sqlite3_stmt *stmt;
-    sqlite3_prepare_v2(_db, sql, -1, &stmt, NULL);
+    sqlite3_prepare_v2(_G.db, sql, -1, &stmt, NULL);
+
+    int ok = _step(_G.db, stmt) == SQLITE_DONE;
+
+    sqlite3_finalize(stmt);
+
+    return ok;
+}
+
+static uint64_t _str_hash(const char *str) {
+    return ce_hash_murmur2_64(str, strlen(str), 0);
+}
+
+static uint64_t _build_hash(uint64_t type,
+                            uint64_t name) {
+    char build_name[128] = {};
+    snprintf(build_name, CE_ARRAY_LEN(build_name), "%" PRIx64 "%" PRIx64,
+             type, name);
+
+    return _str_hash(build_name);
+}
+
+static void type_name_from_filename(const char *fullname,
+                             struct ct_resource_id *resource_id,
+                             char *short_name) {
+
+    const char *resource_type = ce_os_a0->path->extension(fullname);
+
+    size_t size = strlen(fullname) - strlen(resource_type) - 1;
+
+    char resource_name[128] = {};
+    memcpy(resource_name, fullname, size);
+
+    resource_id->name = ce_id_a0->id64(resource_name);
+    resource_id->type = ce_id_a0->id64(resource_type);
+
+    if (short_name) {
+        memcpy(short_name, fullname, sizeof(char) * size);
+        short_name[size] = '\0';
+    }
+}
+
+// Colliding filenames are stored under next free key, files are never
+// removed so probe end on first free key.
+// Call with lock, key is set to key of file or first free key.
+static uint32_t _probe_file(const char *filename,
+                            uint64_t *key) {
+    *key = _str_hash(filename);
+
+    while (true) {
+        if (UINT64_MAX == *key) {
+            *key = 0;
+        }
+
+        uint64_t idx = ce_hash_lookup(&_G.file_map, *key, UINT64_MAX);
+
+        if (UINT64_MAX == idx) {
+            return UINT32_MAX;
+        }
+
+        if (!strcmp(_G.files[idx].filename, filename)) {
+            return (uint32_t) idx;
+        }
+
+        ++*key;
+    }
+}
+
+// Call with lock
+static uint32_t _find_file(const char *filename) {
+    uint64_t key;
+    return _probe_file(filename, &key);
+}
+
+// Call with lock
+static uint32_t _get_file(const char *filename) {
+    uint64_t key;
+    uint32_t idx = _probe_file(filename, &key);
+    if (UINT32_MAX != idx) {
+        return idx;
+    }
+
+    idx = ce_array_size(_G.files);
+
+    struct file_t file = {
+            .filename = ce_memory_a0->str_dup(filename, _G.allocator),
+    };
+
+    ce_array_push(_G.files, file, _G.allocator);
+    ce_hash_add(&_G.file_map, key, idx, _G.allocator);
+
+    return idx;
+}
+
+// Call with lock
+static void _set_file(uint32_t idx,
+                      uint64_t type,
+                      uint64_t name,
+                      time_t mtime) {
+    struct file_t *file = &_G.files[idx];
+
+    file->type = type;
+    file->name = name;
+    file->mtime = mtime;
+    file->stored = true;
+
+    ce_hash_add(&_G.build_map, _build_hash(type, name), idx, _G.allocator);
+}
+
+// Call with lock
+static bool _set_depend(uint32_t idx,
+                        uint32_t depend_idx) {
+    struct file_t *file = &_G.files[idx];
+
+    const uint32_t n = ce_array_size(file->depend_on);
+    for (uint32_t i = 0; i < n; ++i) {
+        if (file->depend_on[i] == depend_idx) {
+            return false;
+        }
+    }
+
+    ce_array_push(file->depend_on, depend_idx, _G.allocator);
+    return true;
+}
+
+static void _load_index() {
+    sqlite3_stmt *stmt;
+
+    sqlite3_prepare_v2(_G.db,
+                       "SELECT filename, name, type, mtime FROM files;",
+                       -1, &stmt, NULL);
 
-    if (_step(_db, stmt) != SQLITE_DONE) {
-        goto error;
+    while (_step(_G.db, stmt) == SQLITE_ROW) {
+        const char *filename = (const char *) sqlite3_column_text(stmt, 0);
+
+        _set_file(_get_file(filename),
+                  sqlite3_column_int64(stmt, 2),
+                  sqlite3_column_int64(stmt, 1),
+                  sqlite3_column_int64(stmt, 3));
     }
 
     sqlite3_finalize(stmt);
-    sqlite3_close_v2(_db);
 
-    return 1;
+    sqlite3_prepare_v2(_G.db,
+                       "SELECT filename, depend_on FROM file_dependency;",
+                       -1, &stmt, NULL);
+
+    while (_step(_G.db, stmt) == SQLITE_ROW) {
+        const char *filename = (const char *) sqlite3_column_text(stmt, 0);
+        const char *depend_on = (const char *) sqlite3_column_text(stmt, 1);
+
+        uint32_t idx = _get_file(filename);
+        _set_depend(idx, _get_file(depend_on));
+    }
 
-    error:
     sqlite3_finalize(stmt);
-    sqlite3_close_v2(_db);
 
-    return 0;
+    ce_log_a0->debug("builddb", "Loaded %u files",
+                     ce_array_size(_G.files));
 }
 
 static int builddb_init_db() {
@@ -105,10 +289,12 @@ static int builddb_init_db() {
     ce_os_a0->path->join(&build_dir_full, ce_memory_a0->system, 2, build_dir_str, platform);
     ce_os_a0->path->make_path(build_dir_full);
 
-    ce_os_a0->path->join(&_logdb_path, ce_memory_a0->system, 2, build_dir_full, "build.db");
+    ce_os_a0->path->join(&_G.logdb_path, ce_memory_a0->system, 2, build_dir_full, "build.db");
 
     ce_buffer_free(build_dir_full, ce_memory_a0->system);
 
+    _G.db = _opendb();
+
     if (!_do_sql("CREATE TABLE IF NOT EXISTS files (\n"
                  "id       INTEGER PRIMARY KEY    AUTOINCREMENT    NOT NULL,\n"
                  "filename TEXT    UNIQUE                          NOT NULL,\n"
@@ -128,162 +314,295 @@ static int builddb_init_db() {
         return 0;
     }
 
-    return 1;
-}
-
-static void type_name_from_filename(const char *fullname,
-                             struct ct_resource_id *resource_id,
-                             char *short_name) {
+    sqlite3_prepare_v2(_G.db,
+                       "INSERT OR REPLACE INTO files VALUES(NULL, ?1, ?2, ?3, ?4, ?5);",
+                       -1, &_G.put_file_stmt, NULL);
 
-    const char *resource_type = ce_os_a0->path->extension(fullname);
-
-    size_t size = strlen(fullname) - strlen(resource_type) - 1;
+    sqlite3_prepare_v2(_G.db,
+                       "INSERT INTO file_dependency (filename, depend_on) VALUES(?1, ?2);",
+                       -1, &_G.set_depend_stmt, NULL);
 
-    char resource_name[128] = {};
-    memcpy(resource_name, fullname, size);
+    sqlite3_prepare_v2(_G.db,
+                       "DELETE FROM file_dependency WHERE filename = ?1;",
+                       -1, &_G.clear_depend_stmt, NULL);
 
-    resource_id->name = ce_id_a0->id64(resource_name);
-    resource_id->type = ce_id_a0->id64(resource_type);
+    _load_index();
 
-    if (short_name) {
-        memcpy(short_name, fullname, sizeof(char) * size);
-        short_name[size] = '\0';
-    }
+    return 1;
 }
 
 static void builddb_set_file(const char *filename,
                              time_t mtime) {
-    static const char *sql = "INSERT OR REPLACE INTO files VALUES(NULL, ?1, ?2, ?3, ?4, ?5);";
-
-    sqlite3 *_db = _opendb();
-    sqlite3_stmt *stmt;
-    sqlite3_prepare_v2(_db, sql, -1, &stmt, NULL);
-
-
     struct ct_resource_id rid;
-
     type_name_from_filename(filename, &rid, NULL);
 
-    char build_name[128] = {};
-    snprintf(build_name, CE_ARRAY_LEN(build_name), "%" PRIx64 "%" PRIx64, rid.type, rid.name);
+    ce_os_a0->thread->spin_lock(&_G.lock);
 
-    sqlite3_bind_text(stmt, 1, filename, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, build_name, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int64(stmt, 3, rid.name);
-    sqlite3_bind_int64(stmt, 4, rid.type);
-    sqlite3_bind_int64(stmt, 5, mtime);
-    _step(_db, stmt);
+    uint32_t idx = _get_file(filename);
+    _set_file(idx, rid.type, rid.name, mtime);
 
-    sqlite3_finalize(stmt);
-    sqlite3_close_v2(_db);
+    if (!_G.files[idx].dirty) {
+        _G.files[idx].dirty = true;
+        ce_array_push(_G.dirty_files, idx, _G.allocator);
+    }
+
+    ce_os_a0->thread->spin_unlock(&_G.lock);
 }
 
 static void builddb_set_file_depend(const char *filename,
                                     const char *depend_on) {
-    static const char *sql = "INSERT INTO file_dependency (filename, depend_on) SELECT ?1, ?2 WHERE NOT EXISTS(SELECT 1 FROM file_dependency WHERE filename = ?1 AND depend_on = ?2);";
+    ce_os_a0->thread->spin_lock(&_G.lock);
 
-    sqlite3 *_db = _opendb();
-    sqlite3_stmt *stmt;
-    sqlite3_prepare_v2(_db, sql, -1, &stmt, NULL);
-
-    sqlite3_bind_text(stmt, 1, filename, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, depend_on, -1, SQLITE_TRANSIENT);
+    uint32_t idx = _get_file(filename);
+    uint32_t depend_idx = _get_file(depend_on);
 
-    _step(_db, stmt);
+    if (_set_depend(idx, depend_idx)) {
+        struct depend_t depend = {.file = idx, .depend_on = depend_idx};
+        ce_array_push(_G.dirty_depends, depend, _G.allocator);
+    }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close_v2(_db);
+    ce_os_a0->thread->spin_unlock(&_G.lock);
 }
 
-static int builddb_get_filename_by_hash(char *filename,
-                                        size_t max_len,
-                                        const char *hash) {
-    static const char *sql = "SELECT filename FROM files WHERE hash = ?1;";
+// Dependencies are recorded again by compile, stale would stay forever.
+static void builddb_clear_dependencies(const char *filename) {
+    ce_os_a0->thread->spin_lock(&_G.lock);
 
-    sqlite3 *_db = _opendb();
-    sqlite3_stmt *stmt;
-    sqlite3_prepare_v2(_db, sql, -1, &stmt, NULL);
+    uint32_t idx = _find_file(filename);
+    if (UINT32_MAX == idx) {
+        ce_os_a0->thread->spin_unlock(&_G.lock);
+        return;
+    }
+
+    struct file_t *file = &_G.files[idx];
+    ce_array_clean(file->depend_on);
+
+    if (!file->depend_cleared) {
+        file->depend_cleared = true;
+        ce_array_push(_G.cleared_files, idx, _G.allocator);
+    }
 
-    sqlite3_bind_text(stmt, 1, hash, -1, SQLITE_TRANSIENT);
+    for (uint32_t i = 0; i < ce_array_size(_G.dirty_depends);) {
+        if (_G.dirty_depends[i].file != idx) {
+            ++i;
+            continue;
+        }
+
+        _G.dirty_depends[i] = ce_array_back(_G.dirty_depends);
+        ce_array_pop_back(_G.dirty_depends);
+    }
 
-    int ok = 0;
-    while (_step(_db, stmt) == SQLITE_ROW) {
-        const unsigned char*fn = sqlite3_column_text(stmt, 0);
+    ce_os_a0->thread->spin_unlock(&_G.lock);
+}
+
+static int _get_filename_by_build(char *filename,
+                                  size_t max_len,
+                                  uint64_t build_hash) {
+    ce_os_a0->thread->spin_lock(&_G.lock);
 
-        snprintf(filename, max_len, "%s", fn);
+    uint64_t idx = ce_hash_lookup(&_G.build_map, build_hash, UINT64_MAX);
+    if (UINT64_MAX != idx) {
+        snprintf(filename, max_len, "%s", _G.files[idx].filename);
     }
-    ok = 1;
 
-    sqlite3_finalize(stmt);
-    sqlite3_close_v2(_db);
+    ce_os_a0->thread->spin_unlock(&_G.lock);
 
-    return ok;
+    return UINT64_MAX != idx;
+}
+
+static int builddb_get_filename_by_hash(char *filename,
+                                        size_t max_len,
+                                        const char *hash) {
+    return _get_filename_by_build(filename, max_len, _str_hash(hash));
 }
 
 static int buildb_get_filename_type_name(char *filename,
                               size_t max_len,
                               uint64_t type,
                               uint64_t  name) {
+    return _get_filename_by_build(filename, max_len, _build_hash(type, name));
+}
 
-    static const char *sql = "SELECT filename FROM files WHERE type = ?1 AND name = ?2;";
+struct depend_mtime_t {
+    const char *filename;
+    time_t mtime;
+};
 
-    sqlite3 *_db = _opendb();
-    sqlite3_stmt *stmt;
-    sqlite3_prepare_v2(_db, sql, -1, &stmt, NULL);
+static int builddb_need_compile(const char *filename) {
+    struct depend_mtime_t *depends = NULL;
+
+    ce_os_a0->thread->spin_lock(&_G.lock);
+
+    uint32_t idx = _find_file(filename);
+    if (UINT32_MAX != idx) {
+        const struct file_t *file = &_G.files[idx];
+        const uint32_t n = ce_array_size(file->depend_on);
 
-    sqlite3_bind_int64(stmt, 1, type);
-    sqlite3_bind_int64(stmt, 2, name);
+        for (uint32_t i = 0; i < n; ++i) {
+            const struct file_t *dep = &_G.files[file->depend_on[i]];
 
-    int ok = 0;
-    while (_step(_db, stmt) == SQLITE_ROW) {
-        const unsigned char*fn = sqlite3_column_text(stmt, 0);
+            if (!dep->stored) {
+                continue;
+            }
 
-        snprintf(filename, max_len, "%s", fn);
+            struct depend_mtime_t item = {
+                    .filename = dep->filename,
+                    .mtime = dep->mtime,
+            };
+            ce_array_push(depends, item, _G.allocator);
+        }
     }
-    ok = 1;
 
-    sqlite3_finalize(stmt);
-    sqlite3_close_v2(_db);
+    ce_os_a0->thread->spin_unlock(&_G.lock);
 
-    return ok;
+    // Filenames are never freed, stat files without lock.
+    int compile = !ce_array_size(depends);
+    for (uint32_t i = 0; i < ce_array_size(depends); ++i) {
+        time_t actual_mtime = ce_fs_a0->file_mtime(SOURCE_ROOT,
+                                                   depends[i].filename);
+
+        if (actual_mtime != depends[i].mtime) {
+            compile = 1;
+            break;
+        }
+    }
+
+    ce_array_free(depends, _G.allocator);
+
+    return compile;
 }
 
-static int builddb_need_compile(const char *filename) {
-    static const char *sql = "SELECT\n"
-                             "    file_dependency.depend_on, files.mtime\n"
-                             "FROM\n"
-                             "    file_dependency\n"
-                             "JOIN\n"
-                             "    files on files.filename == file_dependency.depend_on\n"
-                             "WHERE\n"
-                             "    file_dependency.filename = ?1\n";
-
-    int compile = 1;
-
-    sqlite3 *_db = _opendb();
-    sqlite3_stmt *stmt;
-    sqlite3_prepare_v2(_db, sql, -1, &stmt, NULL);
+static void builddb_get_dependencies(const char *filename,
+                                     const char ***depends,
+                                     struct ce_alloc *allocator) {
+    ce_os_a0->thread->spin_lock(&_G.lock);
 
-    sqlite3_bind_text(stmt, 1, filename, -1, SQLITE_TRANSIENT);
+    uint32_t idx = _find_file(filename);
+    if (UINT32_MAX != idx) {
+        const struct file_t *file = &_G.files[idx];
+        const uint32_t n = ce_array_size(file->depend_on);
 
-    while (_step(_db, stmt) == SQLITE_ROW) {
-        compile = 0;
-        const char *dep_file = (const char *) sqlite3_column_text(stmt, 0);
+        for (uint32_t i = 0; i < n; ++i) {
+            ce_array_push(*depends, _G.files[file->depend_on[i]].filename,
+                          allocator);
+        }
+    }
 
-        time_t actual_mtime = ce_fs_a0->file_mtime(SOURCE_ROOT, dep_file);
+    ce_os_a0->thread->spin_unlock(&_G.lock);
+}
 
-        time_t last_mtime = sqlite3_column_int64(stmt, 1);
+// Reverse edges are not stored, scan resident index.
+static void builddb_get_dependents(const char *filename,
+                                   const char ***dependents,
+                                   struct ce_alloc *allocator) {
+    ce_os_a0->thread->spin_lock(&_G.lock);
 
-        if (actual_mtime != last_mtime) {
-            compile = 1;
-            break;
+    uint32_t idx = _find_file(filename);
+    if (UINT32_MAX != idx) {
+        const uint32_t files_n = ce_array_size(_G.files);
+
+        for (uint32_t i = 0; i < files_n; ++i) {
+            const struct file_t *file = &_G.files[i];
+
+            if (i == idx) {
+                continue;
+            }
+
+            for (uint32_t j = 0; j < ce_array_size(file->depend_on); ++j) {
+                if (file->depend_on[j] == idx) {
+                    ce_array_push(*dependents, file->filename, allocator);
+                    break;
+                }
+            }
         }
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close_v2(_db);
+    ce_os_a0->thread->spin_unlock(&_G.lock);
+}
 
-    return compile;
+// Write changes since last flush in one transaction.
+static void builddb_flush() {
+    struct file_t *files = NULL;
+    const char **cleared = NULL;
+    const char **depends = NULL;
+
+    ce_os_a0->thread->spin_lock(&_G.lock);
+
+    for (uint32_t i = 0; i < ce_array_size(_G.cleared_files); ++i) {
+        struct file_t *file = &_G.files[_G.cleared_files[i]];
+        file->depend_cleared = false;
+        ce_array_push(cleared, file->filename, _G.allocator);
+    }
+
+    for (uint32_t i = 0; i < ce_array_size(_G.dirty_files); ++i) {
+        struct file_t *file = &_G.files[_G.dirty_files[i]];
+        file->dirty = false;
+        ce_array_push(files, *file, _G.allocator);
+    }
+
+    // Filenames are never freed, write them without lock.
+    for (uint32_t i = 0; i < ce_array_size(_G.dirty_depends); ++i) {
+        struct depend_t *depend = &_G.dirty_depends[i];
+        ce_array_push(depends, _G.files[depend->file].filename, _G.allocator);
+        ce_array_push(depends, _G.files[depend->depend_on].filename,
+                      _G.allocator);
+    }
+
+    ce_array_clean(_G.dirty_files);
+    ce_array_clean(_G.cleared_files);
+    ce_array_clean(_G.dirty_depends);
+
+    ce_os_a0->thread->spin_unlock(&_G.lock);
+
+    if (!ce_array_size(files) && !ce_array_size(cleared) &&
+        !ce_array_size(depends)) {
+        ce_array_free(cleared, _G.allocator);
+        return;
+    }
+
+    sqlite3_exec(_G.db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+
+    sqlite3_stmt *stmt = _G.put_file_stmt;
+    for (uint32_t i = 0; i < ce_array_size(files); ++i) {
+        struct file_t *file = &files[i];
+
+        char build_name[128] = {};
+        snprintf(build_name, CE_ARRAY_LEN(build_name), "%" PRIx64 "%" PRIx64,
+                 file->type, file->name);
+
+        sqlite3_bind_text(stmt, 1, file->filename, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, build_name, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 3, file->name);
+        sqlite3_bind_int64(stmt, 4, file->type);
+        sqlite3_bind_int64(stmt, 5, file->mtime);
+        _step(_G.db, stmt);
+        sqlite3_reset(stmt);
+    }
+
+    // Before insert, file can be cleared and depend again in one batch.
+    stmt = _G.clear_depend_stmt;
+    for (uint32_t i = 0; i < ce_array_size(cleared); ++i) {
+        sqlite3_bind_text(stmt, 1, cleared[i], -1, SQLITE_STATIC);
+        _step(_G.db, stmt);
+        sqlite3_reset(stmt);
+    }
+
+    stmt = _G.set_depend_stmt;
+    for (uint32_t i = 0; i < ce_array_size(depends); i += 2) {
+        sqlite3_bind_text(stmt, 1, depends[i], -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, depends[i + 1], -1, SQLITE_STATIC);
+        _step(_G.db, stmt);
+        sqlite3_reset(stmt);
+    }
+
+    sqlite3_exec(_G.db, "COMMIT TRANSACTION;", NULL, NULL, NULL);
+
+    ce_log_a0->debug("builddb", "Flush %u files, %u dependencies",
+                     ce_array_size(files), ce_array_size(depends) / 2);
+
+    ce_array_free(files, _G.allocator);
+    ce_array_free(cleared, _G.allocator);
+    ce_array_free(depends, _G.allocator);
 }
 
 void _add_dependency(const char *who_filename,
@@ -301,17 +620,42 @@ static struct ct_builddb_a0 build_db_api = {
     .get_filename_type_name = buildb_get_filename_type_name,
     .need_compile = builddb_need_compile,
     .add_dependency = _add_dependency,
+    .get_dependencies = builddb_get_dependencies,
+    .get_dependents = builddb_get_dependents,
+    .clear_dependencies = builddb_clear_dependencies,
+    .flush = builddb_flush,
 };
 
 struct ct_builddb_a0 *ct_builddb_a0 =  &build_db_api;
 
 static void _init(struct ce_api_a0 *api) {
+    _G = (struct _G) {.allocator = ce_memory_a0->system};
+
     api->register_api("ct_builddb_a0", ct_builddb_a0);
 
     builddb_init_db();
 }
 
 static void _shutdown() {
+    builddb_flush();
+
+    sqlite3_finalize(_G.put_file_stmt);
+    sqlite3_finalize(_G.set_depend_stmt);
+    sqlite3_finalize(_G.clear_depend_stmt);
+    sqlite3_close_v2(_G.db);
+
+    for (uint32_t i = 0; i < ce_array_size(_G.files); ++i) {
+        CE_FREE(_G.allocator, _G.files[i].filename);
+        ce_array_free(_G.files[i].depend_on, _G.allocator);
+    }
+
+    ce_array_free(_G.files, _G.allocator);
+    ce_array_free(_G.dirty_files, _G.allocator);
+    ce_array_free(_G.cleared_files, _G.allocator);
+    ce_array_free(_G.dirty_depends, _G.allocator);
+    ce_hash_free(&_G.file_map, _G.allocator);
+    ce_hash_free(&_G.build_map, _G.allocator);
+    ce_buffer_free(_G.logdb_path, ce_memory_a0->system);
 }
 
 CE_MODULE_DEF(
@@ -24,6 +24,9 @@ struct package_task_data {
     uint64_t name;
 };
 
+// Bump when compiled package format change.
+#define PACKAGE_COMPILER_VERSION 1
+
 #define _G PackageGlobals
 struct _G {
     struct ce_alloc *allocator;
@@ -32,11 +35,7 @@ struct _G {
 void online(uint64_t name,
             struct ce_vio *input,
             uint64_t obj) {
-    const uint64_t size = input->size(input);
-    char *data = CE_ALLOC(_G.allocator, char, size);
-    input->read(input, data, 1, size);
-
-    ce_cdb_a0->load(ce_cdb_a0->db(), data, obj, _G.allocator);
+    ce_cdb_a0->load_mapped(ce_cdb_a0->db(), input, obj, _G.allocator);
 }
 
 void offline(uint64_t name,
@@ -58,6 +57,10 @@ static uint64_t cdb_type() {
     return PACKAGE_TYPE;
 }
 
+static uint64_t compiler_version() {
+    return PACKAGE_COMPILER_VERSION;
+}
+
 
 //==============================================================================
 // Resource compiler
@@ -117,6 +120,7 @@ static struct ct_resource_i0 ct_resource_i0 = {
         .online = online,
         .offline =offline,
         .compilator = _package_compiler,
+        .compiler_version = compiler_version,
 };
 
 int package_init(struct ce_api_a0 *api) {
@@ -142,14 +146,24 @@ void package_shutdown() {
 
 }
 
-void package_load_task(void *data) {
-    uint64_t type_obj = (uint64_t) data;
+void package_load_task(uint32_t begin,
+                       uint32_t end,
+                       void *data) {
+    uint64_t types_obj = (uint64_t) data;
 
-    const uint64_t name_n = ce_cdb_a0->prop_count(type_obj);
-    uint64_t names[name_n];
-    ce_cdb_a0->prop_keys(type_obj, names);
+    const uint64_t type_n = ce_cdb_a0->prop_count(types_obj);
+    uint64_t types[type_n];
+    ce_cdb_a0->prop_keys(types_obj, types);
+
+    for (uint32_t i = begin; i < end; ++i) {
+        uint64_t type_obj = ce_cdb_a0->read_subobject(types_obj, types[i], 0);
 
-    ct_resource_a0->load_now(ce_cdb_a0->type(type_obj), names, name_n);
+        const uint64_t name_n = ce_cdb_a0->prop_count(type_obj);
+        uint64_t names[name_n];
+        ce_cdb_a0->prop_keys(type_obj, names);
+
+        ct_resource_a0->load_now(ce_cdb_a0->type(type_obj), names, name_n);
+    }
 }
 
 void package_task(void *data) {
@@ -163,25 +177,11 @@ void package_task(void *data) {
     uint64_t obj = ct_resource_a0->get(rid);
     uint64_t types_obj = ce_cdb_a0->read_subobject(obj, PACKAGE_TYPES_PROP, 0);
 
-    struct ce_task_item *load_tasks = NULL;
     const uint64_t type_n = ce_cdb_a0->prop_count(types_obj);
-    uint64_t types[type_n];
-    ce_cdb_a0->prop_keys(types_obj, types);
-
-    for (uint32_t j = 0; j < type_n; ++j) {
-        uint64_t type_obj = ce_cdb_a0->read_subobject(types_obj, types[j], 0);
-
-        struct ce_task_item item = {
-                .name = "package_task",
-                .work = package_load_task,
-                .data = (void *) type_obj,
-        };
-
-        ce_array_push(load_tasks, item, _G.allocator);
-    }
 
     struct ce_task_counter_t *counter = NULL;
-    ce_task_a0->add(load_tasks, type_n, &counter);
+    ce_task_a0->parallel_for(type_n, 1, package_load_task, (void *) types_obj,
+                             &counter);
     ce_task_a0->wait_for_counter(counter, 0);
 
     CE_FREE(_G.allocator, task_data);
@@ -177,6 +177,8 @@ static void load(uint64_t type,
         ce_buffer_free(build_full, _G.allocator);
 
         if (!resource_file) {
+            ce_cdb_a0->destroy_object(object);
+            resource_objects[i] = 0;
             continue;
         }
 
@@ -273,57 +275,85 @@ static uint64_t get_obj(struct ct_resource_id resource_id) {
     return object;
 }
 
+// Loaded resources get new object from build file, instances of old object
+// are moved to new one so prefab instances are notified.
 static void reload(uint64_t type,
                    uint64_t *names,
                    size_t count) {
+    struct ct_resource_i0 *resource_i = get_resource_interface(type);
+
+    if (!resource_i || !count) {
+        return;
+    }
+
+    uint64_t type_obj = ce_cdb_a0->read_subobject(_G.resource_db, type, 0);
+
+    uint64_t loaded_names[count];
+    uint64_t old_objects[count];
+    uint32_t loaded_n = 0;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        uint64_t object = ce_cdb_a0->read_subobject(type_obj, names[i], 0);
+
+        if (!object) {
+            continue;
+        }
+
+        loaded_names[loaded_n] = names[i];
+        old_objects[loaded_n] = object;
+        ++loaded_n;
+    }
+
+    if (!loaded_n) {
+        return;
+    }
+
+    load(type, loaded_names, loaded_n, 1);
+
+    for (uint32_t i = 0; i < loaded_n; ++i) {
+        uint64_t object = ce_cdb_a0->read_subobject(type_obj,
+                                                    loaded_names[i], 0);
 
-//        const uint32_t idx = map::get<uint32_t>(_G.type_map, ptype, 0);
-//        void* data = NULL;
-//        ct_resource_type_t type_clb = _G.resource_callbacks[idx];
-//
-//        const uint32_t type_item_idx = _find_type(ptype);
-//        type_item_t* type_item = &_G.type_items[type_item_idx];
-//
-//        load(ptype, names, count, 1);
-//        for (uint32_t i = 0; i < count; ++i) {
-//
-//            char filename[1024] = {};
-//            resource_compiler_get_filename(filename, CETECH_ARRAY_LEN(filename),
-//                                           ptype,
-//                                           names[i]);
-//#else
-//            char build_name[128] = {};
-//            type_name_string(build_name, CETECH_ARRAY_LEN(build_name),
-//                                       ptype, names[i]);
-//
-//            char *filename = build_name;
-//#endif
-//            ce_log_a0->debug("resource", "Reload resource %s ", filename);
-
-//            void *old_data = get(ptype, names[i]);
-//
-//            void *new_data = type_clb.reloader(names[i], old_data,
-//                                               loaded_data[i],
-//                                               _G.allocator);
-//
-//            uint64_t id = hash_combine(ptype, names[i]);
-//            uint32_t item_idx = map::get(_G.resource_map, id, UINT32_MAX);
-//            if (item_idx == UINT32_MAX) {
-//                continue;
-//            }
-//
-//            resource_item_t item = _G.resource_data[item_idx];
-//            item.data = new_data;
-//            //--item.ref_count; // Load call increase item.ref_count, because is loaded
-//            _G.resource_data[item_idx] = item;
-//        }
+        if (object == old_objects[i]) {
+            continue;
+        }
+
+        char filename[1024] = {};
+        resource_compiler_get_filename(filename, CE_ARRAY_LEN(filename),
+                                       (struct ct_resource_id) {
+                                               .type = type,
+                                               .name = loaded_names[i],
+                                       });
+
+        ce_log_a0->debug(LOG_WHERE, "Reload resource %s", filename);
+
+        ce_cdb_a0->move_instances(old_objects[i], object);
+
+        resource_i->offline(loaded_names[i], old_objects[i]);
+        ce_cdb_a0->destroy_object(old_objects[i]);
+    }
 }
 
 static void reload_all() {
-}
+    uint64_t *names = NULL;
 
-void resource_memory_reload(struct ct_resource_id resource_id,
-                            char **blob) {
+    for (uint32_t i = 0; i < _G.type_map.n; ++i) {
+        const uint64_t type = _G.type_map.keys[i];
+
+        if (EMPTY_SLOT == type) {
+            continue;
+        }
+
+        uint64_t type_obj = ce_cdb_a0->read_subobject(_G.resource_db,
+                                                      type, 0);
+
+        ce_array_resize(names, ce_cdb_a0->prop_count(type_obj), _G.allocator);
+        ce_cdb_a0->prop_keys(type_obj, names);
+
+        reload(type, names, ce_array_size(names));
+    }
+
+    ce_array_free(names, _G.allocator);
 }
 
 static struct ct_resource_a0 resource_api = {
@@ -344,6 +374,7 @@ static struct ct_resource_a0 resource_api = {
         .compiler_get_filename = resource_compiler_get_filename,
         .compiler_get_tmp_dir = resource_compiler_get_tmp_dir,
         .compiler_external_join = resource_compiler_external_join,
+        .compiler_external_hash = resource_compiler_external_hash,
         .type_name_from_filename = type_name_from_filename,
 
 };
@@ -402,8 +433,6 @@ static void _init(struct ce_api_a0 *api) {
 static void _shutdown() {
     package_shutdown();
 
-    ce_cdb_a0->destroy_db(_G.db);
-
     ce_hash_free(&_G.type_map, _G.allocator);
 }
 
@@ -25,6 +25,8 @@ char *resource_compiler_get_tmp_dir(struct ce_alloc *alocator,
 char *resource_compiler_external_join(struct ce_alloc *alocator,
                                       const char *name);
 
+uint64_t resource_compiler_external_hash(const char *name);
+
 void resource_compiler_create_build_dir(struct ce_config_a0 config);
 
 const char *resource_compiler_get_core_dir();
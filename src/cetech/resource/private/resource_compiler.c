@@ -23,6 +23,8 @@
 #include <celib/buffer.inl>
 #include <celib/cdb.h>
 #include <celib/yng.h>
+#include <celib/hash.inl>
+#include <celib/ebus.h>
 
 
 //==============================================================================
@@ -32,6 +34,14 @@
 #define MAX_TYPES 128
 #define _G ResourceCompilerGlobal
 
+// Bump when compiled data format change, invalidate artifact cache.
+#define COMPILER_VERSION 2
+
+#define HASH_CHUNK_SIZE (64 * 1024)
+
+// Wait for quiet period after last change, editors write file in more steps.
+#define RELOAD_DEBOUNCE_MS 100
+
 
 //==============================================================================
 // Globals
@@ -43,11 +53,45 @@ struct compile_task_data {
     struct ct_resource_id rid;
     time_t mtime;
     ct_resource_compilator_t compilator;
+    uint64_t ticks;
+    bool ok;
     atomic_int completed;
 };
 
+// Compile graph node, edges go from dependency to dependent resource.
+struct compile_node_t {
+    char *filename;
+    struct ct_resource_id rid;
+    ct_resource_compilator_t compilator;
+
+    uint32_t *depends;
+    uint32_t *dependents;
+
+    bool compile;
+    uint32_t wave;
+    uint32_t pending;
+
+    // Critical path
+    uint64_t finish;
+    uint32_t critical_pred;
+
+    struct compile_task_data *task;
+};
+
 static struct _G {
     uint64_t config;
+    char *cache_dir;
+    char *shared_cache_dir;
+
+    // Hot reload, changed source files waiting for debounce.
+    struct ce_hash_t changed;
+    char **changed_files;
+    uint64_t last_change;
+
+    // External tool content hash by tool name.
+    struct ce_hash_t external_hash;
+    struct ce_spinlock external_lock;
+
     struct ce_alloc *allocator;
 } _G;
 
@@ -84,9 +128,218 @@ void type_name_from_filename(const char *fullname,
 
 
 
+//==============================================================================
+// Artifact cache
+//==============================================================================
+
+// Compiled resources are stored in cache dir under content hash of source and
+// all its dependencies, so touch, branch switch or clean build reuse them.
+// Source key (source content + compiler version) point to manifest with
+// dependencies, artifact key is source key + dependencies content.
+// Shared cache dir is read only second tier, hits are copied to local cache.
+
+static uint64_t _hash_file(const char *filename,
+                           uint64_t seed) {
+    seed = ce_hash_murmur2_64(filename, strlen(filename), seed);
+
+    struct ce_vio *vio = ce_fs_a0->open(SOURCE_ROOT, filename, FS_OPEN_READ);
+    if (!vio) {
+        return ~seed;
+    }
+
+    char *buffer = CE_ALLOC(_G.allocator, char, HASH_CHUNK_SIZE);
+
+    int64_t size = vio->size(vio);
+    while (size > 0) {
+        const size_t n = vio->read(vio, buffer, 1, HASH_CHUNK_SIZE);
+        if (!n) {
+            break;
+        }
+
+        seed = ce_hash_murmur2_64(buffer, n, seed);
+        size -= n;
+    }
+
+    CE_FREE(_G.allocator, buffer);
+    ce_fs_a0->close(vio);
+
+    return seed;
+}
+
+static uint64_t _source_key(const char *filename,
+                            uint64_t type) {
+    struct ct_resource_i0 *i = ct_resource_a0->get_interface(type);
+
+    uint64_t version[] = {
+            COMPILER_VERSION,
+            type,
+            (i && i->compiler_version) ? i->compiler_version() : 0,
+    };
+
+    return _hash_file(filename, ce_hash_murmur2_64(version, sizeof(version),
+                                                   0));
+}
+
+static char *_cache_path(const char *dir,
+                         uint64_t key,
+                         const char *ext) {
+    char name[64] = {};
+    snprintf(name, CE_ARRAY_LEN(name), "%016" PRIx64 ".%s", key, ext);
+
+    char subdir[3] = {name[0], name[1]};
+
+    char *path = NULL;
+    ce_os_a0->path->join(&path, _G.allocator, 3, dir, subdir, name);
+    return path;
+}
+
+static bool _read_file(const char *path,
+                       char **output) {
+    struct ce_vio *vio = ce_os_a0->vio->from_file(path, VIO_OPEN_READ);
+    if (!vio) {
+        return false;
+    }
+
+    const int64_t size = vio->size(vio);
+    ce_array_resize(*output, size, _G.allocator);
+    vio->read(vio, *output, 1, size);
+    vio->close(vio);
+
+    return true;
+}
+
+// Readers can have old file open or mapped, publish complete file only.
+// Rename keep old content alive for them.
+static bool _publish_file(const char *path,
+                          const char *data,
+                          uint64_t size) {
+    char *tmp_path = NULL;
+    ce_buffer_printf(&tmp_path, _G.allocator, "%s.%" PRIx64, path,
+                     ce_os_a0->thread->actual_id());
+
+    bool ok = false;
+
+    struct ce_vio *vio = ce_os_a0->vio->from_file(tmp_path, VIO_OPEN_WRITE);
+    if (vio) {
+        ok = vio->write(vio, data, 1, size) == size;
+        vio->close(vio);
+
+        ok = ok && !rename(tmp_path, path);
+    }
+
+    if (!ok) {
+        remove(tmp_path);
+    }
+
+    ce_buffer_free(tmp_path, _G.allocator);
+
+    return ok;
+}
+
+static void _cache_write(uint64_t key,
+                         const char *ext,
+                         const char *data,
+                         uint64_t size) {
+    char *path = _cache_path(_G.cache_dir, key, ext);
+
+    char dir[1024] = {};
+    ce_os_a0->path->dir(dir, path);
+    ce_os_a0->path->make_path(dir);
+
+    _publish_file(path, data, size);
+
+    ce_buffer_free(path, _G.allocator);
+}
+
+static bool _cache_read(uint64_t key,
+                        const char *ext,
+                        char **output) {
+    char *path = _cache_path(_G.cache_dir, key, ext);
+    bool hit = _read_file(path, output);
+    ce_buffer_free(path, _G.allocator);
+
+    if (hit || !_G.shared_cache_dir) {
+        return hit;
+    }
+
+    path = _cache_path(_G.shared_cache_dir, key, ext);
+    hit = _read_file(path, output);
+    ce_buffer_free(path, _G.allocator);
+
+    if (hit) {
+        _cache_write(key, ext, *output, ce_array_size(*output));
+    }
+
+    return hit;
+}
+
+static bool _cache_fetch(const char *filename,
+                         uint64_t source_key,
+                         char **output) {
+    char *manifest = NULL;
+    if (!_cache_read(source_key, "deps", &manifest)) {
+        return false;
+    }
+
+    ce_array_push(manifest, '\0', _G.allocator);
+
+    const char **depends = NULL;
+    uint64_t key = source_key;
+
+    char *line = manifest;
+    char *end;
+    while ((end = strchr(line, '\n'))) {
+        *end = '\0';
+        ce_array_push(depends, line, _G.allocator);
+        key = _hash_file(line, key);
+        line = end + 1;
+    }
+
+    bool hit = _cache_read(key, "blob", output);
+
+    if (hit) {
+        for (uint32_t i = 0; i < ce_array_size(depends); ++i) {
+            ct_builddb_a0->add_dependency(filename, depends[i]);
+        }
+    }
+
+    ce_array_free(depends, _G.allocator);
+    ce_array_free(manifest, _G.allocator);
+
+    return hit;
+}
+
+static void _cache_store(const char *filename,
+                         uint64_t source_key,
+                         const char *output) {
+    const char **depends = NULL;
+    ct_builddb_a0->get_dependencies(filename, &depends, _G.allocator);
+
+    char *manifest = NULL;
+    uint64_t key = source_key;
+
+    for (uint32_t i = 0; i < ce_array_size(depends); ++i) {
+        if (!strcmp(depends[i], filename)) {
+            continue;
+        }
+
+        ce_buffer_printf(&manifest, _G.allocator, "%s\n", depends[i]);
+        key = _hash_file(depends[i], key);
+    }
+
+    // Blob first, manifest without blob is only miss.
+    _cache_write(key, "blob", output, ce_array_size(output));
+    _cache_write(source_key, "deps", manifest, ce_array_size(manifest));
+
+    ce_buffer_free(manifest, _G.allocator);
+    ce_array_free(depends, _G.allocator);
+}
+
 static void _compile_task(void *data) {
     struct compile_task_data *tdata = (struct compile_task_data *) data;
 
+    const uint64_t start = ce_os_a0->time->perf_counter();
+
     ce_log_a0->info("resource_compiler.task",
                     "Compile resource \"%s\" to \"" "%" PRIx64 "%" PRIx64"\"",
                     tdata->source_filename, tdata->rid.type,
@@ -94,7 +347,17 @@ static void _compile_task(void *data) {
 
     char *output_blob = NULL;
 
-    if (tdata->compilator) {
+    const uint64_t source_key = _source_key(tdata->source_filename,
+                                            tdata->rid.type);
+
+    ct_builddb_a0->clear_dependencies(tdata->source_filename);
+
+    if (_cache_fetch(tdata->source_filename, source_key, &output_blob)) {
+        ce_log_a0->info("resource_compiler.task",
+                        "Resource \"%s\" found in cache",
+                        tdata->source_filename);
+
+    } else if (tdata->compilator) {
         const char **files;
         uint32_t files_count;
 
@@ -108,6 +371,9 @@ static void _compile_task(void *data) {
         tdata->compilator(tdata->source_filename,
                           &output_blob);
 
+        if (ce_array_size(output_blob)) {
+            _cache_store(tdata->source_filename, source_key, output_blob);
+        }
     }
 
     if (!ce_array_size(output_blob)) {
@@ -119,20 +385,25 @@ static void _compile_task(void *data) {
         ct_builddb_a0->set_file_depend(tdata->source_filename,
                                        tdata->source_filename);
 
-        struct ce_vio *build_vio = ce_fs_a0->open(
-                BUILD_ROOT,
-                tdata->build_filename, FS_OPEN_WRITE);
+        // Loaded resources map previous build file.
+        char *build_path = NULL;
+        ce_os_a0->path->join(&build_path, _G.allocator, 2,
+                             ce_cdb_a0->read_str(_G.config, CONFIG_BUILD, ""),
+                             tdata->build_filename);
+
+        bool published = _publish_file(build_path, output_blob,
+                                       ce_array_size(output_blob));
 
-        ce_buffer_free(tdata->build_filename, _G.allocator);
+        ce_buffer_free(build_path, _G.allocator);
 
-        if (build_vio == NULL) {
+        if (!published) {
+            ce_log_a0->error("resource_compiler.task",
+                             "Could not write resource \"%s\"",
+                             tdata->source_filename);
             goto end;
         }
 
-        build_vio->write(build_vio, output_blob, sizeof(char),
-                         ce_array_size(output_blob));
-
-        ce_fs_a0->close(build_vio);
+        tdata->ok = true;
 
         ce_log_a0->info("resource_compiler.task",
                         "Resource \"%s\" compiled", tdata->source_filename);
@@ -140,10 +411,13 @@ static void _compile_task(void *data) {
 
     end:
     ce_array_free(output_blob, _G.allocator);
+    ce_buffer_free(tdata->build_filename, _G.allocator);
 
     CE_FREE(_G.allocator,
             tdata->source_filename);
 
+    tdata->ticks = ce_os_a0->time->perf_counter() - start;
+
     atomic_store_explicit(&tdata->completed, 1, memory_order_release);
 }
 
@@ -158,9 +432,46 @@ ct_resource_compilator_t _find_compilator(uint64_t type) {
 }
 
 
-void _compile_files(struct ce_task_item **tasks,
-                    char **files,
-                    uint32_t files_count) {
+static struct compile_task_data *_create_task(struct compile_node_t *node) {
+    char build_name[128] = {};
+    snprintf(build_name, CE_ARRAY_LEN(build_name), "%" PRIx64 "%" PRIx64,
+             node->rid.type, node->rid.name);
+
+    char *build_full = NULL;
+    ce_os_a0->path->join(&build_full,
+                         _G.allocator, 2,
+                         ce_cdb_a0->read_str(_G.config,
+                                             CONFIG_PLATFORM, ""),
+                         build_name);
+
+    struct compile_task_data *data = CE_ALLOC(_G.allocator,
+                                              struct compile_task_data,
+                                              sizeof(struct compile_task_data));
+
+    *data = (struct compile_task_data) {
+            .rid = node->rid,
+            .compilator = node->compilator,
+            .build_filename = build_full,
+            .source_filename = ce_memory_a0->str_dup(node->filename,
+                                                     _G.allocator),
+            .mtime = ce_fs_a0->file_mtime(SOURCE_ROOT, node->filename),
+
+            .completed = 0
+    };
+
+    return data;
+}
+
+static uint64_t _filename_hash(const char *filename) {
+    return ce_hash_murmur2_64(filename, strlen(filename), 0);
+}
+
+// Nodes for compilable files, edges from builddb dependencies of last build.
+static void _build_graph(struct compile_node_t **nodes,
+                         char **files,
+                         uint32_t files_count) {
+    struct ce_hash_t node_map = {};
+
     for (uint32_t i = 0; i < files_count; ++i) {
         struct ct_resource_id rid;
 
@@ -171,46 +482,240 @@ void _compile_files(struct ce_task_item **tasks,
             continue;
         }
 
-        if (!ct_builddb_a0->need_compile(files[i])) {
+        struct compile_node_t node = {
+                .filename = files[i],
+                .rid = rid,
+                .compilator = compilator,
+        };
+
+        ce_hash_add(&node_map, _filename_hash(files[i]),
+                    ce_array_size(*nodes), _G.allocator);
+
+        ce_array_push(*nodes, node, _G.allocator);
+    }
+
+    const uint32_t nodes_n = ce_array_size(*nodes);
+    const char **depends = NULL;
+
+    for (uint32_t i = 0; i < nodes_n; ++i) {
+        struct compile_node_t *node = &(*nodes)[i];
+
+        ce_array_clean(depends);
+        ct_builddb_a0->get_dependencies(node->filename, &depends,
+                                        _G.allocator);
+
+        for (uint32_t j = 0; j < ce_array_size(depends); ++j) {
+            uint64_t dep = ce_hash_lookup(&node_map,
+                                          _filename_hash(depends[j]),
+                                          UINT64_MAX);
+
+            if ((UINT64_MAX == dep) || (dep == i)) {
+                continue;
+            }
+
+            ce_array_push(node->depends, dep, _G.allocator);
+            ce_array_push((*nodes)[dep].dependents, i, _G.allocator);
+        }
+    }
+
+    ce_array_free(depends, _G.allocator);
+    ce_hash_free(&node_map, _G.allocator);
+}
+
+// Changed files and all their transitive dependents. Graph of changed files
+// contain only them, else changed are found by builddb mtimes.
+static uint32_t _mark_compile(struct compile_node_t *nodes,
+                              bool all) {
+    const uint32_t nodes_n = ce_array_size(nodes);
+
+    uint32_t *stack = NULL;
+    for (uint32_t i = 0; i < nodes_n; ++i) {
+        if (all || ct_builddb_a0->need_compile(nodes[i].filename)) {
+            nodes[i].compile = true;
+            ce_array_push(stack, i, _G.allocator);
+        }
+    }
+
+    uint32_t count = ce_array_size(stack);
+    while (ce_array_size(stack)) {
+        struct compile_node_t *node = &nodes[ce_array_back(stack)];
+        ce_array_pop_back(stack);
+
+        for (uint32_t i = 0; i < ce_array_size(node->dependents); ++i) {
+            struct compile_node_t *dependent = &nodes[node->dependents[i]];
+
+            if (!dependent->compile) {
+                dependent->compile = true;
+                ce_array_push(stack, node->dependents[i], _G.allocator);
+                ++count;
+            }
+        }
+    }
+
+    ce_array_free(stack, _G.allocator);
+
+    return count;
+}
+
+// Kahn's algorithm over compiled nodes, node wave is longest chain of
+// compiled dependencies. Nodes in cycle are placed to last wave.
+static uint32_t _assign_waves(struct compile_node_t *nodes,
+                              uint32_t **order) {
+    const uint32_t nodes_n = ce_array_size(nodes);
+
+    for (uint32_t i = 0; i < nodes_n; ++i) {
+        struct compile_node_t *node = &nodes[i];
+
+        if (!node->compile) {
             continue;
         }
 
-        char build_name[128] = {};
-        snprintf(build_name, CE_ARRAY_LEN(build_name), "%" PRIx64 "%" PRIx64, rid.type, rid.name);
+        for (uint32_t j = 0; j < ce_array_size(node->depends); ++j) {
+            if (nodes[node->depends[j]].compile) {
+                ++node->pending;
+            }
+        }
+
+        if (!node->pending) {
+            ce_array_push(*order, i, _G.allocator);
+        }
+    }
 
-        char *build_full = NULL;
-        ce_os_a0->path->join(&build_full,
-                             _G.allocator, 2,
-                             ce_cdb_a0->read_str(_G.config,
-                                                 CONFIG_PLATFORM, ""),
-                             build_name);
+    uint32_t waves_n = 0;
+    for (uint32_t k = 0; k < ce_array_size(*order); ++k) {
+        struct compile_node_t *node = &nodes[(*order)[k]];
 
-        struct compile_task_data *data = CE_ALLOC(_G.allocator,
-                                                  struct compile_task_data,
-                                                  sizeof(struct compile_task_data));
+        if (node->wave >= waves_n) {
+            waves_n = node->wave + 1;
+        }
 
-        *data = (struct compile_task_data) {
-                .rid = rid,
-                .compilator = compilator,
-                .build_filename = build_full,
-                .source_filename = ce_memory_a0->str_dup(files[i],
-                                                         _G.allocator),
-                .mtime = ce_fs_a0->file_mtime(SOURCE_ROOT, files[i]),
+        for (uint32_t i = 0; i < ce_array_size(node->dependents); ++i) {
+            struct compile_node_t *dependent = &nodes[node->dependents[i]];
 
-                .completed = 0
-        };
+            if (!dependent->compile) {
+                continue;
+            }
 
-        struct ce_task_item item = {
-                .name = "compiler_task",
-                .work = _compile_task,
-                .data = data
-        };
+            if (dependent->wave <= node->wave) {
+                dependent->wave = node->wave + 1;
+            }
 
-        ce_array_push(*tasks, item, _G.allocator);
-//        multi_map::insert(compiled, (uint64_t)rid.type, (uint64_t)rid.name);
+            if (!--dependent->pending) {
+                ce_array_push(*order, node->dependents[i], _G.allocator);
+            }
+        }
     }
+
+    const uint32_t cycle_wave = waves_n;
+    for (uint32_t i = 0; i < nodes_n; ++i) {
+        if (nodes[i].compile && nodes[i].pending) {
+            ce_log_a0->warning("resource_compiler",
+                               "Dependency cycle at \"%s\"",
+                               nodes[i].filename);
+
+            nodes[i].wave = cycle_wave;
+            waves_n = cycle_wave + 1;
+            ce_array_push(*order, i, _G.allocator);
+        }
+    }
+
+    return waves_n;
+}
+
+static void _compile_waves(struct compile_node_t *nodes,
+                           const uint32_t *order,
+                           uint32_t waves_n) {
+    struct ce_task_item *tasks = NULL;
+
+    for (uint32_t wave = 0; wave < waves_n; ++wave) {
+        ce_array_clean(tasks);
+
+        for (uint32_t k = 0; k < ce_array_size(order); ++k) {
+            struct compile_node_t *node = &nodes[order[k]];
+
+            if (node->wave != wave) {
+                continue;
+            }
+
+            node->task = _create_task(node);
+
+            struct ce_task_item item = {
+                    .name = "compiler_task",
+                    .work = _compile_task,
+                    .data = node->task,
+                    .big_stack = true,
+            };
+
+            ce_array_push(tasks, item, _G.allocator);
+        }
+
+        if (!ce_array_size(tasks)) {
+            continue;
+        }
+
+        struct ce_task_counter_t *counter = NULL;
+        ce_task_a0->add(tasks, ce_array_size(tasks), &counter);
+        ce_task_a0->wait_for_counter(counter, 0);
+    }
+
+    ce_array_free(tasks, _G.allocator);
 }
 
+// Longest chain of compile times, assets on it bottleneck the build.
+static void _report_critical_path(struct compile_node_t *nodes,
+                                  const uint32_t *order) {
+    const uint32_t order_n = ce_array_size(order);
+    if (!order_n) {
+        return;
+    }
+
+    uint32_t last = order[0];
+    for (uint32_t k = 0; k < order_n; ++k) {
+        struct compile_node_t *node = &nodes[order[k]];
+
+        node->critical_pred = UINT32_MAX;
+
+        uint64_t start = 0;
+        for (uint32_t i = 0; i < ce_array_size(node->depends); ++i) {
+            struct compile_node_t *dep = &nodes[node->depends[i]];
+
+            if (dep->compile && (dep->wave < node->wave) &&
+                (dep->finish > start)) {
+                start = dep->finish;
+                node->critical_pred = node->depends[i];
+            }
+        }
+
+        node->finish = start + node->task->ticks;
+
+        if (node->finish > nodes[last].finish) {
+            last = order[k];
+        }
+    }
+
+    const double freq = ce_os_a0->time->perf_freq();
+
+    uint32_t *path = NULL;
+    for (uint32_t i = last; i != UINT32_MAX; i = nodes[i].critical_pred) {
+        ce_array_push(path, i, _G.allocator);
+    }
+
+    char *report = NULL;
+    for (uint32_t k = ce_array_size(path); k > 0; --k) {
+        const struct compile_node_t *node = &nodes[path[k - 1]];
+
+        ce_buffer_printf(&report, _G.allocator, "\n    %s (%.2f ms)",
+                         node->filename, (node->task->ticks * 1000.0) / freq);
+    }
+
+    ce_log_a0->info("resource_compiler",
+                    "Critical path %.2f ms, %u resources:%s",
+                    (nodes[last].finish * 1000.0) / freq,
+                    ce_array_size(path), report);
+
+    ce_buffer_free(report, _G.allocator);
+    ce_array_free(path, _G.allocator);
+}
 
 //==============================================================================
 // Interface
@@ -238,32 +743,199 @@ void resource_compiler_create_build_dir(struct ce_config_a0 config) {
 //    _G.compilator_map_compilator[idx] = (struct compilator) {.compilator = compilator, .yaml_based = yaml_based};
 //}
 
-void _compile_all() {
-    struct ce_task_item *tasks = NULL;
-    const char *glob_patern = "**.*";
+// Changed files with all transitive dependents recorded in builddb.
+static void _changed_closure(char * const *changed,
+                             char ***files) {
+    struct ce_hash_t visited = {};
+
+    for (uint32_t i = 0; i < ce_array_size(changed); ++i) {
+        const uint64_t h = _filename_hash(changed[i]);
+
+        if (ce_hash_contain(&visited, h)) {
+            continue;
+        }
+
+        ce_hash_add(&visited, h, 1, _G.allocator);
+        ce_array_push(*files, ce_memory_a0->str_dup(changed[i], _G.allocator),
+                      _G.allocator);
+    }
+
+    const char **dependents = NULL;
+    for (uint32_t k = 0; k < ce_array_size(*files); ++k) {
+        ce_array_clean(dependents);
+        ct_builddb_a0->get_dependents((*files)[k], &dependents, _G.allocator);
+
+        for (uint32_t i = 0; i < ce_array_size(dependents); ++i) {
+            const uint64_t h = _filename_hash(dependents[i]);
+
+            if (ce_hash_contain(&visited, h)) {
+                continue;
+            }
+
+            ce_hash_add(&visited, h, 1, _G.allocator);
+            ce_array_push(*files,
+                          ce_memory_a0->str_dup(dependents[i], _G.allocator),
+                          _G.allocator);
+        }
+    }
+
+    ce_array_free(dependents, _G.allocator);
+    ce_hash_free(&visited, _G.allocator);
+}
+
+// Without changed compile all outdated files in source root.
+// Compiled nodes are in order by waves, free with _free_graph.
+static void _compile_graph(char * const *changed,
+                           struct compile_node_t **nodes,
+                           uint32_t **order) {
     char **files = NULL;
     uint32_t files_count = 0;
 
-    ce_fs_a0->listdir(SOURCE_ROOT,
-                      "", glob_patern, false, true, &files, &files_count,
-                      _G.allocator);
+    if (changed) {
+        _changed_closure(changed, &files);
+        files_count = ce_array_size(files);
+    } else {
+        const char *glob_patern = "**.*";
+        ce_fs_a0->listdir(SOURCE_ROOT,
+                          "", glob_patern, false, true, &files, &files_count,
+                          _G.allocator);
+    }
+
+    _build_graph(nodes, files, files_count);
+
+    const uint32_t compile_n = _mark_compile(*nodes, changed != NULL);
+    const uint32_t waves_n = _assign_waves(*nodes, order);
+
+    ce_log_a0->info("resource_compiler", "Compile %u resources in %u waves",
+                    compile_n, waves_n);
+
+    _compile_waves(*nodes, *order, waves_n);
+
+    ct_builddb_a0->flush();
 
-    _compile_files(&tasks, files, files_count);
+    _report_critical_path(*nodes, *order);
 
-    ce_fs_a0->listdir_free(files, files_count,
-                           _G.allocator);
+    if (changed) {
+        for (uint32_t i = 0; i < files_count; ++i) {
+            CE_FREE(_G.allocator, files[i]);
+        }
 
-    struct ce_task_counter_t *counter = NULL;
-    ce_task_a0->add(tasks, ce_array_size(tasks), &counter);
-    ce_task_a0->wait_for_counter(counter, 0);
+        ce_array_free(files, _G.allocator);
+    } else {
+        ce_fs_a0->listdir_free(files, files_count,
+                               _G.allocator);
+    }
+}
 
-    for (uint32_t i = 0; i < ce_array_size(tasks); ++i) {
-        struct compile_task_data *data = (struct compile_task_data *) tasks[i].data;
-        CE_FREE(_G.allocator, data);
+static void _free_graph(struct compile_node_t *nodes,
+                        uint32_t *order) {
+    for (uint32_t i = 0; i < ce_array_size(nodes); ++i) {
+        CE_FREE(_G.allocator, nodes[i].task);
+        ce_array_free(nodes[i].depends, _G.allocator);
+        ce_array_free(nodes[i].dependents, _G.allocator);
     }
-    ce_array_free(tasks, _G.allocator);
+
+    ce_array_free(order, _G.allocator);
+    ce_array_free(nodes, _G.allocator);
 }
 
+void _compile_all() {
+    struct compile_node_t *nodes = NULL;
+    uint32_t *order = NULL;
+
+    _compile_graph(NULL, &nodes, &order);
+
+    _free_graph(nodes, order);
+}
+
+static void _push_changed(const char *filename) {
+    const uint64_t h = _filename_hash(filename);
+
+    if (ce_hash_contain(&_G.changed, h)) {
+        return;
+    }
+
+    ce_hash_add(&_G.changed, h, 1, _G.allocator);
+    ce_array_push(_G.changed_files,
+                  ce_memory_a0->str_dup(filename, _G.allocator),
+                  _G.allocator);
+}
+
+// Recompile changed files with dependents and swap reloaded objects,
+// dependencies are reloaded before resources using them.
+static void _compile_changed() {
+    if (!ce_array_size(_G.changed_files)) {
+        return;
+    }
+
+    const uint64_t start = ce_os_a0->time->perf_counter();
+
+    struct compile_node_t *nodes = NULL;
+    uint32_t *order = NULL;
+
+    _compile_graph(_G.changed_files, &nodes, &order);
+
+    // Failed resource keep old object.
+    uint32_t reloaded_n = 0;
+    for (uint32_t k = 0; k < ce_array_size(order); ++k) {
+        struct compile_node_t *node = &nodes[order[k]];
+
+        if (!node->task->ok) {
+            continue;
+        }
+
+        ct_resource_a0->reload(node->rid.type, &node->rid.name, 1);
+        ++reloaded_n;
+    }
+
+    const double freq = ce_os_a0->time->perf_freq();
+    ce_log_a0->info("resource_compiler", "Hot reload %u resources %.2f ms",
+                    reloaded_n,
+                    ((ce_os_a0->time->perf_counter() - start) * 1000.0) /
+                    freq);
+
+    _free_graph(nodes, order);
+
+    for (uint32_t i = 0; i < ce_array_size(_G.changed_files); ++i) {
+        CE_FREE(_G.allocator, _G.changed_files[i]);
+    }
+
+    ce_array_clean(_G.changed_files);
+    ce_hash_clean(&_G.changed);
+    _G.last_change = 0;
+}
+
+static void _update(uint64_t event) {
+    CE_UNUSED(event);
+
+    char **files;
+    uint32_t files_count;
+    ce_fs_a0->changed_files(SOURCE_ROOT, &files, &files_count, _G.allocator);
+
+    const uint64_t now = ce_os_a0->time->perf_counter();
+
+    for (uint32_t i = 0; i < files_count; ++i) {
+        ce_ydb_a0->expire(files[i]);
+
+        _push_changed(files[i]);
+        _G.last_change = now;
+    }
+
+    ce_fs_a0->listdir_free(files, files_count, _G.allocator);
+
+    if (!_G.last_change) {
+        return;
+    }
+
+    const uint64_t debounce = (ce_os_a0->time->perf_freq() *
+                               RELOAD_DEBOUNCE_MS) / 1000;
+
+    if ((now - _G.last_change) < debounce) {
+        return;
+    }
+
+    _compile_changed();
+}
 
 void resource_compiler_compile_all() {
 //    Map<uint64_t> compieled(_G.allocator);
@@ -317,81 +989,49 @@ char *resource_compiler_external_join(struct ce_alloc *alocator,
     return result;
 }
 
+// Tool is hashed once, it does not change while compiler run.
+uint64_t resource_compiler_external_hash(const char *name) {
+    const uint64_t name_id = ce_id_a0->id64(name);
 
-void resource_memory_reload(struct ct_resource_id rid,
-                            char **blob);
+    ce_os_a0->thread->spin_lock(&_G.external_lock);
+    uint64_t hash = ce_hash_lookup(&_G.external_hash, name_id, 0);
+    ce_os_a0->thread->spin_unlock(&_G.external_lock);
 
-void compile_and_reload(const char *filename) {
-    char *output_blob = NULL;
+    if (hash) {
+        return hash;
+    }
 
-    struct ct_resource_id rid;
+    char *path = resource_compiler_external_join(_G.allocator, name);
 
-    type_name_from_filename(filename, &rid, NULL);
+    hash = ce_hash_murmur2_64(name, strlen(name), 0);
 
-    ct_resource_compilator_t compilator = _find_compilator(rid.type);
-    if (!compilator) {
-        goto error;
+    struct ce_vio *vio = ce_os_a0->vio->from_file(path, VIO_OPEN_READ);
+    if (vio) {
+        char *buffer = CE_ALLOC(_G.allocator, char, HASH_CHUNK_SIZE);
+
+        size_t n;
+        while ((n = vio->read(vio, buffer, 1, HASH_CHUNK_SIZE))) {
+            hash = ce_hash_murmur2_64(buffer, n, hash);
+        }
+
+        CE_FREE(_G.allocator, buffer);
+        vio->close(vio);
     }
 
-    compilator(filename, &output_blob);
+    ce_buffer_free(path, _G.allocator);
 
-    resource_memory_reload(rid, &output_blob);
-    ce_array_free(output_blob, _G.allocator);
-    return;
+    ce_os_a0->thread->spin_lock(&_G.external_lock);
+    ce_hash_add(&_G.external_hash, name_id, hash, _G.allocator);
+    ce_os_a0->thread->spin_unlock(&_G.external_lock);
 
-    error:
-    ce_array_free(output_blob, _G.allocator);
+    return hash;
 }
 
-//void resource_compiler_check_fs() {
-//    static uint64_t root = SOURCE_ROOT;
-//
-//    auto *wd_it = ce_fs_a0->event_begin(root);
-//    const auto *wd_end = ce_fs_a0->event_end(root);
-//    int need_compile = 0;
-//
-//    while (wd_it != wd_end) {
-//        if (wd_it->type == CT_WATCHDOG_EVENT_FILE_MODIFIED) {
-//            need_compile = 1;
-//            break;
-//        }
-//
-//        wd_it = ce_fs_a0->event_next(wd_it);
-//    }
-//
-//    if (need_compile) {
-//        ce_alloc *alloc = _G.allocator;
-//        celib::Map<uint64_t> type_name(alloc);
-//
-//        _compile_all(type_name);
-//
-//        auto *type_it = map::begin(type_name);
-//        auto *type_end = map::end(type_name);
-//
-//        uint64_t *name_array = NULL;
-//
-//        while (type_it != type_end) {
-//            uint64_t type_id = type_it->key;
-//
-//            ce_array_clean(name_array);
-//
-//            auto it = multi_map::find_first(type_name, type_id);
-//            while (it != nullptr) {
-//                ce_array_push(name_array, it->value, _G.allocator);
-//
-//                it = multi_map::find_next(type_name, it);
-//            }
-//
-//            ct_resource_a0->reload(static_cast<uint32_t>(type_id),
-//                                  reinterpret_cast<uint32_t *>(&name_array[0]),
-//                                  ce_array_size(name_array));
-//
-//            ++type_it;
-//        }
-//
-//        ce_array_free(name_array, _G.allocator);
-//    }
-//}
+void compile_and_reload(const char *filename) {
+    _push_changed(filename);
+
+    _compile_changed();
+}
 
 
 static void _init_cvar(struct ce_config_a0 *config) {
@@ -408,6 +1048,10 @@ static void _init_cvar(struct ce_config_a0 *config) {
         ce_cdb_a0->set_str(writer, CONFIG_EXTERNAL, "externals/build");
     }
 
+    if (!ce_cdb_a0->prop_exist(_G.config, CONFIG_CACHE)) {
+        ce_cdb_a0->set_str(writer, CONFIG_CACHE, "cache");
+    }
+
     ce_cdb_a0->write_commit(writer);
 }
 
@@ -434,7 +1078,6 @@ static void _init(struct ce_api_a0 *api) {
     package_init(api);
 
     _init_cvar(ce_config_a0);
-//    ct_app_a0->register_on_update(_update);
 
     const char *platform = ce_cdb_a0->read_str(_G.config,
                                                CONFIG_PLATFORM, "");
@@ -454,15 +1097,40 @@ static void _init(struct ce_api_a0 *api) {
     ce_buffer_free(tmp_dir_full, _G.allocator);
     ce_buffer_free(build_dir_full, _G.allocator);
 
+    const char *cache_dir = ce_cdb_a0->read_str(_G.config, CONFIG_CACHE, "");
+    ce_os_a0->path->join(&_G.cache_dir, _G.allocator, 2, cache_dir, platform);
+    ce_os_a0->path->make_path(_G.cache_dir);
+
+    const char *shared_cache_dir = ce_cdb_a0->read_str(_G.config,
+                                                       CONFIG_SHARED_CACHE,
+                                                       NULL);
+    if (shared_cache_dir) {
+        ce_os_a0->path->join(&_G.shared_cache_dir, _G.allocator, 2,
+                             shared_cache_dir, platform);
+    }
+
     const char *core_dir = ce_cdb_a0->read_str(_G.config, CONFIG_CORE, "");
     const char *source_dir = ce_cdb_a0->read_str(_G.config, CONFIG_SRC, "");
 
     ce_fs_a0->map_root_dir(SOURCE_ROOT, core_dir, true);
     ce_fs_a0->map_root_dir(SOURCE_ROOT, source_dir, true);
 
+    ce_ebus_a0->connect(KERNEL_EBUS, KERNEL_UPDATE_EVENT, _update, 0);
 }
 
 static void _shutdown() {
+    ce_ebus_a0->disconnect(KERNEL_EBUS, KERNEL_UPDATE_EVENT, _update);
+
+    for (uint32_t i = 0; i < ce_array_size(_G.changed_files); ++i) {
+        CE_FREE(_G.allocator, _G.changed_files[i]);
+    }
+
+    ce_array_free(_G.changed_files, _G.allocator);
+    ce_hash_free(&_G.changed, _G.allocator);
+    ce_hash_free(&_G.external_hash, _G.allocator);
+    ce_buffer_free(_G.cache_dir, _G.allocator);
+    ce_buffer_free(_G.shared_cache_dir, _G.allocator);
+
     _G = (struct _G) {};
 }
 
@@ -481,6 +1149,7 @@ CE_MODULE_DEF(
             CE_INIT_API(api, ce_yng_a0);
             CE_INIT_API(api, ce_ydb_a0);
             CE_INIT_API(api, ce_cdb_a0);
+            CE_INIT_API(api, ce_ebus_a0);
         },
         {
             CE_UNUSED(reload);
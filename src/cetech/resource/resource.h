@@ -27,6 +27,12 @@
 #define CONFIG_EXTERNAL \
      CE_ID64_0("external", 0x9fb8bb487a62dc4fULL)
 
+#define CONFIG_CACHE \
+     CE_ID64_0("cache", 0x65bf7446eac38b9cULL)
+
+#define CONFIG_SHARED_CACHE \
+     CE_ID64_0("shared_cache", 0xeb339437b7642b8bULL)
+
 #define RESOURCE_I_NAME \
     "ct_resource_i0"
 
@@ -78,6 +84,9 @@ struct ct_resource_i0 {
 
     void (*compilator)(const char *filename,
                        char **output);
+
+    // Optional, change invalidate cached compiled resources of this type.
+    uint64_t (*compiler_version)();
 };
 
 
@@ -140,6 +149,9 @@ struct ct_resource_a0 {
     char *(*compiler_external_join)(struct ce_alloc *a,
                                     const char *name);
 
+    // Content hash of external tool, use it in compiler_version.
+    uint64_t (*compiler_external_hash)(const char *name);
+
     void (*type_name_from_filename)(const char *fullname,
                                     struct ct_resource_id *resource_id,
                                     char *short_name);
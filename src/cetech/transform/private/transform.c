@@ -234,7 +234,22 @@ static void _component_spawner(uint64_t obj,
 
     transform_transform(transform, NULL);
 
-    ce_cdb_a0->register_notify(obj, _on_component_obj_change, NULL);
+    ce_cdb_a0->register_notify_deferred(obj, _on_component_obj_change, NULL);
+}
+
+// Instances of same prefab have same values so transform is computed once.
+static void _component_spawner_n(const uint64_t *obj,
+                                 void *data,
+                                 uint32_t n) {
+    struct ct_transform_comp *transform = data;
+
+    _component_spawner(obj[0], &transform[0]);
+
+    for (uint32_t i = 1; i < n; ++i) {
+        transform[i] = transform[0];
+        ce_cdb_a0->register_notify_deferred(obj[i], _on_component_obj_change,
+                                            NULL);
+    }
 }
 
 static uint64_t cdb_type() {
@@ -331,6 +346,7 @@ static struct ct_component_i0 ct_component_i0 = {
         .get_interface = get_interface,
         .compiler = _component_compiler,
         .spawner = _component_spawner,
+        .spawner_n = _component_spawner_n,
 };
 
 static void _init(struct ce_api_a0 *api) {
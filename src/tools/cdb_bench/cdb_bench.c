@@ -0,0 +1,328 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+
+#include <celib/core.h>
+#include <celib/log.h>
+#include <celib/os.h>
+#include <celib/memory.h>
+#include <celib/allocator.h>
+#include <celib/array.inl>
+#include <celib/cdb.h>
+#include <celib/task.h>
+
+#define PROP_COUNT 8
+#define GC_EVERY 1024
+
+enum {
+    PROP_UINT64 = 1,
+    PROP_FLOAT = 2,
+    PROP_STR = 3,
+    PROP_SUBOBJECT = 4,
+    PROP_BLOB = 5,
+};
+
+static struct _G {
+    uint64_t count;
+    bool json;
+    struct ce_cdb_t db;
+    uint64_t freq;
+} _G;
+
+struct bench_result {
+    const char *name;
+    uint64_t ops;
+    uint64_t ticks;
+    uint64_t bytes;
+};
+
+static uint64_t _pool_bytes() {
+    struct ce_cdb_stats stats = {};
+    ce_cdb_a0->db_stats(_G.db, &stats);
+    return stats.pool_bytes;
+}
+
+static void _report(const struct bench_result *r) {
+    const double sec = (double) r->ticks / _G.freq;
+    const double ops_sec = sec > 0 ? r->ops / sec : 0;
+
+    if (_G.json) {
+        printf("{\"bench\": \"%s\", \"ops\": %" PRIu64 ", "
+               "\"seconds\": %f, \"ops_per_sec\": %.0f, "
+               "\"bytes\": %" PRIu64 "}\n",
+               r->name, r->ops, sec, ops_sec, r->bytes);
+        return;
+    }
+
+    printf("%-16s %12" PRIu64 " ops %10.3f ms %14.0f ops/s %12" PRIu64 " B\n",
+           r->name, r->ops, sec * 1000.0, ops_sec, r->bytes);
+}
+
+static uint64_t _create_prefab() {
+    uint64_t obj = ce_cdb_a0->create_object(_G.db, 1);
+    uint64_t sub = ce_cdb_a0->create_object(_G.db, 2);
+
+    ce_cdb_obj_o *w = ce_cdb_a0->write_begin(sub);
+    ce_cdb_a0->set_str(w, PROP_STR, "subobject");
+    ce_cdb_a0->write_commit(w);
+
+    static char blob[256];
+    w = ce_cdb_a0->write_begin(obj);
+    ce_cdb_a0->set_uint64(w, PROP_UINT64, 42);
+    ce_cdb_a0->set_float(w, PROP_FLOAT, 1.0f);
+    ce_cdb_a0->set_str(w, PROP_STR, "prefab");
+    ce_cdb_a0->set_subobject(w, PROP_SUBOBJECT, sub);
+    ce_cdb_a0->set_blob(w, PROP_BLOB, blob, sizeof(blob));
+    for (uint64_t i = PROP_BLOB + 1; i <= PROP_COUNT; ++i) {
+        ce_cdb_a0->set_uint64(w, i, i);
+    }
+    ce_cdb_a0->write_commit(w);
+
+    return obj;
+}
+
+static void bench_create(uint64_t *objs) {
+    struct bench_result r = {.name = "create_object", .ops = _G.count};
+    const uint64_t bytes = _pool_bytes();
+
+    const uint64_t start = ce_os_a0->time->perf_counter();
+    for (uint64_t i = 0; i < _G.count; ++i) {
+        objs[i] = ce_cdb_a0->create_object(_G.db, 3);
+    }
+    r.ticks = ce_os_a0->time->perf_counter() - start;
+
+    for (uint64_t i = 0; i < _G.count; ++i) {
+        ce_cdb_obj_o *w = ce_cdb_a0->write_begin(objs[i]);
+        ce_cdb_a0->set_uint64(w, PROP_UINT64, i);
+        ce_cdb_a0->set_float(w, PROP_FLOAT, i);
+        ce_cdb_a0->write_commit(w);
+    }
+    ce_cdb_a0->gc();
+
+    r.bytes = _pool_bytes() - bytes;
+    _report(&r);
+}
+
+static void bench_create_from(uint64_t prefab,
+                              uint64_t *instances) {
+    struct bench_result r = {.name = "create_from", .ops = _G.count};
+    const uint64_t bytes = _pool_bytes();
+
+    const uint64_t start = ce_os_a0->time->perf_counter();
+    for (uint64_t i = 0; i < _G.count; ++i) {
+        instances[i] = ce_cdb_a0->create_from(_G.db, prefab);
+    }
+    r.ticks = ce_os_a0->time->perf_counter() - start;
+
+    r.bytes = _pool_bytes() - bytes;
+    _report(&r);
+}
+
+static void bench_read(const char *name,
+                       const uint64_t *objs) {
+    struct bench_result r = {.name = name, .ops = _G.count * 2};
+
+    volatile uint64_t sum = 0;
+    const uint64_t start = ce_os_a0->time->perf_counter();
+    for (uint64_t i = 0; i < _G.count; ++i) {
+        sum += ce_cdb_a0->read_uint64(objs[i], PROP_UINT64, 0);
+        sum += (uint64_t) ce_cdb_a0->read_float(objs[i], PROP_FLOAT, 0);
+    }
+    r.ticks = ce_os_a0->time->perf_counter() - start;
+
+    _report(&r);
+}
+
+static void bench_write_commit(uint64_t obj) {
+    struct bench_result r = {.name = "write_commit", .ops = _G.count};
+    const uint64_t bytes = _pool_bytes();
+
+    const uint64_t start = ce_os_a0->time->perf_counter();
+    for (uint64_t i = 0; i < _G.count; ++i) {
+        ce_cdb_obj_o *w = ce_cdb_a0->write_begin(obj);
+        ce_cdb_a0->set_uint64(w, PROP_UINT64, i);
+        ce_cdb_a0->write_commit(w);
+
+        if (!(i % GC_EVERY)) {
+            ce_cdb_a0->gc();
+        }
+    }
+    r.ticks = ce_os_a0->time->perf_counter() - start;
+
+    r.bytes = _pool_bytes() - bytes;
+    _report(&r);
+}
+
+static void bench_dump_load(uint64_t obj,
+                            bool compressed) {
+    struct ce_alloc *a = ce_memory_a0->system;
+    const uint64_t n = (_G.count / 100) + 1;
+
+    struct bench_result dump = {
+            .name = compressed ? "dump_compressed" : "dump",
+            .ops = n,
+    };
+
+    char *output = NULL;
+    uint64_t start = ce_os_a0->time->perf_counter();
+    for (uint64_t i = 0; i < n; ++i) {
+        ce_array_clean(output);
+        if (compressed) {
+            ce_cdb_a0->dump_compressed(obj, &output, a);
+        } else {
+            ce_cdb_a0->dump(obj, &output, a);
+        }
+    }
+    dump.ticks = ce_os_a0->time->perf_counter() - start;
+    dump.bytes = ce_array_size(output);
+    _report(&dump);
+
+    struct bench_result load = {
+            .name = compressed ? "load_compressed" : "load",
+            .ops = n,
+            .bytes = ce_array_size(output),
+    };
+
+    start = ce_os_a0->time->perf_counter();
+    for (uint64_t i = 0; i < n; ++i) {
+        uint64_t loaded = ce_cdb_a0->create_object(_G.db, 0);
+        ce_cdb_a0->load(_G.db, output, loaded, a);
+        ce_cdb_a0->destroy_object(loaded);
+
+        if (!(i % GC_EVERY)) {
+            ce_cdb_a0->gc();
+        }
+    }
+    load.ticks = ce_os_a0->time->perf_counter() - start;
+    _report(&load);
+
+    ce_array_free(output, a);
+}
+
+struct gc_thread_data {
+    atomic_bool done;
+    uint64_t gc_count;
+};
+
+static int _gc_thread(void *data) {
+    struct gc_thread_data *gc = data;
+
+    while (!atomic_load(&gc->done)) {
+        ce_cdb_a0->gc();
+        ++gc->gc_count;
+    }
+
+    return 0;
+}
+
+static void _write_range(uint32_t begin,
+                         uint32_t end,
+                         void *data) {
+    uint64_t *objs = data;
+
+    for (uint32_t i = begin; i < end; ++i) {
+        ce_cdb_obj_o *w = ce_cdb_a0->write_begin(objs[i]);
+        ce_cdb_a0->set_uint64(w, PROP_UINT64, i);
+        ce_cdb_a0->set_str(w, PROP_STR, "concurrent");
+        ce_cdb_a0->write_commit(w);
+
+        ce_cdb_a0->read_uint64(objs[i], PROP_UINT64, 0);
+    }
+}
+
+static void bench_gc_concurrent(uint64_t *objs) {
+    struct bench_result r = {.name = "gc_concurrent", .ops = _G.count};
+    const uint64_t bytes = _pool_bytes();
+
+    struct gc_thread_data gc = {};
+    ce_thread_t *thread = ce_os_a0->thread->create(_gc_thread, "cdb_bench_gc",
+                                                   &gc);
+
+    struct ce_task_counter_t *counter = NULL;
+
+    const uint64_t start = ce_os_a0->time->perf_counter();
+    ce_task_a0->parallel_for(_G.count, 0, _write_range, objs, &counter);
+    ce_task_a0->wait_for_counter(counter, 0);
+    r.ticks = ce_os_a0->time->perf_counter() - start;
+
+    atomic_store(&gc.done, true);
+    ce_os_a0->thread->wait(thread, NULL);
+
+    r.bytes = _pool_bytes() - bytes;
+    _report(&r);
+
+    if (!_G.json) {
+        printf("%-16s %12" PRIu64 " gc calls\n", "", gc.gc_count);
+    }
+}
+
+void print_usage() {
+    ce_log_a0->info(
+            "cdb_bench", "%s",
+
+            "usage: cdb_bench [--count N] [--json]\n"
+            "\n"
+            "  Measure CDB create, read, write, dump/load and gc.\n"
+            "\n"
+            "    --count N  - Objects per benchmark (default 100000)\n"
+            "    --json     - Print one json object per benchmark\n"
+            "    -h,--help  - Print this help\n"
+    );
+}
+
+int main(int argc,
+         const char **argv) {
+
+    _G.count = 100000;
+
+    bool printusage = false;
+    for (int i = 1; i < argc; ++i) {
+        if ((strcmp(argv[i], "--count") == 0) && (i + 1 < argc)) {
+            _G.count = strtoull(argv[i + 1], NULL, 10);
+            ++i;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            _G.json = true;
+        } else {
+            printusage = true;
+            break;
+        }
+    }
+
+    ce_log_a0->register_handler(ce_log_a0->stdout_handler, NULL);
+
+    if (printusage || !_G.count) {
+        print_usage();
+        return 1;
+    }
+
+    ce_init();
+
+    struct ce_alloc *a = ce_memory_a0->system;
+
+    _G.freq = ce_os_a0->time->perf_freq();
+    _G.db = ce_cdb_a0->create_db((_G.count * 4) + GC_EVERY);
+
+    uint64_t *objs = CE_ALLOC(a, uint64_t, sizeof(uint64_t) * _G.count);
+    uint64_t *instances = CE_ALLOC(a, uint64_t, sizeof(uint64_t) * _G.count);
+
+    const uint64_t prefab = _create_prefab();
+
+    bench_create(objs);
+    bench_create_from(prefab, instances);
+    bench_read("read", objs);
+    bench_read("read_prefab", instances);
+    bench_write_commit(objs[0]);
+    bench_dump_load(prefab, false);
+    bench_dump_load(prefab, true);
+    bench_gc_concurrent(objs);
+
+    CE_FREE(a, objs);
+    CE_FREE(a, instances);
+
+    ce_cdb_a0->destroy_db(_G.db);
+    ce_cdb_a0->gc();
+
+    ce_shutdown();
+}